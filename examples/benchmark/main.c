@@ -0,0 +1,308 @@
+#include <stdlib.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "pico/stdlib.h"
+#include "hardware/i2c.h"
+#include "hardware/irq.h"
+#include "i2c_dma.h"
+#include "cpu_load.h"
+#include "mprintf.h"
+
+// On-target benchmark. Reads the temperature register of an MCP9808 with
+// every combination of baudrate, read length, number of contending tasks and
+// mode (DMA based I2C or the Pico SDK blocking I2C functions) and prints one
+// line of key=value pairs per combination.
+//
+// CPU usage is measured with cpu_load which is calibrated without any I2C
+// activity at startup. Whatever CPU time the idle tasks don't get during a
+// run is attributed to I2C.
+
+static const uint8_t MCP9808_ADDR = 0x18;
+static const uint8_t MCP9808_TEMP_REG = 0x05;
+
+// After power-up the MCP9808 typically requires 250 ms to perform the first
+// conversion at the power-up default resolution. See datasheet.
+static const int32_t MCP9808_POWER_UP_DELAY_MS = 300;
+
+static const uint SDA_GPIO = 4;
+static const uint SCL_GPIO = 5;
+
+static const uint BAUDRATES[] = {100 * 1000, 400 * 1000, 1000 * 1000};
+
+// The MCP9808 keeps sending bytes if more than the two bytes of the
+// temperature register are read, so it can be used for longer reads too.
+static const size_t READ_LENGTHS[] = {2, 16, 64, 256};
+
+static const int TASK_COUNTS[] = {1, 2, 4};
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+// The benchmark_semaphore executable is built with I2C_DMA_TASK_NOTIFY
+// defined as 0, so that i2c_dma signals completions with a semaphore rather
+// than with task notifications.
+#if defined(I2C_DMA_TASK_NOTIFY) && I2C_DMA_TASK_NOTIFY == 0
+#define BENCH_COMPLETION "semaphore"
+#else
+#define BENCH_COMPLETION "notify"
+#endif
+
+#define MAX_READ_LENGTH 256
+#define MAX_TASKS 4
+#define RUN_MS 2000
+#define SETTLE_MS 20
+
+// Latencies of the last LATENCY_SAMPLES transactions of each task are kept
+// for percentiles.
+#define LATENCY_SAMPLES 1024
+
+// Modes in the order they're run for each baudrate, see bench_init_mode.
+typedef enum {
+  BENCH_MODE_DMA,
+  BENCH_MODE_SDK_BLOCKING,
+} bench_mode_t;
+
+static const char *const BENCH_MODE_NAMES[] = {"dma", "sdk_blocking"};
+
+typedef struct {
+  TaskHandle_t task;
+  uint32_t transactions;
+  uint32_t errors;
+  uint8_t rbuf[MAX_READ_LENGTH];
+  uint32_t latency_us[LATENCY_SAMPLES];
+} bench_worker_t;
+
+static bench_worker_t workers[MAX_TASKS];
+static uint32_t latency_us[MAX_TASKS * LATENCY_SAMPLES];
+
+// Set by the controller task before the workers are started. Not modified
+// while they're running.
+static bench_mode_t mode;
+static size_t read_len;
+static volatile bool stop;
+
+static TaskHandle_t controller;
+static i2c_dma_t *i2c0_dma;
+
+// The Pico SDK blocking I2C functions can't be called concurrently, so
+// contending tasks take turns just like they do inside i2c_dma.
+static SemaphoreHandle_t sdk_mutex;
+
+static int bench_read_sdk_blocking(uint8_t *rbuf, size_t len) {
+  xSemaphoreTake(sdk_mutex, portMAX_DELAY);
+
+  int rc = i2c_write_blocking(i2c0, MCP9808_ADDR, &MCP9808_TEMP_REG, 1, true);
+  if (rc == 1) {
+    rc = i2c_read_blocking(i2c0, MCP9808_ADDR, rbuf, len, false);
+  }
+
+  xSemaphoreGive(sdk_mutex);
+
+  if (rc < 1) {
+    return rc;
+  }
+
+  return rc == (int) len ? PICO_OK : PICO_ERROR_GENERIC;
+}
+
+static int bench_read_dma(uint8_t *rbuf, size_t len) {
+  return i2c_dma_write_read(
+    i2c0_dma, MCP9808_ADDR, &MCP9808_TEMP_REG, 1, rbuf, len
+  );
+}
+
+static void worker_task(void *args) {
+  bench_worker_t *worker = (bench_worker_t *) args;
+
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    worker->transactions = 0;
+    worker->errors = 0;
+
+    while (!stop) {
+      const uint32_t start_us = time_us_32();
+      const int rc = mode == BENCH_MODE_DMA ?
+        bench_read_dma(worker->rbuf, read_len) :
+        bench_read_sdk_blocking(worker->rbuf, read_len);
+      const uint32_t stop_us = time_us_32();
+
+      if (rc != PICO_OK) {
+        worker->errors += 1;
+      }
+
+      worker->latency_us[worker->transactions % LATENCY_SAMPLES] =
+        stop_us - start_us;
+      worker->transactions += 1;
+    }
+
+    xTaskNotifyGive(controller);
+  }
+}
+
+// Starts task_cnt workers, lets them run for RUN_MS and waits for them to
+// finish their last transaction. Returns the CPU load in percent and the
+// elapsed time in microseconds.
+static float bench_window(int task_cnt, uint64_t *elapsed_us) {
+  // Let the output of the previous run drain.
+  vTaskDelay(pdMS_TO_TICKS(SETTLE_MS));
+
+  stop = false;
+
+  cpu_load_snapshot_t start;
+  cpu_load_snapshot(&start);
+
+  for (int i = 0; i != task_cnt; ++i) {
+    xTaskNotifyGive(workers[i].task);
+  }
+
+  vTaskDelay(pdMS_TO_TICKS(RUN_MS));
+
+  stop = true;
+
+  for (int i = 0; i != task_cnt; ++i) {
+    ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+  }
+
+  cpu_load_snapshot_t end;
+  cpu_load_snapshot(&end);
+
+  *elapsed_us = end.time_us - start.time_us;
+
+  return cpu_load_between(&start, &end);
+}
+
+static int bench_compare_u32(const void *a, const void *b) {
+  const uint32_t x = *(const uint32_t *) a;
+  const uint32_t y = *(const uint32_t *) b;
+  return x < y ? -1 : x > y;
+}
+
+static void bench_run(uint baudrate, int task_cnt) {
+  uint64_t elapsed_us;
+  const float cpu_pct = bench_window(task_cnt, &elapsed_us);
+  const double elapsed_s = elapsed_us / 1e6;
+
+  uint32_t transactions = 0;
+  uint32_t errors = 0;
+  size_t samples = 0;
+
+  for (int i = 0; i != task_cnt; ++i) {
+    const bench_worker_t *worker = &workers[i];
+    const size_t n = worker->transactions < LATENCY_SAMPLES ?
+      worker->transactions : LATENCY_SAMPLES;
+
+    transactions += worker->transactions;
+    errors += worker->errors;
+
+    for (size_t j = 0; j != n; ++j) {
+      latency_us[samples++] = worker->latency_us[j];
+    }
+  }
+
+  qsort(latency_us, samples, sizeof(uint32_t), bench_compare_u32);
+
+  const uint32_t ok = transactions - errors;
+
+  mprintf(
+    "bench=read mode=%s completion=%s baudrate=%u len=%u tasks=%d n=%u "
+    "errors=%u tps=%.0f bytes_per_s=%.0f cpu_pct=%.1f "
+    "lat_p50_us=%u lat_p99_us=%u lat_max_us=%u\n",
+    BENCH_MODE_NAMES[mode], BENCH_COMPLETION, baudrate, (unsigned) read_len,
+    task_cnt, transactions, errors,
+    ok / elapsed_s, ok * (1 + read_len) / elapsed_s, cpu_pct,
+    samples > 0 ? latency_us[samples / 2] : 0,
+    samples > 0 ? latency_us[(samples * 99) / 100] : 0,
+    samples > 0 ? latency_us[samples - 1] : 0
+  );
+}
+
+// For each baudrate, i2c_dma is initialized first and the bus is then
+// handed to the Pico SDK. bench_window waits for the last transaction of
+// every worker, so i2c_dma has nothing in progress or queued when that
+// happens, and it only gets the bus back when it's initialized again for
+// the next baudrate.
+static int bench_init_mode(bench_mode_t new_mode, uint baudrate) {
+  mode = new_mode;
+
+  if (mode == BENCH_MODE_DMA) {
+    // Reinitializing is the only way to change the baudrate of a bus.
+    return i2c_dma_init(&i2c0_dma, i2c0, baudrate, SDA_GPIO, SCL_GPIO);
+  }
+
+  // i2c_init resets the peripheral and its interrupt mask, keep the i2c_dma
+  // interrupt handler from seeing its interrupts. i2c_dma_init enables it
+  // again.
+  irq_set_enabled(I2C0_IRQ, false);
+
+  i2c_init(i2c0, baudrate);
+  gpio_set_function(SDA_GPIO, GPIO_FUNC_I2C);
+  gpio_set_function(SCL_GPIO, GPIO_FUNC_I2C);
+  gpio_pull_up(SDA_GPIO);
+  gpio_pull_up(SCL_GPIO);
+
+  return PICO_OK;
+}
+
+static void controller_task(void *args) {
+  (void) args;
+
+  vTaskDelay(pdMS_TO_TICKS(MCP9808_POWER_UP_DELAY_MS));
+
+  cpu_load_calibrate(RUN_MS);
+
+  mprintf("bench=calibration run_ms=%d cores=%d\n", RUN_MS, CPU_LOAD_CORES);
+
+  for (size_t b = 0; b != ARRAY_SIZE(BAUDRATES); ++b) {
+    for (int m = BENCH_MODE_DMA; m <= BENCH_MODE_SDK_BLOCKING; ++m) {
+      const int rc = bench_init_mode((bench_mode_t) m, BAUDRATES[b]);
+      if (rc != PICO_OK) {
+        mprintf(
+          "bench=read mode=%s baudrate=%u error=init rc=%d\n",
+          BENCH_MODE_NAMES[m], BAUDRATES[b], rc
+        );
+        continue;
+      }
+
+      for (size_t l = 0; l != ARRAY_SIZE(READ_LENGTHS); ++l) {
+        read_len = READ_LENGTHS[l];
+
+        for (size_t t = 0; t != ARRAY_SIZE(TASK_COUNTS); ++t) {
+          bench_run(BAUDRATES[b], TASK_COUNTS[t]);
+        }
+      }
+    }
+  }
+
+  mprintf("bench=done\n");
+
+  vTaskSuspend(NULL);
+}
+
+int main(void) {
+  stdio_init_all();
+
+  sdk_mutex = xSemaphoreCreateMutex();
+
+  xTaskCreate(
+    controller_task,
+    "controller-task",
+    configMINIMAL_STACK_SIZE * 2,
+    NULL,
+    configMAX_PRIORITIES - 2,
+    &controller
+  );
+
+  for (int i = 0; i != MAX_TASKS; ++i) {
+    xTaskCreate(
+      worker_task,
+      "worker-task",
+      configMINIMAL_STACK_SIZE,
+      &workers[i],
+      configMAX_PRIORITIES - 3,
+      &workers[i].task
+    );
+  }
+
+  vTaskStartScheduler();
+}
@@ -0,0 +1,140 @@
+#include "FreeRTOS.h"
+#include "task.h"
+#include "pico/stdlib.h"
+#include "cpu_load.h"
+
+static volatile uint32_t idle_iterations[CPU_LOAD_CORES];
+
+// Idle iterations per second of each core without load. Zero for cores that
+// don't run the scheduler.
+static float idle_per_s[CPU_LOAD_CORES];
+static volatile bool calibrated = false;
+
+// The window is advanced by the tick hook.
+static cpu_load_snapshot_t window_start;
+static uint32_t window_ticks;
+static volatile float window_load[CPU_LOAD_CORES];
+static volatile bool window_valid = false;
+
+static float cpu_load_core_between(
+  uint core,
+  const cpu_load_snapshot_t *start,
+  const cpu_load_snapshot_t *end
+) {
+  const float expected =
+    idle_per_s[core] * ((end->time_us - start->time_us) / 1e6f);
+  if (expected <= 0) {
+    return -1;
+  }
+
+  const float load =
+    100.0f * (1.0f - (end->idle[core] - start->idle[core]) / expected);
+
+  return load < 0 ? 0 : load > 100 ? 100 : load;
+}
+
+void cpu_load_calibrate(uint32_t duration_ms) {
+  cpu_load_snapshot_t start;
+  cpu_load_snapshot_t end;
+
+  cpu_load_snapshot(&start);
+  vTaskDelay(pdMS_TO_TICKS(duration_ms));
+  cpu_load_snapshot(&end);
+
+  const float seconds = (end.time_us - start.time_us) / 1e6f;
+
+  taskENTER_CRITICAL();
+  for (uint core = 0; core != CPU_LOAD_CORES; ++core) {
+    idle_per_s[core] = (end.idle[core] - start.idle[core]) / seconds;
+  }
+  window_start = end;
+  window_ticks = 0;
+  window_valid = false;
+  calibrated = true;
+  taskEXIT_CRITICAL();
+}
+
+float cpu_load_get(void) {
+  if (!window_valid) {
+    return -1;
+  }
+
+  float total = 0;
+  uint cores = 0;
+
+  for (uint core = 0; core != CPU_LOAD_CORES; ++core) {
+    if (window_load[core] >= 0) {
+      total += window_load[core];
+      cores += 1;
+    }
+  }
+
+  return cores > 0 ? total / cores : -1;
+}
+
+float cpu_load_get_core(uint core) {
+  if (!window_valid || core >= CPU_LOAD_CORES) {
+    return -1;
+  }
+
+  return window_load[core];
+}
+
+void cpu_load_snapshot(cpu_load_snapshot_t *snapshot) {
+  snapshot->time_us = time_us_64();
+  for (uint core = 0; core != CPU_LOAD_CORES; ++core) {
+    snapshot->idle[core] = idle_iterations[core];
+  }
+}
+
+float cpu_load_between(
+  const cpu_load_snapshot_t *start,
+  const cpu_load_snapshot_t *end
+) {
+  if (!calibrated) {
+    return -1;
+  }
+
+  float total = 0;
+  uint cores = 0;
+
+  for (uint core = 0; core != CPU_LOAD_CORES; ++core) {
+    const float load = cpu_load_core_between(core, start, end);
+    if (load >= 0) {
+      total += load;
+      cores += 1;
+    }
+  }
+
+  return cores > 0 ? total / cores : -1;
+}
+
+void cpu_load_idle_hook(void) {
+  const uint core = get_core_num();
+
+  if (core < CPU_LOAD_CORES) {
+    idle_iterations[core] += 1;
+  }
+}
+
+void cpu_load_tick_hook(void) {
+  if (!calibrated) {
+    return;
+  }
+
+  window_ticks += 1;
+  if (window_ticks < pdMS_TO_TICKS(CPU_LOAD_WINDOW_MS)) {
+    return;
+  }
+  window_ticks = 0;
+
+  cpu_load_snapshot_t now;
+  cpu_load_snapshot(&now);
+
+  for (uint core = 0; core != CPU_LOAD_CORES; ++core) {
+    window_load[core] = cpu_load_core_between(core, &window_start, &now);
+  }
+
+  window_start = now;
+  window_valid = true;
+}
@@ -1,5 +1,6 @@
 #include "FreeRTOS.h"
 #include "task.h"
+#include "cpu_load.h"
 
 void vApplicationMallocFailedHook(void) {
   /* Called if a call to pvPortMalloc() fails because there is insufficient
@@ -25,21 +26,17 @@ void vApplicationStackOverflowHook(TaskHandle_t pxTask, char *pcTaskName) {
 }
 
 void vApplicationIdleHook(void) {
-  volatile size_t xFreeHeapSpace;
-
-  /* This is just a trivial example of an idle hook.  It is called on each
-  cycle of the idle task.  It must *NOT* attempt to block.  In this case the
-  idle task just queries the amount of FreeRTOS heap that remains.  See the
-  memory management section on the http://www.FreeRTOS.org web site for memory
-  management options.  If there is a lot of heap memory free then the
-  configTOTAL_HEAP_SIZE value in FreeRTOSConfig.h can be reduced to free up
-  RAM. */
-  xFreeHeapSpace = xPortGetFreeHeapSize();
-
-  /* Remove compiler warning about xFreeHeapSpace being set but never used. */
-  (void) xFreeHeapSpace;
+  /* Count idle iterations for the CPU load measurement in cpu_load.c. It must
+  *NOT* attempt to block. */
+  cpu_load_idle_hook();
 }
 
-void vApplicationTickHook(void) {
+void vApplicationPassiveIdleHook(void) {
+  /* With the SMP port, the idle tasks of the other cores call this hook
+  rather than vApplicationIdleHook. */
+  cpu_load_idle_hook();
 }
 
+void vApplicationTickHook(void) {
+  cpu_load_tick_hook();
+}
@@ -43,7 +43,7 @@
 /* Scheduler Related */
 #define configUSE_PREEMPTION                    1
 #define configUSE_TICKLESS_IDLE                 0
-#define configUSE_IDLE_HOOK                     0
+#define configUSE_IDLE_HOOK                     1
 #define configUSE_TICK_HOOK                     1
 #define configTICK_RATE_HZ                      ( ( TickType_t ) 1000 )
 #define configMAX_PRIORITIES                    32
@@ -63,6 +63,9 @@
 #define configUSE_NEWLIB_REENTRANT              0
 #define configENABLE_BACKWARD_COMPATIBILITY     0
 #define configNUM_THREAD_LOCAL_STORAGE_POINTERS 5
+#define configUSE_TASK_NOTIFICATIONS            1
+/* Index 0 is left to the application, i2c_dma uses index 1. */
+#define configTASK_NOTIFICATION_ARRAY_ENTRIES   2
 
 /* System */
 #define configSTACK_DEPTH_TYPE                  uint32_t
@@ -101,10 +104,17 @@
 #define configMAX_API_CALL_INTERRUPT_PRIORITY   [dependent on processor and application]
 */
 
-/* SMP port only */
-#define configNUM_CORES                         2
+/* SMP port only. Examples using both cores define configNUMBER_OF_CORES
+as 2 in their CMakeLists.txt. */
+#ifndef configNUMBER_OF_CORES
+#define configNUMBER_OF_CORES                   1
+#endif
 #define configTICK_CORE                         0
-#define configRUN_MULTIPLE_PRIORITIES           0
+#if configNUMBER_OF_CORES > 1
+#define configRUN_MULTIPLE_PRIORITIES           1
+#define configUSE_CORE_AFFINITY                 1
+#define configUSE_PASSIVE_IDLE_HOOK             1
+#endif
 
 /* RP2040 specific */
 #define configSUPPORT_PICO_SYNC_INTEROP         1
@@ -0,0 +1,69 @@
+#ifndef _CPU_LOAD_H
+#define _CPU_LOAD_H
+
+#include <stdint.h>
+#include "FreeRTOS.h"
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// CPU load measurement based on counting idle task iterations. The idle hook
+// increments a counter for the core it runs on. cpu_load_calibrate measures
+// how many iterations each core can do per second when nothing else runs, the
+// load is the fraction of those iterations missing in a measurement window.
+//
+// Requires configUSE_IDLE_HOOK and configUSE_TICK_HOOK (and
+// configUSE_PASSIVE_IDLE_HOOK with the SMP port) and the hooks in
+// freertos_hooks.c.
+
+#if defined(configNUMBER_OF_CORES)
+#define CPU_LOAD_CORES configNUMBER_OF_CORES
+#else
+#define CPU_LOAD_CORES 1
+#endif
+
+// Length of the window cpu_load_get and cpu_load_get_core report on.
+#ifndef CPU_LOAD_WINDOW_MS
+#define CPU_LOAD_WINDOW_MS 1000
+#endif
+
+typedef struct {
+  uint64_t time_us;
+  uint32_t idle[CPU_LOAD_CORES];
+} cpu_load_snapshot_t;
+
+// Measures the idle iterations per second of each core for duration_ms. Must
+// be called from a task while all other tasks are blocked, typically first
+// thing in a task at startup. Blocks for duration_ms.
+void cpu_load_calibrate(uint32_t duration_ms);
+
+// Returns the average load of all cores in percent over the last complete
+// window of CPU_LOAD_WINDOW_MS, or -1 if not calibrated yet.
+float cpu_load_get(void);
+
+// Returns the load of a core in percent over the last complete window of
+// CPU_LOAD_WINDOW_MS, or -1 if not calibrated yet or the core doesn't run
+// the scheduler.
+float cpu_load_get_core(uint core);
+
+// Takes a snapshot of the idle counters for cpu_load_between.
+void cpu_load_snapshot(cpu_load_snapshot_t *snapshot);
+
+// Returns the average load of all cores in percent between two snapshots, or
+// -1 if not calibrated yet.
+float cpu_load_between(
+  const cpu_load_snapshot_t *start,
+  const cpu_load_snapshot_t *end
+);
+
+// Called by the idle hooks and the tick hook in freertos_hooks.c.
+void cpu_load_idle_hook(void);
+void cpu_load_tick_hook(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -106,6 +106,9 @@ typedef UG_U32                                        UG_COLOR;
 #ifdef USE_COLOR_RGB565
 typedef UG_U16                                        UG_COLOR;
 #endif
+#ifdef USE_COLOR_MONO
+typedef UG_U8                                         UG_COLOR;
+#endif
 /* -------------------------------------------------------------------------------- */
 /* -- DEFINES                                                                    -- */
 /* -------------------------------------------------------------------------------- */
@@ -876,6 +879,148 @@ typedef struct
 #define  C_WHITE_SMOKE                0xF5F5F5
 #define  C_WHITE                      0xFFFFFF
 #endif
+#ifdef USE_COLOR_MONO
+/* Black = 0, white = 1. Colors brighter than 50% gray are white. */
+#define  C_MAROON                     0
+#define  C_DARK_RED                   0
+#define  C_BROWN                      0
+#define  C_FIREBRICK                  0
+#define  C_CRIMSON                    0
+#define  C_RED                        0
+#define  C_TOMATO                     1
+#define  C_CORAL                      1
+#define  C_INDIAN_RED                 0
+#define  C_LIGHT_CORAL                1
+#define  C_DARK_SALMON                1
+#define  C_SALMON                     1
+#define  C_LIGHT_SALMON               1
+#define  C_ORANGE_RED                 0
+#define  C_DARK_ORANGE                1
+#define  C_ORANGE                     1
+#define  C_GOLD                       1
+#define  C_DARK_GOLDEN_ROD            1
+#define  C_GOLDEN_ROD                 1
+#define  C_PALE_GOLDEN_ROD            1
+#define  C_DARK_KHAKI                 1
+#define  C_KHAKI                      1
+#define  C_OLIVE                      0
+#define  C_YELLOW                     1
+#define  C_YELLOW_GREEN               1
+#define  C_DARK_OLIVE_GREEN           0
+#define  C_OLIVE_DRAB                 0
+#define  C_LAWN_GREEN                 1
+#define  C_CHART_REUSE                1
+#define  C_GREEN_YELLOW               1
+#define  C_DARK_GREEN                 0
+#define  C_GREEN                      1
+#define  C_FOREST_GREEN               0
+#define  C_LIME                       1
+#define  C_LIME_GREEN                 1
+#define  C_LIGHT_GREEN                1
+#define  C_PALE_GREEN                 1
+#define  C_DARK_SEA_GREEN             1
+#define  C_MEDIUM_SPRING_GREEN        1
+#define  C_SPRING_GREEN               1
+#define  C_SEA_GREEN                  0
+#define  C_MEDIUM_AQUA_MARINE         1
+#define  C_MEDIUM_SEA_GREEN           1
+#define  C_LIGHT_SEA_GREEN            1
+#define  C_DARK_SLATE_GRAY            0
+#define  C_TEAL                       0
+#define  C_DARK_CYAN                  0
+#define  C_AQUA                       1
+#define  C_CYAN                       1
+#define  C_LIGHT_CYAN                 1
+#define  C_DARK_TURQUOISE             1
+#define  C_TURQUOISE                  1
+#define  C_MEDIUM_TURQUOISE           1
+#define  C_PALE_TURQUOISE             1
+#define  C_AQUA_MARINE                1
+#define  C_POWDER_BLUE                1
+#define  C_CADET_BLUE                 1
+#define  C_STEEL_BLUE                 0
+#define  C_CORN_FLOWER_BLUE           1
+#define  C_DEEP_SKY_BLUE              1
+#define  C_DODGER_BLUE                0
+#define  C_LIGHT_BLUE                 1
+#define  C_SKY_BLUE                   1
+#define  C_LIGHT_SKY_BLUE             1
+#define  C_MIDNIGHT_BLUE              0
+#define  C_NAVY                       0
+#define  C_DARK_BLUE                  0
+#define  C_MEDIUM_BLUE                0
+#define  C_BLUE                       0
+#define  C_ROYAL_BLUE                 0
+#define  C_BLUE_VIOLET                0
+#define  C_INDIGO                     0
+#define  C_DARK_SLATE_BLUE            0
+#define  C_SLATE_BLUE                 0
+#define  C_MEDIUM_SLATE_BLUE          0
+#define  C_MEDIUM_PURPLE              1
+#define  C_DARK_MAGENTA               0
+#define  C_DARK_VIOLET                0
+#define  C_DARK_ORCHID                0
+#define  C_MEDIUM_ORCHID              1
+#define  C_PURPLE                     0
+#define  C_THISTLE                    1
+#define  C_PLUM                       1
+#define  C_VIOLET                     1
+#define  C_MAGENTA                    0
+#define  C_ORCHID                     1
+#define  C_MEDIUM_VIOLET_RED          0
+#define  C_PALE_VIOLET_RED            1
+#define  C_DEEP_PINK                  0
+#define  C_HOT_PINK                   1
+#define  C_LIGHT_PINK                 1
+#define  C_PINK                       1
+#define  C_ANTIQUE_WHITE              1
+#define  C_BEIGE                      1
+#define  C_BISQUE                     1
+#define  C_BLANCHED_ALMOND            1
+#define  C_WHEAT                      1
+#define  C_CORN_SILK                  1
+#define  C_LEMON_CHIFFON              1
+#define  C_LIGHT_GOLDEN_ROD_YELLOW    1
+#define  C_LIGHT_YELLOW               1
+#define  C_SADDLE_BROWN               0
+#define  C_SIENNA                     0
+#define  C_CHOCOLATE                  0
+#define  C_PERU                       1
+#define  C_SANDY_BROWN                1
+#define  C_BURLY_WOOD                 1
+#define  C_TAN                        1
+#define  C_ROSY_BROWN                 1
+#define  C_MOCCASIN                   1
+#define  C_NAVAJO_WHITE               1
+#define  C_PEACH_PUFF                 1
+#define  C_MISTY_ROSE                 1
+#define  C_LAVENDER_BLUSH             1
+#define  C_LINEN                      1
+#define  C_OLD_LACE                   1
+#define  C_PAPAYA_WHIP                1
+#define  C_SEA_SHELL                  1
+#define  C_MINT_CREAM                 1
+#define  C_SLATE_GRAY                 0
+#define  C_LIGHT_SLATE_GRAY           1
+#define  C_LIGHT_STEEL_BLUE           1
+#define  C_LAVENDER                   1
+#define  C_FLORAL_WHITE               1
+#define  C_ALICE_BLUE                 1
+#define  C_GHOST_WHITE                1
+#define  C_HONEYDEW                   1
+#define  C_IVORY                      1
+#define  C_AZURE                      1
+#define  C_SNOW                       1
+#define  C_BLACK                      0
+#define  C_DIM_GRAY                   0
+#define  C_GRAY                       0
+#define  C_DARK_GRAY                  1
+#define  C_SILVER                     1
+#define  C_LIGHT_GRAY                 1
+#define  C_GAINSBORO                  1
+#define  C_WHITE_SMOKE                1
+#define  C_WHITE                      1
+#endif
 
 /* -------------------------------------------------------------------------------- */
 /* -- PROTOTYPES                                                                 -- */
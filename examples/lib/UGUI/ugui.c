@@ -4581,6 +4581,9 @@ UG_S16 UG_Init( UG_GUI* g, void (*p)(UG_S16,UG_S16,UG_COLOR), UG_S16 x, UG_S16 y
    #ifdef USE_COLOR_RGB565
    g->desktop_color = 0x5C5D;
    #endif
+   #ifdef USE_COLOR_MONO
+   g->desktop_color = C_BLACK;
+   #endif
    g->fore_color = C_WHITE;
    g->back_color = C_BLACK;
    g->next_window = NULL;
@@ -5248,6 +5251,103 @@ const UG_COLOR pal_checkbox_released[] =
 };
 #endif
 
+#ifdef USE_COLOR_MONO
+const UG_COLOR pal_window[] =
+{
+   /* Frame 0 */
+   C_BLACK,
+   C_BLACK,
+   C_BLACK,
+   C_BLACK,
+   /* Frame 1 */
+   C_WHITE,
+   C_WHITE,
+   C_BLACK,
+   C_BLACK,
+   /* Frame 2 */
+   C_WHITE,
+   C_WHITE,
+   C_WHITE,
+   C_WHITE,
+};
+
+const UG_COLOR pal_button_pressed[] =
+{
+   /* Frame 0 */
+   C_BLACK,
+   C_BLACK,
+   C_BLACK,
+   C_BLACK,
+   /* Frame 1 */
+   C_WHITE,
+   C_WHITE,
+   C_WHITE,
+   C_WHITE,
+   /* Frame 2 */
+   C_WHITE,
+   C_WHITE,
+   C_WHITE,
+   C_WHITE,
+};
+
+const UG_COLOR pal_button_released[] =
+{
+   /* Frame 0 */
+   C_BLACK,
+   C_BLACK,
+   C_BLACK,
+   C_BLACK,
+   /* Frame 1 */
+   C_WHITE,
+   C_WHITE,
+   C_BLACK,
+   C_BLACK,
+   /* Frame 2 */
+   C_WHITE,
+   C_WHITE,
+   C_WHITE,
+   C_WHITE,
+};
+
+const UG_COLOR pal_checkbox_pressed[] =
+{
+   /* Frame 0 */
+   C_BLACK,
+   C_BLACK,
+   C_BLACK,
+   C_BLACK,
+   /* Frame 1 */
+   C_WHITE,
+   C_WHITE,
+   C_WHITE,
+   C_WHITE,
+   /* Frame 2 */
+   C_WHITE,
+   C_WHITE,
+   C_WHITE,
+   C_WHITE,
+};
+
+const UG_COLOR pal_checkbox_released[] =
+{
+   /* Frame 0 */
+   C_BLACK,
+   C_BLACK,
+   C_BLACK,
+   C_BLACK,
+   /* Frame 1 */
+   C_WHITE,
+   C_WHITE,
+   C_BLACK,
+   C_BLACK,
+   /* Frame 2 */
+   C_WHITE,
+   C_WHITE,
+   C_WHITE,
+   C_WHITE,
+};
+#endif
+
 
 
 /* -------------------------------------------------------------------------------- */
@@ -5323,9 +5423,13 @@ void _UG_PutChar( char chr, UG_S16 x, UG_S16 y, UG_COLOR fc, UG_COLOR bc, const
 			  for( i=0;i<actual_char_width;i++ )
 			  {
 				 b = font->p[index++];
+				 #ifdef USE_COLOR_MONO
+				 color = (b & 0x80) ? fc : bc; // Threshold rather than blend
+				 #else
 				 color = ((((fc & 0xFF) * b + (bc & 0xFF) * (256 - b)) >> 8) & 0xFF) |//Blue component
 				         ((((fc & 0xFF00) * b + (bc & 0xFF00) * (256 - b)) >> 8)  & 0xFF00) |//Green component
 				         ((((fc & 0xFF0000) * b + (bc & 0xFF0000) * (256 - b)) >> 8) & 0xFF0000); //Red component
+				 #endif
 				 push_pixel(color);
 			  }
 			  index += font->char_width - actual_char_width;
@@ -5372,9 +5476,13 @@ void _UG_PutChar( char chr, UG_S16 x, UG_S16 y, UG_COLOR fc, UG_COLOR bc, const
             for( i=0;i<actual_char_width;i++ )
             {
                b = font->p[index++];
+               #ifdef USE_COLOR_MONO
+               color = (b & 0x80) ? fc : bc; // Threshold rather than blend
+               #else
                color = ((((fc & 0xFF) * b + (bc & 0xFF) * (256 - b)) >> 8) & 0xFF) |//Blue component
                        ((((fc & 0xFF00) * b + (bc & 0xFF00) * (256 - b)) >> 8)  & 0xFF00) |//Green component
                        ((((fc & 0xFF0000) * b + (bc & 0xFF0000) * (256 - b)) >> 8) & 0xFF0000); //Red component
+               #endif
                gui->pset(xo,yo,color);
                xo++;
             }
@@ -5836,7 +5944,12 @@ void UG_DrawBMP( UG_S16 xp, UG_S16 yp, UG_BMP* bmp )
          g<<=2;
          b = (tmp)&0x1F;
          b<<=3;
+         #ifdef USE_COLOR_MONO
+         /* Same luminance threshold as the C_xxx color defines */
+         c = ( (UG_U32)r*299 + (UG_U32)g*587 + (UG_U32)b*114 > 128500 ) ? C_WHITE : C_BLACK;
+         #else
          c = ((UG_COLOR)r<<16) | ((UG_COLOR)g<<8) | (UG_COLOR)b;
+         #endif
          UG_DrawPixel( xp++ , yp , c );
       }
       yp++;
@@ -5880,6 +5993,10 @@ UG_RESULT UG_WindowCreate( UG_WINDOW* wnd, UG_OBJECT* objlst, UG_U8 objcnt, void
    wnd->fc = 0x0000;
    wnd->bc = 0xEF7D;
    #endif
+   #ifdef USE_COLOR_MONO
+   wnd->fc = C_BLACK;
+   wnd->bc = C_WHITE;
+   #endif
    wnd->xs = 0;
    wnd->ys = 0;
    wnd->xe = UG_GetXDim()-1;
@@ -0,0 +1,157 @@
+#ifndef _SSD1306_H
+#define _SSD1306_H
+
+#include <stdint.h>
+#include "i2c_dma.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Driver for 128x64 pixel SSD1306 OLED displays. Drawing functions change a
+// pixel buffer in RAM, ssd1306_flush sends the changes to the display.
+//
+// The driver keeps the range of columns that may have changed in each page
+// of the pixel buffer, a page being a row of 8 pixel high bytes, and a copy
+// of what the display shows. A flush narrows each range down to the bytes
+// that really differ and sends only those, using SET_COLUMN_ADDRESS and
+// SET_PAGE_ADDRESS to select the window of display RAM they go to. A frame
+// that's cleared and redrawn only sends the columns where the old and new
+// frames differ.
+//
+// The ranges can be sent as one window per page or as a single window
+// covering all of them. ssd1306_flush estimates the bus time of both with the
+// cost model described in ssd1306.c and picks the cheaper, which is a full
+// flush when most of the display has changed. All windows are sent as one
+// transfer, so the task is only woken once per flush.
+//
+// The changed bytes are copied to a front buffer and sent from there, so
+// ssd1306_flush_start can return while they're being sent by DMA and the
+// next frame can be drawn into the pixel buffer at the same time. The frame
+// period is then the longer of the drawing and the sending time rather than
+// their sum.
+//
+// Requires the i2c_dma or i2c_dma_bare_metal library.
+
+#define SSD1306_WIDTH  128
+#define SSD1306_HEIGHT 64
+#define SSD1306_PAGES  (SSD1306_HEIGHT / 8)
+
+typedef enum {
+  SSD1306_BLACK = 0, // Clear the pixel
+  SSD1306_WHITE,     // Set the pixel
+  SSD1306_INVERT,    // Invert the pixel
+} ssd1306_color_t;
+
+typedef struct {
+  i2c_dma_t *i2c_dma;
+  uint8_t addr;
+
+  // Pixel buffer, SSD1306_PAGES pages of SSD1306_WIDTH columns. Bit n of a
+  // byte is row n of its page. Call ssd1306_mark_dirty after changing it
+  // directly.
+  uint8_t buffer[SSD1306_PAGES * SSD1306_WIDTH] __attribute__((aligned(4)));
+
+  // Front buffer, what the display shows once the flush in progress is
+  // complete. Valid once the first flush has been started.
+  uint8_t front[SSD1306_PAGES * SSD1306_WIDTH];
+  bool front_valid;
+
+  // Columns dirty_lo to dirty_hi of each page may have changed. A page is
+  // clean if dirty_lo is greater than dirty_hi.
+  uint8_t dirty_lo[SSD1306_PAGES];
+  uint8_t dirty_hi[SSD1306_PAGES];
+
+  // Storage for the messages of a flush, three per window.
+  i2c_dma_msg_t msgs[3 * SSD1306_PAGES];
+  uint8_t window_cmds[SSD1306_PAGES][7];
+  i2c_dma_xfer_t xfer;
+  bool flushing;
+
+  // Area being filled by ssd1306_area_push and the next pixel in it.
+  int area_x0;
+  int area_x1;
+  int area_x;
+  int area_y;
+  bool area_on_display;
+  uint8_t *area_byte; // Page byte of the next pixel if area_on_display
+  uint8_t area_mask;  // Bit of the next pixel in area_byte
+
+  // Statistics.
+  uint32_t flushes; // Flushes that sent something
+  uint32_t windows; // Windows sent
+  uint32_t bytes;   // Display data bytes sent
+  uint32_t errors;  // Flushes that failed
+} ssd1306_t;
+
+// Initializes the display at addr and clears it. The init commands are sent
+// as one transaction.
+//
+// Returns the same as i2c_dma_writev or ssd1306_flush.
+int ssd1306_init(
+  ssd1306_t *disp,    // Display to initialize
+  i2c_dma_t *i2c_dma, // i2c_dma_t pointer for the bus of the display
+  uint8_t addr        // 7 bit I2C address, typically 0x3c
+);
+
+// Sets, clears or inverts a pixel. Pixels outside the display are ignored.
+void ssd1306_draw_pixel(ssd1306_t *disp, int x, int y, ssd1306_color_t color);
+
+// Sets, clears or inverts all pixels in the rectangle with corners (x0, y0)
+// and (x1, y1). Up to 8 rows of pixels are changed at a time as a page byte,
+// and whole page bytes four at a time.
+void ssd1306_fill_rect(
+  ssd1306_t *disp, int x0, int y0, int x1, int y1, ssd1306_color_t color
+);
+
+// Sets, clears or inverts the pixels of a line from (x0, y0) to (x1, y1).
+// Horizontal and vertical lines are filled like rectangles.
+void ssd1306_draw_line(
+  ssd1306_t *disp, int x0, int y0, int x1, int y1, ssd1306_color_t color
+);
+
+// Starts filling the rectangle with corners (x0, y0) and (x1, y1), x0 <= x1
+// and y0 <= y1, with pixels passed to ssd1306_area_push. The pixels are
+// passed left to right, top to bottom, for example the pixels of a
+// character. The rectangle is marked dirty once rather than for each pixel.
+void ssd1306_area_begin(ssd1306_t *disp, int x0, int y0, int x1, int y1);
+
+// Sets, clears or inverts the next pixel of the area started with
+// ssd1306_area_begin. Pixels outside the display are skipped.
+void ssd1306_area_push(ssd1306_t *disp, ssd1306_color_t color);
+
+// Sets, clears or inverts all pixels.
+void ssd1306_fill(ssd1306_t *disp, ssd1306_color_t color);
+
+// Marks the pixels in a rectangle as possibly changed after the buffer has
+// been written to directly.
+void ssd1306_mark_dirty(ssd1306_t *disp, int x0, int y0, int x1, int y1);
+
+// Sends the pixels that have changed since the last flush to the display and
+// waits for them to be sent. Does nothing if nothing has changed. If the
+// transfer fails, what the display shows is unknown and the next flush sends
+// all pixels.
+//
+// Returns the same as i2c_dma_transfer.
+int ssd1306_flush(ssd1306_t *disp);
+
+// Starts sending the pixels that have changed since the last flush to the
+// display and returns without waiting for them to be sent. The pixel buffer
+// can be drawn into straight away. If a flush is still in progress, waits
+// for it to complete first. A failed flush is counted in errors and, as for
+// ssd1306_flush, the next flush sends all pixels.
+//
+// Returns the same as i2c_dma_submit.
+int ssd1306_flush_start(ssd1306_t *disp);
+
+// Waits for the flush started by ssd1306_flush_start to complete. Returns
+// immediately if no flush is in progress.
+//
+// Returns the same as i2c_dma_wait, PICO_OK if no flush is in progress.
+int ssd1306_flush_wait(ssd1306_t *disp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
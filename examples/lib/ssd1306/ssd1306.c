@@ -0,0 +1,556 @@
+#include <string.h>
+#include "ssd1306.h"
+
+typedef enum {
+  // Fundamental commands
+
+  SET_CONTRAST = 0x81,         // Double byte command to select 1 out of
+                               // 256 contrast steps.
+  SET_ENTIRE_DISP_ON = 0xa4,   // Bit0 = 0: Output follows RAM content.
+                               // Bit0 = 1: Output ignores RAM content,
+                               //           all pixels are turned on.
+  SET_NORMAL_INVERTED = 0xa6,  // Bit0 = 0: Normal display.
+                               // Bit0 = 1: Inverted display.
+  SET_DISP_ON_OFF = 0xae,      // Bit0 = 0: Display off, sleep mode.
+                               // Bit0 = 1: Display on, normal mode.
+
+  // Addressing setting Commands
+
+  SET_ADDRESSING_MODE = 0x20,  // Double byte command to set memory
+                               // addressing mode.
+  SET_COLUMN_ADDRESS = 0x21,   // Tripple byte command to setup column start
+                               // and end address.
+  SET_PAGE_ADDRESS = 0x22,     // Tripple byte command to setup page start and
+                               // end address.
+
+  // Hardware configuration (panel resolution and layout related) commands
+
+  SET_DISP_START_LINE = 0x40,  // Set display RAM display start line
+                               // register. Valid values are 0 to 63.
+  SET_SEGMENT_REMAP = 0xa0,    // Bit 0 = 0: Map col addr 0 to SEG0.
+                               // Bit 0 = 1: Map col addr 127 to SEG0.
+  SET_MUX_RATIO = 0xa8,        // Double byte command to configure display
+                               // height. Valid height values are 15 to 63.
+  SET_COM_OUTPUT_DIR = 0xc0,   // Bit 3 = 0: Scan from 0 to N-1.
+                               // Bit 3 = 1: Scan from N-1 to 0. (N=height)
+  SET_DISP_OFFSET = 0xd3,      // Double byte command to configure vertical
+                               // display shift. Valid values are 0 to 63.
+  SET_COM_PINS_CONFIG = 0xda,  // Double byte command to set COM pins
+                               // hardware configuration.
+
+  // Timing and driving scheme setting commands
+
+  SET_DCLK_FOSC = 0xd5,        // Double byte command to set display clock
+                               // divide ratio and oscillator frequency.
+  SET_PRECHARGE_PERIOD = 0xd9, // Double byte command to set pre-charge
+                               // period.
+  SET_VCOM_DESEL_LEVEL = 0xdb, // Double byte command to set VCOMH deselect
+                               // level.
+
+  // Charge pump command
+
+  SET_CHARGE_PUMP = 0x8d,      // Double byte command to enable/disable
+                               // charge pump.
+                               // Byte2 = 0x10: Disable charge pump.
+                               // Byte2 = 0x14: Enable charge pump.
+} ssd1306_command_t;
+
+// A control byte with Co = 0 is followed by a stream of commands or of
+// display data, depending on D/C#.
+static const uint8_t SSD1306_COMMAND_CONTROL_BYTE = 0x00;
+static uint8_t ssd1306_data_control_byte = 0x40;
+
+// A word of the pixel buffer, for filling four bytes at a time.
+typedef uint32_t __attribute__((may_alias)) ssd1306_word_t;
+
+// Cost model. A window of w columns and h pages costs w * h data bytes plus
+// a fixed overhead of SSD1306_WINDOW_COST bytes on the bus. The overhead is
+// a command transaction with the address, the control byte and the six
+// SET_COLUMN_ADDRESS and SET_PAGE_ADDRESS bytes, a data transaction with the
+// address and the control byte, and the start and stop conditions of both,
+// which take about as long as a byte together.
+#define SSD1306_WINDOW_COST 11
+
+static void ssd1306_clean(ssd1306_t *disp) {
+  memset(disp->dirty_lo, SSD1306_WIDTH, sizeof(disp->dirty_lo));
+  memset(disp->dirty_hi, 0, sizeof(disp->dirty_hi));
+}
+
+static void ssd1306_dirty(ssd1306_t *disp, int page, int x0, int x1) {
+  if (x0 < disp->dirty_lo[page]) {
+    disp->dirty_lo[page] = x0;
+  }
+  if (x1 > disp->dirty_hi[page]) {
+    disp->dirty_hi[page] = x1;
+  }
+}
+
+// Orders the corners of a rectangle and clips it to the display. Returns
+// false if no part of it is on the display.
+static bool ssd1306_clip(int *x0, int *y0, int *x1, int *y1) {
+  if (*x0 > *x1) {
+    const int x = *x0;
+    *x0 = *x1;
+    *x1 = x;
+  }
+  if (*y0 > *y1) {
+    const int y = *y0;
+    *y0 = *y1;
+    *y1 = y;
+  }
+
+  if (*x0 < 0) {
+    *x0 = 0;
+  }
+  if (*y0 < 0) {
+    *y0 = 0;
+  }
+  if (*x1 >= SSD1306_WIDTH) {
+    *x1 = SSD1306_WIDTH - 1;
+  }
+  if (*y1 >= SSD1306_HEIGHT) {
+    *y1 = SSD1306_HEIGHT - 1;
+  }
+
+  return *x0 <= *x1 && *y0 <= *y1;
+}
+
+int ssd1306_init(ssd1306_t *disp, i2c_dma_t *i2c_dma, uint8_t addr) {
+  const uint8_t commands[] = {
+    SET_DISP_ON_OFF | 0x00,         // Display off.
+    SET_DCLK_FOSC, 0x80,            // Set clock divide ratio and oscillator
+                                    //   frequency.
+    SET_MUX_RATIO, 0x3f,            // Set display height.
+    SET_DISP_OFFSET, 0x00,          // Set vertical display shift to 0.
+    SET_DISP_START_LINE,            // Set display RAM display start line
+                                    //   register to 0.
+    SET_CHARGE_PUMP, 0x14,          // Enable charge pump.
+    SET_SEGMENT_REMAP | 0x01,       // Map col addr 127 to SEG0.
+    SET_COM_OUTPUT_DIR | 0x08,      // Scan from N-1 to 0. (N=height)
+    SET_COM_PINS_CONFIG, 0x12,      // Set COM pins hardware configuration to
+                                    //   0x12.
+    SET_CONTRAST, 0xcf,             // Set contrast to 0xcf
+    SET_PRECHARGE_PERIOD, 0xf1,     // Set pre-charge to 0xf1
+    SET_VCOM_DESEL_LEVEL, 0x40,     // Set VCOMH deselect to 0x40
+    SET_ENTIRE_DISP_ON,             // Output follows RAM content.
+    SET_NORMAL_INVERTED | 0x00,     // Normal display.
+    SET_ADDRESSING_MODE, 0x00,      // Set addressing mode to horizontal mode.
+    SET_DISP_ON_OFF | 0x01,         // Display on.
+  };
+
+  memset(disp, 0, sizeof(*disp));
+  disp->i2c_dma = i2c_dma;
+  disp->addr = addr;
+  ssd1306_clean(disp);
+
+  // All commands are sent as one transaction after a single control byte,
+  // rather than as one transaction per command.
+  const i2c_dma_iovec_t message[] = {
+    {&SSD1306_COMMAND_CONTROL_BYTE, 1},
+    {commands, sizeof(commands)},
+  };
+  const int rc = i2c_dma_writev(i2c_dma, addr, message, 2);
+  if (rc != PICO_OK) {
+    return rc;
+  }
+
+  ssd1306_mark_dirty(disp, 0, 0, SSD1306_WIDTH - 1, SSD1306_HEIGHT - 1);
+
+  return ssd1306_flush(disp);
+}
+
+void ssd1306_draw_pixel(ssd1306_t *disp, int x, int y, ssd1306_color_t color) {
+  if (x < 0 || x >= SSD1306_WIDTH || y < 0 || y >= SSD1306_HEIGHT) {
+    return;
+  }
+
+  const int page = y / 8;
+  uint8_t *byte = &disp->buffer[page * SSD1306_WIDTH + x];
+  const uint8_t old = *byte;
+  const uint8_t bit_mask = 1 << (y % 8);
+
+  switch (color) {
+    case SSD1306_BLACK:
+      *byte &= ~bit_mask;
+      break;
+    case SSD1306_WHITE:
+      *byte |= bit_mask;
+      break;
+    default:
+      *byte ^= bit_mask;
+  }
+
+  if (*byte != old) {
+    ssd1306_dirty(disp, page, x, x);
+  }
+}
+
+// Inverts n bytes at p, four at a time where they're aligned.
+static void ssd1306_invert_bytes(uint8_t *p, int n) {
+  while (n != 0 && ((uintptr_t) p & 3) != 0) {
+    *p++ ^= 0xff;
+    n -= 1;
+  }
+
+  for (; n >= 4; n -= 4, p += 4) {
+    *(ssd1306_word_t *) p ^= 0xffffffff;
+  }
+
+  while (n-- != 0) {
+    *p++ ^= 0xff;
+  }
+}
+
+// Sets, clears or inverts the rows in mask of columns x0 to x1 of a page.
+static void ssd1306_fill_page(
+  ssd1306_t *disp, int page, int x0, int x1, uint8_t mask,
+  ssd1306_color_t color
+) {
+  uint8_t *p = &disp->buffer[page * SSD1306_WIDTH + x0];
+  const int n = x1 - x0 + 1;
+
+  if (mask == 0xff) {
+    // Whole bytes.
+    switch (color) {
+      case SSD1306_BLACK:
+        memset(p, 0x00, n);
+        break;
+      case SSD1306_WHITE:
+        memset(p, 0xff, n);
+        break;
+      default:
+        ssd1306_invert_bytes(p, n);
+    }
+  } else {
+    switch (color) {
+      case SSD1306_BLACK:
+        for (int i = 0; i != n; ++i) {
+          p[i] &= ~mask;
+        }
+        break;
+      case SSD1306_WHITE:
+        for (int i = 0; i != n; ++i) {
+          p[i] |= mask;
+        }
+        break;
+      default:
+        for (int i = 0; i != n; ++i) {
+          p[i] ^= mask;
+        }
+    }
+  }
+
+  ssd1306_dirty(disp, page, x0, x1);
+}
+
+void ssd1306_fill_rect(
+  ssd1306_t *disp, int x0, int y0, int x1, int y1, ssd1306_color_t color
+) {
+  if (!ssd1306_clip(&x0, &y0, &x1, &y1)) {
+    return;
+  }
+
+  const int page0 = y0 / 8;
+  const int page1 = y1 / 8;
+
+  for (int page = page0; page <= page1; ++page) {
+    // Rows of this page within y0 to y1.
+    const int lo = page == page0 ? y0 % 8 : 0;
+    const int hi = page == page1 ? y1 % 8 : 7;
+
+    ssd1306_fill_page(
+      disp, page, x0, x1, (0xff << lo) & (0xff >> (7 - hi)), color
+    );
+  }
+}
+
+void ssd1306_draw_line(
+  ssd1306_t *disp, int x0, int y0, int x1, int y1, ssd1306_color_t color
+) {
+  // Horizontal and vertical lines are filled a page byte at a time.
+  if (x0 == x1 || y0 == y1) {
+    ssd1306_fill_rect(disp, x0, y0, x1, y1, color);
+    return;
+  }
+
+  // Bresenham.
+  const int dx = x1 > x0 ? x1 - x0 : x0 - x1;
+  const int dy = y1 > y0 ? y0 - y1 : y1 - y0;
+  const int sx = x1 > x0 ? 1 : -1;
+  const int sy = y1 > y0 ? 1 : -1;
+  int err = dx + dy;
+
+  while (true) {
+    ssd1306_draw_pixel(disp, x0, y0, color);
+    if (x0 == x1 && y0 == y1) {
+      break;
+    }
+    const int e2 = 2 * err;
+    if (e2 >= dy) {
+      err += dy;
+      x0 += sx;
+    }
+    if (e2 <= dx) {
+      err += dx;
+      y0 += sy;
+    }
+  }
+}
+
+void ssd1306_fill(ssd1306_t *disp, ssd1306_color_t color) {
+  ssd1306_fill_rect(
+    disp, 0, 0, SSD1306_WIDTH - 1, SSD1306_HEIGHT - 1, color
+  );
+}
+
+void ssd1306_mark_dirty(ssd1306_t *disp, int x0, int y0, int x1, int y1) {
+  if (!ssd1306_clip(&x0, &y0, &x1, &y1)) {
+    return;
+  }
+
+  for (int page = y0 / 8; page <= y1 / 8; ++page) {
+    ssd1306_dirty(disp, page, x0, x1);
+  }
+}
+
+void ssd1306_area_begin(
+  ssd1306_t *disp, int x0, int y0, int x1, int y1
+) {
+  disp->area_x0 = x0;
+  disp->area_x1 = x1;
+  disp->area_x = x0;
+  disp->area_y = y0;
+
+  // If the area is on the display, the pixels are pushed without checks.
+  disp->area_on_display = x0 >= 0 && x1 < SSD1306_WIDTH &&
+    y0 >= 0 && y1 < SSD1306_HEIGHT;
+  if (disp->area_on_display) {
+    disp->area_byte = &disp->buffer[(y0 / 8) * SSD1306_WIDTH + x0];
+    disp->area_mask = 1 << (y0 % 8);
+  }
+
+  ssd1306_mark_dirty(disp, x0, y0, x1, y1);
+}
+
+void ssd1306_area_push(ssd1306_t *disp, ssd1306_color_t color) {
+  uint8_t *byte;
+  uint8_t bit_mask;
+  const int x = disp->area_x;
+  const int y = disp->area_y;
+
+  if (disp->area_on_display) {
+    byte = disp->area_byte;
+    bit_mask = disp->area_mask;
+  } else if (
+    x >= 0 && x < SSD1306_WIDTH && y >= 0 && y < SSD1306_HEIGHT
+  ) {
+    byte = &disp->buffer[(y / 8) * SSD1306_WIDTH + x];
+    bit_mask = 1 << (y % 8);
+  } else {
+    byte = NULL;
+    bit_mask = 0;
+  }
+
+  if (byte != NULL) {
+    switch (color) {
+      case SSD1306_BLACK:
+        *byte &= ~bit_mask;
+        break;
+      case SSD1306_WHITE:
+        *byte |= bit_mask;
+        break;
+      default:
+        *byte ^= bit_mask;
+    }
+  }
+
+  // Next pixel. At the end of a row of the area, the next row is the next
+  // bit of the first column, or bit 0 of the next page.
+  if (x != disp->area_x1) {
+    disp->area_x = x + 1;
+    if (disp->area_on_display) {
+      disp->area_byte += 1;
+    }
+  } else {
+    disp->area_x = disp->area_x0;
+    disp->area_y = y + 1;
+    if (disp->area_on_display) {
+      disp->area_byte -= disp->area_x1 - disp->area_x0;
+      disp->area_mask <<= 1;
+      if (disp->area_mask == 0) {
+        disp->area_mask = 1;
+        disp->area_byte += SSD1306_WIDTH;
+      }
+    }
+  }
+}
+
+// Adds the messages for a window of columns x0 to x1 and pages page0 to
+// page1 to the messages of a flush. Returns the number of messages added.
+static size_t ssd1306_add_window(
+  ssd1306_t *disp, size_t nmsgs, int x0, int x1, int page0, int page1
+) {
+  uint8_t *cmds = disp->window_cmds[nmsgs / 3];
+  i2c_dma_msg_t *msgs = &disp->msgs[nmsgs];
+  size_t n = 0;
+
+  cmds[0] = SSD1306_COMMAND_CONTROL_BYTE;
+  cmds[1] = SET_COLUMN_ADDRESS;
+  cmds[2] = x0;
+  cmds[3] = x1;
+  cmds[4] = SET_PAGE_ADDRESS;
+  cmds[5] = page0;
+  cmds[6] = page1;
+
+  msgs[n++] = (i2c_dma_msg_t) {disp->addr, I2C_DMA_M_STOP, cmds, 7};
+  msgs[n++] = (i2c_dma_msg_t) {disp->addr, 0, &ssd1306_data_control_byte, 1};
+
+  // The display RAM window is filled a page at a time, so a window of
+  // several pages is one data transaction made of a message per page. The
+  // bytes are sent from the front buffer.
+  for (int page = page0; page <= page1; ++page) {
+    uint8_t *front = &disp->front[page * SSD1306_WIDTH + x0];
+
+    memcpy(front, &disp->buffer[page * SSD1306_WIDTH + x0], x1 - x0 + 1);
+    msgs[n++] = (i2c_dma_msg_t) {
+      disp->addr,
+      I2C_DMA_M_NOSTART | (page == page1 ? I2C_DMA_M_STOP : 0),
+      front,
+      x1 - x0 + 1
+    };
+  }
+
+  disp->windows += 1;
+  disp->bytes += (x1 - x0 + 1) * (page1 - page0 + 1);
+
+  return n;
+}
+
+// Called after a flush failed. Some windows may have been written, others
+// not.
+static void ssd1306_flush_failed(ssd1306_t *disp) {
+  disp->front_valid = false;
+  disp->errors += 1;
+  ssd1306_mark_dirty(disp, 0, 0, SSD1306_WIDTH - 1, SSD1306_HEIGHT - 1);
+}
+
+int ssd1306_flush_start(ssd1306_t *disp) {
+  // The messages and the front buffer are in use until the flush in progress
+  // is complete. If it fails, everything is sent again.
+  ssd1306_flush_wait(disp);
+
+  int lo[SSD1306_PAGES];
+  int hi[SSD1306_PAGES];
+  int first_page = -1;
+  int last_page = -1;
+  int rect_lo = SSD1306_WIDTH;
+  int rect_hi = -1;
+  int pages_cost = 0;
+
+  // Narrow the dirty range of each page down to the bytes that differ from
+  // what the display shows.
+  for (int page = 0; page != SSD1306_PAGES; ++page) {
+    const uint8_t *buf = &disp->buffer[page * SSD1306_WIDTH];
+    const uint8_t *front = &disp->front[page * SSD1306_WIDTH];
+
+    lo[page] = disp->dirty_lo[page];
+    hi[page] = disp->dirty_hi[page];
+
+    if (disp->front_valid) {
+      while (lo[page] <= hi[page] && buf[lo[page]] == front[lo[page]]) {
+        lo[page] += 1;
+      }
+      while (hi[page] >= lo[page] && buf[hi[page]] == front[hi[page]]) {
+        hi[page] -= 1;
+      }
+    }
+
+    if (lo[page] > hi[page]) {
+      continue;
+    }
+
+    if (first_page == -1) {
+      first_page = page;
+    }
+    last_page = page;
+    if (lo[page] < rect_lo) {
+      rect_lo = lo[page];
+    }
+    if (hi[page] > rect_hi) {
+      rect_hi = hi[page];
+    }
+    pages_cost += SSD1306_WINDOW_COST + hi[page] - lo[page] + 1;
+  }
+
+  if (first_page == -1) {
+    ssd1306_clean(disp);
+    return PICO_OK;
+  }
+
+  // Send a window per page, or a single window around all of them if that's
+  // cheaper. The single window includes unchanged bytes, but saves the
+  // overhead of the other windows.
+  const int rect_cost = SSD1306_WINDOW_COST +
+    (rect_hi - rect_lo + 1) * (last_page - first_page + 1);
+  const bool single = rect_cost <= pages_cost;
+  size_t nmsgs = 0;
+
+  if (single) {
+    nmsgs += ssd1306_add_window(
+      disp, nmsgs, rect_lo, rect_hi, first_page, last_page
+    );
+  } else {
+    for (int page = first_page; page <= last_page; ++page) {
+      if (lo[page] <= hi[page]) {
+        nmsgs += ssd1306_add_window(
+          disp, nmsgs, lo[page], hi[page], page, page
+        );
+      }
+    }
+  }
+
+  ssd1306_clean(disp);
+
+  disp->xfer = (i2c_dma_xfer_t) {
+    .msgs = disp->msgs,
+    .nmsgs = nmsgs,
+  };
+
+  const int rc = i2c_dma_submit(disp->i2c_dma, &disp->xfer);
+
+  if (rc != PICO_OK) {
+    ssd1306_flush_failed(disp);
+    return rc;
+  }
+
+  disp->front_valid = true;
+  disp->flushing = true;
+  disp->flushes += 1;
+
+  return PICO_OK;
+}
+
+int ssd1306_flush_wait(ssd1306_t *disp) {
+  if (!disp->flushing) {
+    return PICO_OK;
+  }
+
+  const int rc = i2c_dma_wait(&disp->xfer);
+
+  disp->flushing = false;
+  if (rc != PICO_OK) {
+    ssd1306_flush_failed(disp);
+  }
+
+  return rc;
+}
+
+int ssd1306_flush(ssd1306_t *disp) {
+  const int rc = ssd1306_flush_start(disp);
+
+  if (rc != PICO_OK) {
+    return rc;
+  }
+
+  return ssd1306_flush_wait(disp);
+}
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "i2c_dma.h"
+
+static const uint8_t MCP9808_ADDR = 0x18;
+static const uint8_t MCP9808_TEMP_REG = 0x05;
+
+// After power-up the MCP9808 typically requires 250 ms to perform the first
+// conversion at the power-up default resolution. See datasheet.
+static const int32_t MCP9808_POWER_UP_DELAY_MS = 300;
+
+// There are no tasks, the LED is blinked from a timer interrupt while the
+// main loop is waiting for the I2C transactions to complete.
+static bool blink_led_callback(repeating_timer_t *timer) {
+  (void) timer;
+
+  gpio_xor_mask(1u << PICO_DEFAULT_LED_PIN);
+  return true;
+}
+
+static double mcp9808_raw_temp_to_celsius(uint16_t raw_temp) {
+  return (raw_temp & 0x0fff) / 16.0 - (raw_temp & 0x1000 ? 256 : 0);
+}
+
+int main(void) {
+  stdio_init_all();
+
+  static i2c_dma_t *i2c0_dma;
+  const int rc = i2c_dma_init(&i2c0_dma, i2c0, (1000 * 1000), 4, 5);
+  if (rc != PICO_OK) {
+    printf("can't configure I2C0\n");
+    return rc;
+  }
+
+  gpio_init(PICO_DEFAULT_LED_PIN);
+  gpio_set_dir(PICO_DEFAULT_LED_PIN, 1);
+  gpio_put(PICO_DEFAULT_LED_PIN, !PICO_DEFAULT_LED_PIN_INVERTED);
+
+  static repeating_timer_t blink_led_timer;
+  add_repeating_timer_ms(500, blink_led_callback, NULL, &blink_led_timer);
+
+  sleep_ms(MCP9808_POWER_UP_DELAY_MS);
+
+  uint64_t start_us = time_us_64();
+  int start_i = 0;
+
+  for (int err_cnt = 0, i = 0; true; i += 1) {
+    uint16_t raw_temp;
+    const int rc = i2c_dma_read_word_swapped(
+      i2c0_dma, MCP9808_ADDR, MCP9808_TEMP_REG, &raw_temp
+    );
+
+    if (rc != PICO_OK) {
+      err_cnt += 1;
+      printf("error (i: %d, rc: %d, errors: %d)\n", i, rc, err_cnt);
+    } else if (i - start_i >= 10000) {
+      const uint64_t now_us = time_us_64();
+      const double celsius = mcp9808_raw_temp_to_celsius(raw_temp);
+      printf(
+        "temp: %.4f (i: %d, errors: %d, reads/s: %.0f)\n",
+        celsius, i, err_cnt, (i - start_i) * 1e6 / (now_us - start_us)
+      );
+      start_us = now_us;
+      start_i = i;
+    }
+  }
+}
@@ -0,0 +1,110 @@
+#include "FreeRTOS.h"
+#include "task.h"
+#include "pico/stdlib.h"
+#include "i2c_dma.h"
+#include "cpu_load.h"
+#include "mprintf.h"
+
+static const uint8_t MCP9808_ADDR = 0x18;
+static const uint8_t MCP9808_TEMP_REG = 0x05;
+
+// After power-up the MCP9808 typically requires 250 ms to perform the first
+// conversion at the power-up default resolution. See datasheet.
+static const int32_t MCP9808_POWER_UP_DELAY_MS = 300;
+
+static const uint32_t CALIBRATION_MS = 1000;
+static const uint32_t SAMPLE_PERIOD_US = 10 * 1000;
+
+static double mcp9808_raw_temp_to_celsius(uint16_t raw_temp) {
+  return (raw_temp & 0x0fff) / 16.0 - (raw_temp & 0x1000 ? 256 : 0);
+}
+
+// Starts a periodic job that reads the temperature register every 10ms and
+// prints the latest sample once a second. The task is blocked in between,
+// the reads are started by an alarm and completed by the I2C interrupt
+// handler.
+static void mcp9808_task(void *args) {
+  i2c_dma_t *i2c_dma = (i2c_dma_t *) args;
+
+  vTaskDelay(pdMS_TO_TICKS(MCP9808_POWER_UP_DELAY_MS));
+
+  // Nothing else runs yet.
+  cpu_load_calibrate(CALIBRATION_MS);
+
+  static uint16_t data_cmds[3];
+  static i2c_dma_prepared_t prepared;
+  int rc = i2c_dma_prepare(
+    i2c_dma, &prepared, data_cmds, MCP9808_ADDR, &MCP9808_TEMP_REG, 1, 2
+  );
+  if (rc != PICO_OK) {
+    mprintf("can't prepare read (rc: %d)\n", rc);
+    vTaskSuspend(NULL);
+  }
+
+  static uint8_t buf[2 * 2];
+  static i2c_dma_periodic_t job;
+  job = (i2c_dma_periodic_t) {
+    .prepared = &prepared,
+    .buf = buf,
+    .period_us = SAMPLE_PERIOD_US,
+  };
+
+  rc = i2c_dma_periodic_start(&job);
+  if (rc != PICO_OK) {
+    mprintf("can't start periodic job (rc: %d)\n", rc);
+    vTaskSuspend(NULL);
+  }
+
+  uint32_t last_seq = 0;
+
+  while (true) {
+    vTaskDelay(pdMS_TO_TICKS(CPU_LOAD_WINDOW_MS));
+
+    uint8_t sample[2];
+    const uint32_t seq = i2c_dma_periodic_read(&job, sample);
+
+    if (seq == 0) {
+      mprintf(
+        "no sample yet (errors: %u, last rc: %d)\n",
+        (unsigned) job.errors, job.last_rc
+      );
+      continue;
+    }
+
+    const uint16_t raw_temp = (sample[0] << 8) | sample[1];
+    mprintf(
+      "temp: %.4f (seq: %u, samples/s: %u, errors: %u, overruns: %u, "
+      "load: %.1f%%)\n",
+      mcp9808_raw_temp_to_celsius(raw_temp),
+      (unsigned) seq,
+      (unsigned) (seq - last_seq),
+      (unsigned) job.errors,
+      (unsigned) job.overruns,
+      cpu_load_get()
+    );
+
+    last_seq = seq;
+  }
+}
+
+int main(void) {
+  stdio_init_all();
+
+  static i2c_dma_t *i2c0_dma;
+  const int rc = i2c_dma_init(&i2c0_dma, i2c0, (400 * 1000), 4, 5);
+  if (rc != PICO_OK) {
+    mprintf("can't configure I2C0\n");
+    return rc;
+  }
+
+  xTaskCreate(
+    mcp9808_task,
+    "mcp9808-task",
+    configMINIMAL_STACK_SIZE,
+    i2c0_dma,
+    configMAX_PRIORITIES - 2,
+    NULL
+  );
+
+  vTaskStartScheduler();
+}
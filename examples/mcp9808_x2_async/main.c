@@ -0,0 +1,157 @@
+#include "FreeRTOS.h"
+#include "task.h"
+#include "pico/stdlib.h"
+#include "i2c_dma.h"
+#include "mprintf.h"
+
+static const uint8_t MCP9808_ADDR = 0x18;
+static const uint8_t MCP9808_TEMP_REG = 0x05;
+
+// After power-up the MCP9808 typically requires 250 ms to perform the first
+// conversion at the power-up default resolution. See datasheet.
+static const int32_t MCP9808_POWER_UP_DELAY_MS = 300;
+
+typedef struct {
+  i2c_dma_t *i2c0_dma;
+  i2c_dma_t *i2c1_dma;
+} mcp9808_x2_t;
+
+static void blink_led_task(void *args) {
+  (void) args;
+
+  gpio_init(PICO_DEFAULT_LED_PIN);
+  gpio_set_dir(PICO_DEFAULT_LED_PIN, 1);
+  gpio_put(PICO_DEFAULT_LED_PIN, !PICO_DEFAULT_LED_PIN_INVERTED);
+
+  while (true) {
+    gpio_xor_mask(1u << PICO_DEFAULT_LED_PIN);
+    vTaskDelay(pdMS_TO_TICKS(500));
+  }
+}
+
+static double mcp9808_raw_temp_to_celsius(const uint8_t raw_temp[2]) {
+  const uint16_t raw = raw_temp[0] << 8 | raw_temp[1];
+  return (raw & 0x0fff) / 16.0 - (raw & 0x1000 ? 256 : 0);
+}
+
+static void mcp9808_report(
+  int bus, const uint8_t raw_temp[2], int rc, int i, int *err_cnt
+) {
+  if (rc != PICO_OK) {
+    *err_cnt += 1;
+    mprintf(
+      "bus %d, error (i: %d, rc: %d, errors: %d)\n", bus, i, rc, *err_cnt
+    );
+  } else if (i % 10000 == 0) {
+    const double celsius = mcp9808_raw_temp_to_celsius(raw_temp);
+    mprintf(
+      "bus %d, temp: %.4f (i: %d, errors: %d)\n", bus, celsius, i, *err_cnt
+    );
+  }
+}
+
+// A single task reads the temperature from both sensors. Both transactions
+// are submitted before waiting for either of them so the two I2C buses are
+// busy at the same time.
+static void mcp9808_x2_task(void *args) {
+  mcp9808_x2_t *mcp9808_x2 = (mcp9808_x2_t *) args;
+
+  vTaskDelay(pdMS_TO_TICKS(MCP9808_POWER_UP_DELAY_MS));
+
+  uint8_t raw_temp0[2];
+  uint8_t raw_temp1[2];
+
+  i2c_dma_xfer_t xfer0 = {
+    .addr = MCP9808_ADDR,
+    .wbuf = &MCP9808_TEMP_REG,
+    .wbuf_len = 1,
+    .rbuf = raw_temp0,
+    .rbuf_len = 2,
+  };
+
+  i2c_dma_xfer_t xfer1 = {
+    .addr = MCP9808_ADDR,
+    .wbuf = &MCP9808_TEMP_REG,
+    .wbuf_len = 1,
+    .rbuf = raw_temp1,
+    .rbuf_len = 2,
+  };
+
+  for (int err_cnt0 = 0, err_cnt1 = 0, i = 0; true; i += 1) {
+    int rc0 = i2c_dma_submit(mcp9808_x2->i2c0_dma, &xfer0);
+    int rc1 = i2c_dma_submit(mcp9808_x2->i2c1_dma, &xfer1);
+
+    if (rc0 == PICO_OK) {
+      rc0 = i2c_dma_wait(&xfer0);
+    }
+    if (rc1 == PICO_OK) {
+      rc1 = i2c_dma_wait(&xfer1);
+    }
+
+    mcp9808_report(0, raw_temp0, rc0, i, &err_cnt0);
+    mcp9808_report(1, raw_temp1, rc1, i, &err_cnt1);
+  }
+}
+
+static void waste_time_task(void *args) {
+  (void) args;
+
+  double billion_iterations = 0;
+
+  while (true) {
+    for (int j = 0; j != 100 * 1000 * 1000; j += 1) {
+      __asm__("nop");
+    }
+
+    billion_iterations += 0.1;
+
+    mprintf("%.1f billion iterations\n", billion_iterations);
+  }
+}
+
+int main(void) {
+  stdio_init_all();
+
+  static mcp9808_x2_t mcp9808_x2;
+
+  int rc = i2c_dma_init(&mcp9808_x2.i2c0_dma, i2c0, (1000 * 1000), 4, 5);
+  if (rc != PICO_OK) {
+    mprintf("can't configure I2C0\n");
+    return rc;
+  }
+
+  rc = i2c_dma_init(&mcp9808_x2.i2c1_dma, i2c1, (1000 * 1000), 6, 7);
+  if (rc != PICO_OK) {
+    mprintf("can't configure I2C1\n");
+    return rc;
+  }
+
+  xTaskCreate(
+    blink_led_task,
+    "blink-led-task",
+    configMINIMAL_STACK_SIZE,
+    NULL,
+    configMAX_PRIORITIES - 2,
+    NULL
+  );
+
+  xTaskCreate(
+    mcp9808_x2_task,
+    "mcp9808-x2-task",
+    configMINIMAL_STACK_SIZE,
+    &mcp9808_x2,
+    configMAX_PRIORITIES - 2,
+    NULL
+  );
+
+  xTaskCreate(
+    waste_time_task,
+    "waste-time-task",
+    configMINIMAL_STACK_SIZE,
+    NULL,
+    configMAX_PRIORITIES - 4,
+    NULL
+  );
+
+  vTaskStartScheduler();
+}
@@ -0,0 +1,130 @@
+#include "FreeRTOS.h"
+#include "task.h"
+#include "pico/stdlib.h"
+#include "i2c_dma.h"
+#include "cpu_load.h"
+#include "mprintf.h"
+
+static const uint8_t MCP9808_ADDR = 0x18;
+static const uint8_t MCP9808_TEMP_REG = 0x05;
+
+// After power-up the MCP9808 typically requires 250 ms to perform the first
+// conversion at the power-up default resolution. See datasheet.
+static const int32_t MCP9808_POWER_UP_DELAY_MS = 300;
+
+static const uint32_t CALIBRATION_MS = 1000;
+
+typedef struct {
+  i2c_inst_t *i2c;
+  uint sda_gpio;
+  uint scl_gpio;
+  uint core;
+  i2c_dma_irq_core_t irq_core;
+  TaskHandle_t task;
+  volatile uint32_t reads;
+  volatile uint32_t errors;
+} bus_t;
+
+static bus_t buses[] = {
+  {.i2c = i2c0, .sda_gpio = 4, .scl_gpio = 5,
+   .core = 0, .irq_core = I2C_DMA_IRQ_CORE_0},
+  {.i2c = i2c1, .sda_gpio = 6, .scl_gpio = 7,
+   .core = 1, .irq_core = I2C_DMA_IRQ_CORE_1},
+};
+
+// Note that two instances of this task run concurrently, one on each core.
+// The interrupts of each bus are handled on the core of its task.
+static void mcp9808_task(void *args) {
+  bus_t *bus = (bus_t *) args;
+  const int bus_num = bus - buses;
+
+  const i2c_dma_options_t options = {
+    .irq_core = bus->irq_core,
+  };
+
+  i2c_dma_t *i2c_dma;
+  const int init_rc = i2c_dma_init_with_options(
+    &i2c_dma, bus->i2c, (1000 * 1000), bus->sda_gpio, bus->scl_gpio, &options
+  );
+  if (init_rc != PICO_OK) {
+    mprintf("can't configure I2C%d (rc: %d)\n", bus_num, init_rc);
+    vTaskSuspend(NULL);
+  }
+
+  // Wait for the CPU load calibration.
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+  while (true) {
+    uint16_t raw_temp;
+    const int rc = i2c_dma_read_word_swapped(
+      i2c_dma, MCP9808_ADDR, MCP9808_TEMP_REG, &raw_temp
+    );
+
+    if (rc != PICO_OK) {
+      bus->errors += 1;
+    }
+    bus->reads += 1;
+  }
+}
+
+static void monitor_task(void *args) {
+  (void) args;
+
+  vTaskDelay(pdMS_TO_TICKS(MCP9808_POWER_UP_DELAY_MS));
+
+  // The MCP9808 tasks are waiting, so nothing else runs.
+  cpu_load_calibrate(CALIBRATION_MS);
+
+  for (size_t i = 0; i != sizeof(buses) / sizeof(buses[0]); ++i) {
+    xTaskNotifyGive(buses[i].task);
+  }
+
+  uint32_t reads[2] = {0, 0};
+
+  while (true) {
+    vTaskDelay(pdMS_TO_TICKS(CPU_LOAD_WINDOW_MS));
+
+    const uint32_t reads0 = buses[0].reads;
+    const uint32_t reads1 = buses[1].reads;
+    const unsigned per_s0 = reads0 - reads[0];
+    const unsigned per_s1 = reads1 - reads[1];
+
+    mprintf(
+      "reads/s bus 0: %u, bus 1: %u, total: %u, "
+      "load core 0: %.1f%%, core 1: %.1f%% (errors: %u, %u)\n",
+      per_s0, per_s1, per_s0 + per_s1,
+      cpu_load_get_core(0), cpu_load_get_core(1),
+      (unsigned) buses[0].errors, (unsigned) buses[1].errors
+    );
+
+    reads[0] = reads0;
+    reads[1] = reads1;
+  }
+}
+
+int main(void) {
+  stdio_init_all();
+
+  for (size_t i = 0; i != sizeof(buses) / sizeof(buses[0]); ++i) {
+    xTaskCreateAffinitySet(
+      mcp9808_task,
+      "mcp9808-task",
+      configMINIMAL_STACK_SIZE,
+      &buses[i],
+      configMAX_PRIORITIES - 2,
+      1u << buses[i].core,
+      &buses[i].task
+    );
+  }
+
+  xTaskCreate(
+    monitor_task,
+    "monitor-task",
+    configMINIMAL_STACK_SIZE,
+    NULL,
+    configMAX_PRIORITIES - 3,
+    NULL
+  );
+
+  vTaskStartScheduler();
+}
@@ -11,7 +11,8 @@
 
 /* Enable color mode */
 //#define USE_COLOR_RGB888   // RGB = 0xFF,0xFF,0xFF
-#define USE_COLOR_RGB565   // RGB = 0bRRRRRGGGGGGBBBBB 
+//#define USE_COLOR_RGB565   // RGB = 0bRRRRRGGGGGGBBBBB 
+#define USE_COLOR_MONO     // Black = 0, white = 1
 
 /* Enable needed fonts here */
 //#define  USE_FONT_4X6
@@ -0,0 +1,571 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "i2c_dma.h"
+#include "sim.h"
+
+// Host benchmark for the i2c_dma library. Each scenario runs a number of
+// transactions against simulated devices and prints one line of key=value
+// pairs, so results can be compared between commits with standard tools.
+//
+// The wire is timed at the configured baudrate. CPU figures are host CPU time
+// and only meaningful relative to other runs on the same host.
+
+static const uint8_t MCP9808_ADDR = 0x18;
+static const uint8_t MCP9808_TEMP_REG = 0x05;
+static const uint8_t MEMORY_ADDR = 0x50;
+static const uint8_t SINK_ADDR = 0x3c;
+static const uint8_t ABSENT_ADDR = 0x77;
+static const uint8_t LOG_ADDR = 0x40;
+
+static const uint SDA_GPIO = 4;
+static const uint SCL_GPIO = 5;
+static const uint I2C1_SDA_GPIO = 6;
+static const uint I2C1_SCL_GPIO = 7;
+
+#define MAX_TRANSFER_LEN 4096
+
+static sim_mcp9808_t mcp9808;
+static sim_mcp9808_t mcp9808_i2c1;
+static sim_memory_t memory;
+static sim_memory_t sink;
+static uint8_t memory_bytes[256];
+
+static uint8_t buf[MAX_TRANSFER_LEN];
+
+static volatile uint64_t waste_time_iterations;
+
+// I2C1 is initialized at the same baudrate as I2C0 for each scenario.
+static i2c_dma_t *i2c1_dma;
+
+typedef int (*bench_op_t)(i2c_dma_t *i2c_dma, size_t len);
+typedef void (*bench_drain_t)(void);
+
+typedef struct {
+  const char *name;
+  bench_op_t op;
+  uint baudrate;
+  size_t len;
+  int count;
+  bench_drain_t drain; // Waits for anything op left in progress, or NULL
+  const i2c_dma_options_t *options; // Options for I2C0, or NULL
+} bench_scenario_t;
+
+static const i2c_dma_options_t reserve_dma_channels = {
+  .reserve_dma_channels = true,
+};
+
+static int bench_read_word_swapped(i2c_dma_t *i2c_dma, size_t len) {
+  (void) len;
+  uint16_t raw_temp;
+  return i2c_dma_read_word_swapped(
+    i2c_dma, MCP9808_ADDR, MCP9808_TEMP_REG, &raw_temp
+  );
+}
+
+// Same transaction as bench_read_word_swapped, encoded once.
+static i2c_dma_prepared_t read_temp;
+static uint16_t read_temp_data_cmds[3];
+
+static int bench_read_word_prepared(i2c_dma_t *i2c_dma, size_t len) {
+  (void) len;
+
+  if (read_temp.i2c_dma != i2c_dma) {
+    const int rc = i2c_dma_prepare(
+      i2c_dma, &read_temp, read_temp_data_cmds,
+      MCP9808_ADDR, &MCP9808_TEMP_REG, 1, 2
+    );
+    if (rc != PICO_OK) {
+      return rc;
+    }
+  }
+
+  uint8_t raw_temp[2];
+  return i2c_dma_execute(&read_temp, raw_temp);
+}
+
+static int bench_write(i2c_dma_t *i2c_dma, size_t len) {
+  return i2c_dma_write(i2c_dma, SINK_ADDR, buf, len);
+}
+
+// Same as bench_write, with the first byte in a segment of its own like the
+// control byte in front of an SSD1306 frame buffer.
+static int bench_writev(i2c_dma_t *i2c_dma, size_t len) {
+  const i2c_dma_iovec_t wiov[] = {
+    {buf, 1},
+    {buf + 1, len - 1},
+  };
+  return i2c_dma_writev(i2c_dma, SINK_ADDR, wiov, 2);
+}
+
+// Reads the temperature register and a word from the memory in one
+// i2c_dma_transfer. The devices have different addresses so it takes two
+// transactions, the second is started from the I2C interrupt handler.
+static int bench_read_word_x2_transfer(i2c_dma_t *i2c_dma, size_t len) {
+  (void) len;
+  uint8_t temp_reg = MCP9808_TEMP_REG;
+  uint8_t raw_temp[2];
+  uint8_t word[2];
+
+  i2c_dma_msg_t msgs[] = {
+    {MCP9808_ADDR, 0, &temp_reg, 1},
+    {MCP9808_ADDR, I2C_DMA_M_RD, raw_temp, 2},
+    {MEMORY_ADDR, I2C_DMA_M_RD, word, 2},
+  };
+  return i2c_dma_transfer(i2c_dma, msgs, 3);
+}
+
+static int bench_read(i2c_dma_t *i2c_dma, size_t len) {
+  return i2c_dma_read(i2c_dma, MEMORY_ADDR, buf, len);
+}
+
+// Reads the temperature register on both buses from one task. Both
+// transactions are submitted before waiting for either.
+static int bench_read_word_x2_async(i2c_dma_t *i2c_dma, size_t len) {
+  (void) len;
+  uint8_t raw_temp0[2];
+  uint8_t raw_temp1[2];
+
+  i2c_dma_xfer_t xfer0 = {
+    .addr = MCP9808_ADDR,
+    .wbuf = &MCP9808_TEMP_REG,
+    .wbuf_len = 1,
+    .rbuf = raw_temp0,
+    .rbuf_len = 2,
+  };
+  i2c_dma_xfer_t xfer1 = xfer0;
+  xfer1.rbuf = raw_temp1;
+
+  int rc0 = i2c_dma_submit(i2c_dma, &xfer0);
+  int rc1 = i2c_dma_submit(i2c1_dma, &xfer1);
+
+  if (rc0 == PICO_OK) {
+    rc0 = i2c_dma_wait(&xfer0);
+  }
+  if (rc1 == PICO_OK) {
+    rc1 = i2c_dma_wait(&xfer1);
+  }
+
+  return rc0 != PICO_OK ? rc0 : rc1;
+}
+
+// Keeps PIPELINE_DEPTH reads of the temperature register queued. Each call
+// waits for the oldest one and submits it again, so the bus goes from one
+// transaction to the next without waiting for the task.
+#define PIPELINE_DEPTH 4
+
+static i2c_dma_xfer_t pipeline[PIPELINE_DEPTH];
+static uint8_t pipeline_raw_temp[PIPELINE_DEPTH][2];
+static int pipeline_next;
+static bool pipeline_primed;
+
+static int bench_read_word_pipelined(i2c_dma_t *i2c_dma, size_t len) {
+  (void) len;
+
+  if (!pipeline_primed) {
+    for (int i = 0; i != PIPELINE_DEPTH; ++i) {
+      pipeline[i] = (i2c_dma_xfer_t) {
+        .addr = MCP9808_ADDR,
+        .wbuf = &MCP9808_TEMP_REG,
+        .wbuf_len = 1,
+        .rbuf = pipeline_raw_temp[i],
+        .rbuf_len = 2,
+      };
+      i2c_dma_submit(i2c_dma, &pipeline[i]);
+    }
+    pipeline_next = 0;
+    pipeline_primed = true;
+  }
+
+  i2c_dma_xfer_t *xfer = &pipeline[pipeline_next];
+  pipeline_next = (pipeline_next + 1) % PIPELINE_DEPTH;
+
+  const int rc = i2c_dma_wait(xfer);
+  i2c_dma_submit(i2c_dma, xfer);
+  return rc;
+}
+
+static void bench_drain_pipeline(void) {
+  for (int i = 0; i != PIPELINE_DEPTH; ++i) {
+    i2c_dma_wait(&pipeline[i]);
+  }
+  pipeline_primed = false;
+}
+
+static int bench_read_absent(i2c_dma_t *i2c_dma, size_t len) {
+  return i2c_dma_read(i2c_dma, ABSENT_ADDR, buf, len) == PICO_ERROR_IO
+    ? PICO_OK
+    : PICO_ERROR_GENERIC;
+}
+
+// Device that logs what it sees on the bus, S for a start, the bytes written
+// and P for a stop, to check where transactions begin and end.
+static struct {
+  sim_i2c_device_t dev;
+  char text[16];
+  size_t len;
+} bus_log;
+
+static void bus_log_clear(void) {
+  bus_log.len = 0;
+  bus_log.text[0] = 0;
+}
+
+static void bus_log_append(char c) {
+  if (bus_log.len < sizeof(bus_log.text) - 1) {
+    bus_log.text[bus_log.len++] = c;
+    bus_log.text[bus_log.len] = 0;
+  }
+}
+
+static bool bus_log_start(sim_i2c_device_t *dev, bool read) {
+  (void) dev;
+  (void) read;
+  bus_log_append('S');
+  return true;
+}
+
+static bool bus_log_write(sim_i2c_device_t *dev, uint8_t byte) {
+  (void) dev;
+  bus_log_append(byte);
+  return true;
+}
+
+static void bus_log_stop(sim_i2c_device_t *dev) {
+  (void) dev;
+  bus_log_append('P');
+}
+
+// Writes with their own addresses are executed in order, each in a
+// transaction of its own. The write to the absent device aborts and the
+// rest of its batch isn't executed.
+static int bench_write_batch(i2c_dma_t *i2c_dma, size_t len) {
+  (void) len;
+  const i2c_dma_write_t writes[] = {
+    {MEMORY_ADDR, (uint8_t[]) {0x20, 1, 2}, 3},
+    {LOG_ADDR, (const uint8_t *) "ab", 2},
+    {MEMORY_ADDR, (uint8_t[]) {0x21, 3}, 2},
+    {LOG_ADDR, (const uint8_t *) "c", 1},
+  };
+  const i2c_dma_write_t aborted[] = {
+    {LOG_ADDR, (const uint8_t *) "d", 1},
+    {ABSENT_ADDR, (const uint8_t *) "e", 1},
+    {LOG_ADDR, (const uint8_t *) "f", 1},
+  };
+
+  memory_bytes[0x20] = 0;
+  memory_bytes[0x21] = 0;
+  bus_log_clear();
+  bool ok = i2c_dma_write_batch(i2c_dma, writes, 4) == PICO_OK;
+  ok = ok && memory_bytes[0x20] == 1 && memory_bytes[0x21] == 3;
+  ok = ok && strcmp(bus_log.text, "SabPScP") == 0;
+
+  bus_log_clear();
+  ok = ok && i2c_dma_write_batch(i2c_dma, aborted, 3) == PICO_ERROR_IO;
+  ok = ok && strcmp(bus_log.text, "SdP") == 0;
+
+  return ok ? PICO_OK : PICO_ERROR_GENERIC;
+}
+
+// Registers at 0x10 to 0x13 in the memory, cached through regcache. The
+// memory is changed behind the cache's back to tell hits, which still return
+// the old value, from reads that went to the device.
+static i2c_dma_regcache_t regcache;
+static uint8_t regcache_values[3];
+static i2c_dma_reg_t regcache_regs[] = {
+  {.reg = 0x10, .len = 1, .policy = I2C_DMA_REG_CACHED,
+    .value = &regcache_values[0]},
+  {.reg = 0x11, .len = 2, .policy = I2C_DMA_REG_CACHED,
+    .value = &regcache_values[1]},
+  {.reg = 0x13, .len = 1, .policy = I2C_DMA_REG_VOLATILE},
+};
+
+static bool bench_regcache_reads(uint8_t reg, uint8_t b0, uint8_t b1) {
+  const size_t len = reg == 0x11 ? 2 : 1;
+  uint8_t value[2];
+  return i2c_dma_regcache_read(&regcache, reg, value, len) == PICO_OK &&
+    value[0] == b0 && (len == 1 || value[1] == b1);
+}
+
+static int bench_regcache(i2c_dma_t *i2c_dma, size_t len) {
+  (void) len;
+  memcpy(&memory_bytes[0x10], (uint8_t[]) {1, 2, 3, 4}, 4);
+  if (
+    i2c_dma_regcache_init(
+      &regcache, i2c_dma, MEMORY_ADDR, regcache_regs,
+      sizeof(regcache_regs) / sizeof(regcache_regs[0])
+    ) != PICO_OK
+  ) {
+    return PICO_ERROR_GENERIC;
+  }
+
+  // A miss then a hit. Volatile registers are always read from the device.
+  bool ok = bench_regcache_reads(0x10, 1, 0);
+  memory_bytes[0x10] = 5;
+  memory_bytes[0x13] = 6;
+  ok = ok && bench_regcache_reads(0x10, 1, 0);
+  ok = ok && bench_regcache_reads(0x13, 6, 0);
+  ok = ok && regcache_regs[0].hits == 1 && regcache_regs[0].misses == 1;
+
+  // Writes go to the device and update the cache.
+  ok = ok && i2c_dma_regcache_write_byte(&regcache, 0x10, 7) == PICO_OK;
+  ok = ok && memory_bytes[0x10] == 7 && bench_regcache_reads(0x10, 7, 0);
+
+  // A burst updates every cached register it covers.
+  ok = ok && bench_regcache_reads(0x11, 2, 3);
+  ok = ok && i2c_dma_regcache_write(
+    &regcache, 0x10, (uint8_t[]) {8, 9, 10}, 3
+  ) == PICO_OK;
+  memory_bytes[0x10] = 0;
+  memory_bytes[0x11] = 0;
+  ok = ok && bench_regcache_reads(0x10, 8, 0);
+  ok = ok && bench_regcache_reads(0x11, 9, 10);
+
+  // A burst that covers part of a cached register invalidates it.
+  ok = ok && i2c_dma_regcache_write_byte(&regcache, 0x12, 11) == PICO_OK;
+  ok = ok && bench_regcache_reads(0x11, 0, 11);
+  ok = ok && regcache_regs[1].hits == 1 && regcache_regs[1].misses == 2;
+
+  // Nothing is cached after invalidating the cache.
+  i2c_dma_regcache_invalidate(&regcache);
+  ok = ok && bench_regcache_reads(0x10, 0, 0);
+
+  ok = ok && regcache.hits == 4 && regcache.misses == 5 &&
+    regcache.uncached == 0;
+
+  return ok ? PICO_OK : PICO_ERROR_GENERIC;
+}
+
+static int bench_stuck_sda(i2c_dma_t *i2c_dma, size_t len) {
+  (void) len;
+  uint16_t raw_temp;
+  sim_i2c_set_sda_stuck_low(i2c0, true);
+  const int rc = i2c_dma_read_word_swapped(
+    i2c_dma, MCP9808_ADDR, MCP9808_TEMP_REG, &raw_temp
+  );
+  sim_i2c_set_sda_stuck_low(i2c0, false);
+  return rc;
+}
+
+// Same as bench_stuck_sda with the transfer timeout derived from the
+// length of the transaction and the baudrate.
+static int bench_stuck_sda_auto(i2c_dma_t *i2c_dma, size_t len) {
+  i2c_dma_set_transfer_timeout(i2c_dma, I2C_DMA_TIMEOUT_AUTO);
+  const int rc = bench_stuck_sda(i2c_dma, len);
+  i2c_dma_set_transfer_timeout(i2c_dma, I2C_DMA_DEFAULT_TRANSFER_TIMEOUT_MS);
+  return rc;
+}
+
+static const bench_scenario_t scenarios[] = {
+  {"read_word_swapped", bench_read_word_swapped, 100 * 1000, 2, 2000},
+  {"read_word_swapped", bench_read_word_swapped, 400 * 1000, 2, 5000},
+  {"read_word_swapped", bench_read_word_swapped, 1000 * 1000, 2, 10000},
+  {
+    "read_word_swapped_reserved", bench_read_word_swapped, 1000 * 1000, 2,
+    10000, NULL, &reserve_dma_channels
+  },
+  {
+    "read_word_prepared", bench_read_word_prepared, 1000 * 1000, 2, 10000,
+    NULL, &reserve_dma_channels
+  },
+  {"read_word_x2_async", bench_read_word_x2_async, 1000 * 1000, 2, 10000},
+  {
+    "read_word_x2_transfer", bench_read_word_x2_transfer, 1000 * 1000, 2,
+    10000
+  },
+  {
+    "read_word_pipelined", bench_read_word_pipelined, 1000 * 1000, 2, 10000,
+    bench_drain_pipeline
+  },
+  {"read", bench_read, 1000 * 1000, 32, 2000},
+  {"read", bench_read, 1000 * 1000, 1024, 200},
+  {"write", bench_write, 1000 * 1000, 1025, 200},
+  {"writev", bench_writev, 1000 * 1000, 1025, 200},
+  {"write", bench_write, 1000 * 1000, 4096, 50},
+  {"read_absent", bench_read_absent, 1000 * 1000, 2, 1000},
+  {
+    "read_absent_reserved", bench_read_absent, 1000 * 1000, 2, 1000, NULL,
+    &reserve_dma_channels
+  },
+  {"write_batch", bench_write_batch, 1000 * 1000, 1, 200},
+  {"regcache", bench_regcache, 1000 * 1000, 1, 200},
+  {"stuck_sda", bench_stuck_sda, 1000 * 1000, 2, 1},
+  {"stuck_sda_auto", bench_stuck_sda_auto, 1000 * 1000, 2, 1},
+};
+
+static uint64_t bench_thread_cpu_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static int bench_compare_u32(const void *a, const void *b) {
+  const uint32_t x = *(const uint32_t *) a;
+  const uint32_t y = *(const uint32_t *) b;
+  return x < y ? -1 : x > y;
+}
+
+static void bench_run(const bench_scenario_t *s) {
+  i2c_dma_t *i2c_dma;
+  const int rc = i2c_dma_init_with_options(
+    &i2c_dma, i2c0, s->baudrate, SDA_GPIO, SCL_GPIO, s->options
+  );
+  if (rc != PICO_OK) {
+    printf("bench=%s error=init rc=%d\n", s->name, rc);
+    return;
+  }
+
+  const int rc1 = i2c_dma_init(
+    &i2c1_dma, i2c1, s->baudrate, I2C1_SDA_GPIO, I2C1_SCL_GPIO
+  );
+  if (rc1 != PICO_OK) {
+    printf("bench=%s error=init rc=%d\n", s->name, rc1);
+    return;
+  }
+
+  uint32_t *latency_ns = malloc(s->count * sizeof(uint32_t));
+  int errors = 0;
+
+  const uint64_t wall_start = sim_time_ns();
+  const uint64_t cpu_start = bench_thread_cpu_ns();
+  const uint64_t irq_cpu_start = sim_irq_cpu_ns();
+  const uint32_t irq_cnt_start = sim_irq_count();
+  const uint64_t busy_start = sim_i2c_busy_ns(i2c0);
+  const uint64_t waste_start = waste_time_iterations;
+
+  for (int i = 0; i != s->count; ++i) {
+    const uint64_t t0 = sim_time_ns();
+    if (s->op(i2c_dma, s->len) != PICO_OK) {
+      errors += 1;
+    }
+    latency_ns[i] = sim_time_ns() - t0;
+  }
+
+  if (s->drain != NULL) {
+    s->drain();
+  }
+
+  const double wall_s = (sim_time_ns() - wall_start) / 1e9;
+  const double cpu_us = (bench_thread_cpu_ns() - cpu_start) / 1e3;
+  const double irq_cpu_us = (sim_irq_cpu_ns() - irq_cpu_start) / 1e3;
+  const uint32_t irq_cnt = sim_irq_count() - irq_cnt_start;
+  const double busy_s = (sim_i2c_busy_ns(i2c0) - busy_start) / 1e9;
+  const uint64_t waste = waste_time_iterations - waste_start;
+
+  qsort(latency_ns, s->count, sizeof(uint32_t), bench_compare_u32);
+
+  printf(
+    "bench=%s baudrate=%u len=%zu n=%d errors=%d tps=%.0f "
+    "lat_p50_us=%.1f lat_p99_us=%.1f lat_max_us=%.1f "
+    "task_cpu_us_per_tx=%.2f irq_cpu_us_per_tx=%.2f irqs_per_tx=%.2f "
+    "bus_util=%.3f spare_iter_per_s=%.0f",
+    s->name, s->baudrate, s->len, s->count, errors, s->count / wall_s,
+    latency_ns[s->count / 2] / 1e3,
+    latency_ns[(s->count * 99) / 100] / 1e3,
+    latency_ns[s->count - 1] / 1e3,
+    cpu_us / s->count, irq_cpu_us / s->count, (double) irq_cnt / s->count,
+    busy_s / wall_s, waste / wall_s
+  );
+
+  // Only available if the library was built with I2C_DMA_STATS.
+  i2c_dma_stats_t stats;
+  if (i2c_dma_get_stats(i2c_dma, &stats, false) == PICO_OK) {
+    const uint32_t wires = stats.wire.count > 0 ? stats.wire.count : 1;
+    printf(
+      " aborts=%u timeouts=%u reinits=%u dma_claim_failures=%u "
+      "wire_mean_us=%.1f wire_max_us=%u queue_wait_max_us=%u",
+      stats.aborts, stats.timeouts, stats.reinits, stats.dma_claim_failures,
+      (double) stats.wire.total_us / wires,
+      stats.wire.max_us, stats.queue_wait.max_us
+    );
+  }
+  printf("\n");
+  fflush(stdout);
+
+  free(latency_ns);
+}
+
+static void bench_write_trace(const void *data, size_t len, void *arg) {
+  fwrite(data, 1, len, (FILE *) arg);
+}
+
+static void bench_task(void *args) {
+  (void) args;
+
+  for (size_t i = 0; i != sizeof(scenarios) / sizeof(scenarios[0]); ++i) {
+    bench_run(&scenarios[i]);
+  }
+
+  // Only available if the library was built with I2C_DMA_TRACE.
+  const char *trace_path = getenv("BENCH_TRACE");
+  if (trace_path != NULL) {
+    FILE *trace = fopen(trace_path, "wb");
+    if (trace != NULL) {
+      i2c_dma_trace_freeze(true);
+      i2c_dma_trace_dump(bench_write_trace, trace);
+      fclose(trace);
+    }
+  }
+
+  exit(0);
+}
+
+// Same idea as waste_time_task in the examples. The iterations it manages per
+// second show how much CPU the I2C work leaves for other tasks.
+static void waste_time_task(void *args) {
+  (void) args;
+
+  while (true) {
+    for (int j = 0; j != 1000; j += 1) {
+      __asm__("nop");
+    }
+    waste_time_iterations += 1000;
+  }
+}
+
+int main(void) {
+  for (size_t i = 0; i != sizeof(buf); ++i) {
+    buf[i] = i;
+  }
+
+  sim_mcp9808_init(&mcp9808, MCP9808_ADDR);
+  sim_i2c_attach(i2c0, &mcp9808.dev);
+
+  sim_mcp9808_init(&mcp9808_i2c1, MCP9808_ADDR);
+  sim_i2c_attach(i2c1, &mcp9808_i2c1.dev);
+
+  sim_memory_init(&memory, MEMORY_ADDR, memory_bytes, sizeof(memory_bytes));
+  sim_i2c_attach(i2c0, &memory.dev);
+
+  sim_memory_init(&sink, SINK_ADDR, NULL, 0);
+  sim_i2c_attach(i2c0, &sink.dev);
+
+  bus_log.dev.addr = LOG_ADDR;
+  bus_log.dev.start = bus_log_start;
+  bus_log.dev.write = bus_log_write;
+  bus_log.dev.stop = bus_log_stop;
+  sim_i2c_attach(i2c0, &bus_log.dev);
+
+  xTaskCreate(
+    bench_task,
+    "bench-task",
+    configMINIMAL_STACK_SIZE,
+    NULL,
+    configMAX_PRIORITIES - 2,
+    NULL
+  );
+
+  xTaskCreate(
+    waste_time_task,
+    "waste-time-task",
+    configMINIMAL_STACK_SIZE,
+    NULL,
+    configMAX_PRIORITIES - 4,
+    NULL
+  );
+
+  vTaskStartScheduler();
+}
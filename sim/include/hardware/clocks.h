@@ -0,0 +1,11 @@
+#ifndef _SIM_HARDWARE_CLOCKS_H
+#define _SIM_HARDWARE_CLOCKS_H
+
+#include "pico.h"
+
+#define CLOCKS_FC0_SRC_VALUE_CLK_SYS 0x09
+
+// Always reports the RP2040 default system clock of 125 MHz.
+uint32_t frequency_count_khz(uint src);
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef _SIM_HARDWARE_DMA_H
+#define _SIM_HARDWARE_DMA_H
+
+// Simulated RP2040 DMA controller. Channels paced by an I2C DREQ are serviced
+// by the bus thread of the corresponding I2C peripheral, one FIFO slot at a
+// time, so DREQ pacing, chaining and completion timing follow the wire.
+// Channels with DREQ_FORCE run to completion as soon as they are triggered.
+
+#include "pico.h"
+
+#define NUM_DMA_CHANNELS 12
+
+#define DREQ_FORCE 0x3f
+
+#define DMA_IRQ_0 11
+#define DMA_IRQ_1 12
+
+enum dma_channel_transfer_size {
+  DMA_SIZE_8 = 0,
+  DMA_SIZE_16 = 1,
+  DMA_SIZE_32 = 2
+};
+
+typedef struct {
+  bool enable;
+  bool read_increment;
+  bool write_increment;
+  enum dma_channel_transfer_size size;
+  uint dreq;
+  uint chain_to;
+  bool ring_write;
+  uint ring_size_bits;
+  bool irq_quiet;
+} dma_channel_config;
+
+dma_channel_config dma_channel_get_default_config(uint channel);
+
+static inline void channel_config_set_read_increment(
+  dma_channel_config *c, bool incr
+) {
+  c->read_increment = incr;
+}
+
+static inline void channel_config_set_write_increment(
+  dma_channel_config *c, bool incr
+) {
+  c->write_increment = incr;
+}
+
+static inline void channel_config_set_transfer_data_size(
+  dma_channel_config *c, enum dma_channel_transfer_size size
+) {
+  c->size = size;
+}
+
+static inline void channel_config_set_dreq(dma_channel_config *c, uint dreq) {
+  c->dreq = dreq;
+}
+
+static inline void channel_config_set_chain_to(
+  dma_channel_config *c, uint chain_to
+) {
+  c->chain_to = chain_to;
+}
+
+static inline void channel_config_set_ring(
+  dma_channel_config *c, bool write, uint size_bits
+) {
+  c->ring_write = write;
+  c->ring_size_bits = size_bits;
+}
+
+static inline void channel_config_set_irq_quiet(
+  dma_channel_config *c, bool irq_quiet
+) {
+  c->irq_quiet = irq_quiet;
+}
+
+static inline void channel_config_set_enable(
+  dma_channel_config *c, bool enable
+) {
+  c->enable = enable;
+}
+
+int dma_claim_unused_channel(bool required);
+void dma_channel_claim(uint channel);
+void dma_channel_unclaim(uint channel);
+bool dma_channel_is_claimed(uint channel);
+
+void dma_channel_set_config(
+  uint channel, const dma_channel_config *config, bool trigger
+);
+void dma_channel_set_read_addr(
+  uint channel, const volatile void *read_addr, bool trigger
+);
+void dma_channel_set_write_addr(
+  uint channel, volatile void *write_addr, bool trigger
+);
+void dma_channel_set_trans_count(
+  uint channel, uint32_t trans_count, bool trigger
+);
+
+void dma_channel_configure(
+  uint channel,
+  const dma_channel_config *config,
+  volatile void *write_addr,
+  const volatile void *read_addr,
+  uint transfer_count,
+  bool trigger
+);
+
+void dma_channel_transfer_from_buffer_now(
+  uint channel, const volatile void *read_addr, uint32_t transfer_count
+);
+void dma_channel_transfer_to_buffer_now(
+  uint channel, volatile void *write_addr, uint32_t transfer_count
+);
+
+void dma_channel_start(uint channel);
+void dma_start_channel_mask(uint32_t chan_mask);
+void dma_channel_abort(uint channel);
+bool dma_channel_is_busy(uint channel);
+void dma_channel_wait_for_finish_blocking(uint channel);
+uint32_t dma_channel_get_trans_count(uint channel);
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled);
+void dma_channel_set_irq1_enabled(uint channel, bool enabled);
+bool dma_channel_get_irq0_status(uint channel);
+bool dma_channel_get_irq1_status(uint channel);
+void dma_channel_acknowledge_irq0(uint channel);
+void dma_channel_acknowledge_irq1(uint channel);
+
+void dma_irqn_set_channel_enabled(uint irq_index, uint channel, bool enabled);
+bool dma_irqn_get_channel_status(uint irq_index, uint channel);
+void dma_irqn_acknowledge_channel(uint irq_index, uint channel);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef _SIM_HARDWARE_GPIO_H
+#define _SIM_HARDWARE_GPIO_H
+
+// Simulated GPIOs. Only what the bus unblocking code in i2c_dma.c needs: a
+// pin reads high unless a fault has been injected with
+// sim_i2c_set_sda_stuck_low.
+
+#include "pico.h"
+
+#define GPIO_OUT 1
+#define GPIO_IN 0
+
+enum gpio_function {
+  GPIO_FUNC_I2C = 3,
+  GPIO_FUNC_SIO = 5,
+  GPIO_FUNC_NULL = 0x1f,
+};
+
+void gpio_init(uint gpio);
+void gpio_set_function(uint gpio, enum gpio_function fn);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_put(uint gpio, bool value);
+bool gpio_get(uint gpio);
+void gpio_pull_up(uint gpio);
+
+#endif
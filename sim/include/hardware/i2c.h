@@ -0,0 +1,76 @@
+#ifndef _SIM_HARDWARE_I2C_H
+#define _SIM_HARDWARE_I2C_H
+
+// Simulated DW_apb_i2c register block and the subset of the Pico SDK
+// hardware_i2c API used by the i2c_dma library. Register and bit names match
+// the RP2040 SDK so src/i2c_dma.c compiles unchanged. The register block is
+// shared with the bus thread in sim_i2c.c which plays the role of the I2C
+// peripheral.
+
+#include "pico.h"
+
+#define I2C_IC_DATA_CMD_DAT_BITS                    0x000000ff
+#define I2C_IC_DATA_CMD_CMD_BITS                    0x00000100
+#define I2C_IC_DATA_CMD_STOP_BITS                   0x00000200
+#define I2C_IC_DATA_CMD_RESTART_BITS                0x00000400
+
+#define I2C_IC_INTR_STAT_R_TX_ABRT_BITS             0x00000040
+#define I2C_IC_INTR_STAT_R_STOP_DET_BITS            0x00000200
+
+#define I2C_IC_INTR_MASK_M_TX_ABRT_BITS             0x00000040
+#define I2C_IC_INTR_MASK_M_STOP_DET_BITS            0x00000200
+
+#define I2C_IC_TX_ABRT_SOURCE_ABRT_7B_ADDR_NOACK_BITS 0x00000001
+#define I2C_IC_TX_ABRT_SOURCE_ABRT_TXDATA_NOACK_BITS  0x00000008
+
+#define I2C0_IRQ 23
+#define I2C1_IRQ 24
+
+#define DREQ_I2C0_TX 32
+#define DREQ_I2C0_RX 33
+#define DREQ_I2C1_TX 34
+#define DREQ_I2C1_RX 35
+
+typedef struct {
+  io_rw_32 con;
+  io_rw_32 tar;
+  io_rw_32 data_cmd;
+  io_ro_32 intr_stat;
+  io_rw_32 intr_mask;
+  io_ro_32 raw_intr_stat;
+  io_ro_32 clr_tx_abrt;
+  io_ro_32 clr_stop_det;
+  io_rw_32 enable;
+  io_ro_32 txflr;
+  io_ro_32 rxflr;
+  io_ro_32 tx_abrt_source;
+} i2c_hw_t;
+
+typedef struct i2c_inst {
+  i2c_hw_t *hw;
+  bool restart_on_next;
+} i2c_inst_t;
+
+extern i2c_inst_t i2c0_inst;
+extern i2c_inst_t i2c1_inst;
+
+#define i2c0 (&i2c0_inst)
+#define i2c1 (&i2c1_inst)
+
+static inline i2c_hw_t *i2c_get_hw(i2c_inst_t *i2c) {
+  return i2c->hw;
+}
+
+static inline uint i2c_hw_index(i2c_inst_t *i2c) {
+  return i2c == i2c1 ? 1 : 0;
+}
+
+static inline uint i2c_get_dreq(i2c_inst_t *i2c, bool is_tx) {
+  return (i2c == i2c1 ? DREQ_I2C1_TX : DREQ_I2C0_TX) + (is_tx ? 0 : 1);
+}
+
+// Resets the simulated peripheral, sets the baudrate used for bus timing and
+// enables it. Starts the bus thread on first use.
+uint i2c_init(i2c_inst_t *i2c, uint baudrate);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef _SIM_HARDWARE_IRQ_H
+#define _SIM_HARDWARE_IRQ_H
+
+// Simulated NVIC. An interrupt raised by the simulated hardware is delivered
+// as a process directed SIGUSR1. The FreeRTOS POSIX port keeps signals
+// blocked in every thread except the one running the current task, and
+// blocks them in critical sections, so the handler runs in the context of the
+// interrupted task exactly like an ISR on the RP2040.
+
+#include "pico.h"
+
+#define PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY 0x80
+
+typedef void (*irq_handler_t)(void);
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+void irq_add_shared_handler(
+  uint num, irq_handler_t handler, uint8_t order_priority
+);
+void irq_remove_handler(uint num, irq_handler_t handler);
+void irq_set_enabled(uint num, bool enabled);
+bool irq_is_enabled(uint num);
+void irq_set_pending(uint num);
+
+#endif
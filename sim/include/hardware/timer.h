@@ -0,0 +1,9 @@
+#ifndef _SIM_HARDWARE_TIMER_H
+#define _SIM_HARDWARE_TIMER_H
+
+#include "pico.h"
+
+// Microseconds of monotonic host time.
+uint64_t time_us_64(void);
+
+#endif
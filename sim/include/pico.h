@@ -0,0 +1,34 @@
+#ifndef _SIM_PICO_H
+#define _SIM_PICO_H
+
+// Host replacement for the parts of the Pico SDK's pico.h, pico/types.h,
+// pico/platform.h and pico/error.h that the i2c_dma library and the
+// simulated hardware use.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
+
+typedef volatile uint32_t io_rw_32;
+typedef volatile uint32_t io_ro_32;
+typedef volatile uint32_t io_wo_32;
+
+enum pico_error_codes {
+  PICO_OK = 0,
+  PICO_ERROR_NONE = 0,
+  PICO_ERROR_TIMEOUT = -1,
+  PICO_ERROR_GENERIC = -2,
+  PICO_ERROR_NO_DATA = -3,
+  PICO_ERROR_NOT_PERMITTED = -4,
+  PICO_ERROR_INVALID_ARG = -5,
+  PICO_ERROR_IO = -6,
+};
+
+// The simulated RP2040 has a single core.
+static inline uint get_core_num(void) {
+  return 0;
+}
+
+#endif
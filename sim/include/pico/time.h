@@ -0,0 +1,42 @@
+#ifndef _SIM_PICO_TIME_H
+#define _SIM_PICO_TIME_H
+
+// Host replacement for the repeating timers of the Pico SDK's pico/time.h.
+// The callbacks run in the handler of a simulated TIMER_IRQ_3, the interrupt
+// of the SDK's default alarm pool, so they run in interrupt context like on
+// the RP2040.
+
+#include "pico.h"
+
+#define TIMER_IRQ_3 3
+
+typedef struct repeating_timer repeating_timer_t;
+
+typedef bool (*repeating_timer_callback_t)(repeating_timer_t *rt);
+
+struct repeating_timer {
+  int64_t delay_us;
+  repeating_timer_callback_t callback;
+  void *user_data;
+
+  // Simulation state.
+  uint64_t due_us;
+  bool fired;
+  repeating_timer_t *next;
+};
+
+// Calls callback every delay_us microseconds until it returns false or the
+// timer is cancelled. A negative delay_us is the time from the start of one
+// call to the start of the next, a positive one the time from the end of one
+// call to the start of the next. Returns false if delay_us is 0.
+bool add_repeating_timer_us(
+  int64_t delay_us,
+  repeating_timer_callback_t callback,
+  void *user_data,
+  repeating_timer_t *out
+);
+
+// Returns false if the timer wasn't active.
+bool cancel_repeating_timer(repeating_timer_t *timer);
+
+#endif
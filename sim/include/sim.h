@@ -0,0 +1,88 @@
+#ifndef _SIM_H
+#define _SIM_H
+
+// Control interface for the simulated RP2040 I2C/DMA/IRQ hardware. Used by
+// host programs that exercise src/i2c_dma.c, for example the benchmark in
+// sim/bench.
+
+#include "pico.h"
+#include "hardware/i2c.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A device on a simulated bus. The callbacks are invoked by the bus thread
+// at the point in time where the corresponding bits have been clocked out on
+// the wire.
+typedef struct sim_i2c_device_s sim_i2c_device_t;
+
+struct sim_i2c_device_s {
+  uint8_t addr;
+
+  // Start or repeated start addressed to this device. Returns the ACK bit.
+  bool (*start)(sim_i2c_device_t *dev, bool read);
+  // Byte written by the host. Returns the ACK bit.
+  bool (*write)(sim_i2c_device_t *dev, uint8_t byte);
+  // Byte requested by the host.
+  uint8_t (*read)(sim_i2c_device_t *dev);
+  // Stop condition.
+  void (*stop)(sim_i2c_device_t *dev);
+
+  sim_i2c_device_t *next;
+};
+
+// Adds a device to the bus of an I2C peripheral.
+void sim_i2c_attach(i2c_inst_t *i2c, sim_i2c_device_t *dev);
+
+// Holds SDA low, the bus appears blocked and no stop condition will be
+// detected until the fault is removed.
+void sim_i2c_set_sda_stuck_low(i2c_inst_t *i2c, bool stuck);
+
+// MCP9808 temperature sensor with 16-bit registers and a register pointer.
+typedef struct {
+  sim_i2c_device_t dev;
+  uint16_t regs[16];
+  uint8_t pointer;
+  uint8_t byte_index;
+  bool pointer_written;
+} sim_mcp9808_t;
+
+void sim_mcp9808_init(sim_mcp9808_t *mcp9808, uint8_t addr);
+
+// Generic byte addressed memory with an 8-bit address pointer that auto
+// increments, like a small EEPROM. With a NULL mem it acts as a sink that
+// acknowledges and discards every byte written, like an SSD1306 receiving
+// display data.
+typedef struct {
+  sim_i2c_device_t dev;
+  uint8_t *mem;
+  size_t size;
+  size_t pointer;
+  bool pointer_written;
+  uint32_t bytes_written;
+} sim_memory_t;
+
+void sim_memory_init(
+  sim_memory_t *memory, uint8_t addr, uint8_t *mem, size_t size
+);
+
+// Monotonic host time.
+uint64_t sim_time_ns(void);
+
+// CPU time consumed by simulated interrupt handlers, in nanoseconds. Summed
+// over all interrupts since program start.
+uint64_t sim_irq_cpu_ns(void);
+
+// Number of simulated interrupts delivered since program start.
+uint32_t sim_irq_count(void);
+
+// Time in nanoseconds the wire of an I2C peripheral has been busy, start
+// condition to stop condition, since program start.
+uint64_t sim_i2c_busy_ns(i2c_inst_t *i2c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
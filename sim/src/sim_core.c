@@ -0,0 +1,80 @@
+#include <time.h>
+#include "hardware/clocks.h"
+#include "hardware/gpio.h"
+#include "hardware/timer.h"
+#include "sim.h"
+#include "sim_internal.h"
+
+static pthread_mutex_t sim_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sim_cond = PTHREAD_COND_INITIALIZER;
+
+void sim_lock(sim_lock_state_t *state) {
+  sigset_t all;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &state->saved_mask);
+  pthread_mutex_lock(&sim_mutex);
+}
+
+void sim_unlock(sim_lock_state_t *state) {
+  pthread_mutex_unlock(&sim_mutex);
+  pthread_sigmask(SIG_SETMASK, &state->saved_mask, NULL);
+}
+
+void sim_notify(void) {
+  pthread_cond_broadcast(&sim_cond);
+}
+
+void sim_wait(void) {
+  pthread_cond_wait(&sim_cond, &sim_mutex);
+}
+
+void sim_block_signals(void) {
+  sigset_t all;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, NULL);
+}
+
+uint64_t sim_time_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+uint64_t time_us_64(void) {
+  return sim_time_ns() / 1000;
+}
+
+uint32_t frequency_count_khz(uint src) {
+  (void) src;
+  return 125000;
+}
+
+// GPIOs. The only GPIO state that matters is whether the SDA line of a bus
+// is held low by a fault, sim_i2c.c answers that question.
+
+void gpio_init(uint gpio) {
+  (void) gpio;
+}
+
+void gpio_set_function(uint gpio, enum gpio_function fn) {
+  (void) gpio;
+  (void) fn;
+}
+
+void gpio_set_dir(uint gpio, bool out) {
+  (void) gpio;
+  (void) out;
+}
+
+void gpio_put(uint gpio, bool value) {
+  (void) gpio;
+  (void) value;
+}
+
+bool gpio_get(uint gpio) {
+  return !sim_i2c_gpio_stuck_low(gpio);
+}
+
+void gpio_pull_up(uint gpio) {
+  (void) gpio;
+}
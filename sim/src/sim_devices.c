@@ -0,0 +1,110 @@
+#include <string.h>
+#include "sim.h"
+
+// MCP9808. The first byte written after a start is the register pointer,
+// the following bytes are written to the register msb first. Reads return
+// the register pointed to, msb first.
+
+#define SIM_MCP9808_TEMP_REG 0x05
+#define SIM_MCP9808_MANUFACTURER_ID_REG 0x06
+#define SIM_MCP9808_DEVICE_ID_REG 0x07
+
+static bool sim_mcp9808_start(sim_i2c_device_t *dev, bool read) {
+  sim_mcp9808_t *mcp9808 = (sim_mcp9808_t *) dev;
+  mcp9808->byte_index = 0;
+  mcp9808->pointer_written = read;
+  return true;
+}
+
+static bool sim_mcp9808_write(sim_i2c_device_t *dev, uint8_t byte) {
+  sim_mcp9808_t *mcp9808 = (sim_mcp9808_t *) dev;
+
+  if (!mcp9808->pointer_written) {
+    mcp9808->pointer = byte & 0x0f;
+    mcp9808->pointer_written = true;
+    return true;
+  }
+
+  uint16_t *reg = &mcp9808->regs[mcp9808->pointer];
+  if (mcp9808->byte_index % 2 == 0) {
+    *reg = (*reg & 0x00ff) | byte << 8;
+  } else {
+    *reg = (*reg & 0xff00) | byte;
+  }
+  mcp9808->byte_index += 1;
+
+  return true;
+}
+
+static uint8_t sim_mcp9808_read(sim_i2c_device_t *dev) {
+  sim_mcp9808_t *mcp9808 = (sim_mcp9808_t *) dev;
+  const uint16_t reg = mcp9808->regs[mcp9808->pointer];
+  const uint8_t byte = mcp9808->byte_index % 2 == 0 ? reg >> 8 : reg & 0xff;
+  mcp9808->byte_index += 1;
+  return byte;
+}
+
+void sim_mcp9808_init(sim_mcp9808_t *mcp9808, uint8_t addr) {
+  memset(mcp9808, 0, sizeof(*mcp9808));
+  mcp9808->dev.addr = addr;
+  mcp9808->dev.start = sim_mcp9808_start;
+  mcp9808->dev.write = sim_mcp9808_write;
+  mcp9808->dev.read = sim_mcp9808_read;
+
+  // 26.5 degrees celsius.
+  mcp9808->regs[SIM_MCP9808_TEMP_REG] = 0x01a8;
+  mcp9808->regs[SIM_MCP9808_MANUFACTURER_ID_REG] = 0x0054;
+  mcp9808->regs[SIM_MCP9808_DEVICE_ID_REG] = 0x0400;
+}
+
+// Byte addressed memory.
+
+static bool sim_memory_start(sim_i2c_device_t *dev, bool read) {
+  sim_memory_t *memory = (sim_memory_t *) dev;
+  memory->pointer_written = read;
+  return true;
+}
+
+static bool sim_memory_write(sim_i2c_device_t *dev, uint8_t byte) {
+  sim_memory_t *memory = (sim_memory_t *) dev;
+
+  memory->bytes_written += 1;
+
+  if (memory->mem == NULL) {
+    return true;
+  }
+
+  if (!memory->pointer_written) {
+    memory->pointer = byte % memory->size;
+    memory->pointer_written = true;
+  } else {
+    memory->mem[memory->pointer] = byte;
+    memory->pointer = (memory->pointer + 1) % memory->size;
+  }
+
+  return true;
+}
+
+static uint8_t sim_memory_read(sim_i2c_device_t *dev) {
+  sim_memory_t *memory = (sim_memory_t *) dev;
+
+  if (memory->mem == NULL) {
+    return 0xff;
+  }
+
+  const uint8_t byte = memory->mem[memory->pointer];
+  memory->pointer = (memory->pointer + 1) % memory->size;
+  return byte;
+}
+
+void sim_memory_init(
+  sim_memory_t *memory, uint8_t addr, uint8_t *mem, size_t size
+) {
+  memset(memory, 0, sizeof(*memory));
+  memory->dev.addr = addr;
+  memory->dev.start = sim_memory_start;
+  memory->dev.write = sim_memory_write;
+  memory->dev.read = sim_memory_read;
+  memory->mem = mem;
+  memory->size = size;
+}
@@ -0,0 +1,421 @@
+#include <string.h>
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "sim_internal.h"
+
+typedef struct {
+  bool claimed;
+  bool busy;
+  dma_channel_config config;
+  uintptr_t read_addr;
+  uintptr_t write_addr;
+  uint32_t trans_count;        // Transfers remaining
+  uint32_t trans_count_reload; // Last value written to TRANS_COUNT
+} sim_dma_channel_t;
+
+static sim_dma_channel_t channels[NUM_DMA_CHANNELS];
+
+// As on the RP2040, a completion is latched in intr whether or not its
+// interrupt is enabled, and INTS0/INTS1 are intr masked by INTE0/INTE1.
+// Acknowledging an interrupt clears intr.
+static uint32_t intr;
+static uint32_t inte0;
+static uint32_t inte1;
+
+static void sim_dma_trigger(uint channel);
+
+static uintptr_t sim_dma_advance(
+  uintptr_t addr, bool incr, uint size, bool ring, uint ring_size_bits
+) {
+  if (!incr) {
+    return addr;
+  }
+
+  if (ring && ring_size_bits != 0) {
+    const uintptr_t mask = ((uintptr_t) 1 << ring_size_bits) - 1;
+    return (addr & ~mask) | ((addr + size) & mask);
+  }
+
+  return addr + size;
+}
+
+static void sim_dma_step(sim_dma_channel_t *ch) {
+  const dma_channel_config *c = &ch->config;
+  const uint size = 1u << c->size;
+
+  ch->read_addr = sim_dma_advance(
+    ch->read_addr, c->read_increment, size,
+    !c->ring_write, c->ring_size_bits
+  );
+  ch->write_addr = sim_dma_advance(
+    ch->write_addr, c->write_increment, size,
+    c->ring_write, c->ring_size_bits
+  );
+  ch->trans_count -= 1;
+}
+
+static void sim_dma_complete(uint channel) {
+  sim_dma_channel_t *ch = &channels[channel];
+
+  ch->busy = false;
+
+  if (!ch->config.irq_quiet) {
+    intr |= 1u << channel;
+    if (inte0 & (1u << channel)) {
+      sim_irq_raise(DMA_IRQ_0);
+    }
+    if (inte1 & (1u << channel)) {
+      sim_irq_raise(DMA_IRQ_1);
+    }
+  }
+
+  if (ch->config.chain_to != channel) {
+    sim_dma_trigger(ch->config.chain_to);
+  }
+}
+
+// Unpaced channels copy memory to memory the moment they are triggered.
+static void sim_dma_run_unpaced(uint channel) {
+  sim_dma_channel_t *ch = &channels[channel];
+  const uint size = 1u << ch->config.size;
+
+  while (ch->trans_count != 0) {
+    memcpy((void *) ch->write_addr, (const void *) ch->read_addr, size);
+    sim_dma_step(ch);
+  }
+
+  sim_dma_complete(channel);
+}
+
+static void sim_dma_trigger(uint channel) {
+  sim_dma_channel_t *ch = &channels[channel];
+
+  if (!ch->config.enable) {
+    return;
+  }
+
+  ch->trans_count = ch->trans_count_reload;
+  ch->busy = true;
+
+  if (ch->trans_count == 0) {
+    sim_dma_complete(channel);
+  } else if (ch->config.dreq == DREQ_FORCE) {
+    sim_dma_run_unpaced(channel);
+  } else {
+    sim_notify();
+  }
+}
+
+bool sim_dma_tx_pop(uint dreq, uint16_t *word) {
+  for (uint channel = 0; channel != NUM_DMA_CHANNELS; ++channel) {
+    sim_dma_channel_t *ch = &channels[channel];
+
+    if (ch->busy && ch->config.dreq == dreq) {
+      const uintptr_t src = ch->read_addr;
+
+      switch (ch->config.size) {
+        case DMA_SIZE_8:
+          // The bus fabric replicates narrow writes across all byte lanes of
+          // a peripheral register, as on the real RP2040.
+          *word = *(const uint8_t *) src * 0x0101u;
+          break;
+        case DMA_SIZE_16:
+          *word = *(const uint16_t *) src;
+          break;
+        default:
+          *word = (uint16_t) *(const uint32_t *) src;
+          break;
+      }
+
+      sim_dma_step(ch);
+      if (ch->trans_count == 0) {
+        sim_dma_complete(channel);
+      }
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool sim_dma_rx_push(uint dreq, uint8_t byte) {
+  for (uint channel = 0; channel != NUM_DMA_CHANNELS; ++channel) {
+    sim_dma_channel_t *ch = &channels[channel];
+
+    if (ch->busy && ch->config.dreq == dreq) {
+      const uintptr_t dst = ch->write_addr;
+
+      switch (ch->config.size) {
+        case DMA_SIZE_8:
+          *(uint8_t *) dst = byte;
+          break;
+        case DMA_SIZE_16:
+          *(uint16_t *) dst = byte;
+          break;
+        default:
+          *(uint32_t *) dst = byte;
+          break;
+      }
+
+      sim_dma_step(ch);
+      if (ch->trans_count == 0) {
+        sim_dma_complete(channel);
+      }
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel) {
+  dma_channel_config c = {
+    .enable = true,
+    .read_increment = true,
+    .write_increment = false,
+    .size = DMA_SIZE_32,
+    .dreq = DREQ_FORCE,
+    .chain_to = channel,
+    .ring_write = false,
+    .ring_size_bits = 0,
+    .irq_quiet = false,
+  };
+  return c;
+}
+
+int dma_claim_unused_channel(bool required) {
+  (void) required;
+
+  sim_lock_state_t state;
+  sim_lock(&state);
+
+  int channel = -1;
+  for (uint i = 0; i != NUM_DMA_CHANNELS; ++i) {
+    if (!channels[i].claimed) {
+      channels[i].claimed = true;
+      channel = i;
+      break;
+    }
+  }
+
+  sim_unlock(&state);
+
+  return channel;
+}
+
+void dma_channel_claim(uint channel) {
+  channels[channel].claimed = true;
+}
+
+void dma_channel_unclaim(uint channel) {
+  channels[channel].claimed = false;
+}
+
+bool dma_channel_is_claimed(uint channel) {
+  return channels[channel].claimed;
+}
+
+void dma_channel_set_config(
+  uint channel, const dma_channel_config *config, bool trigger
+) {
+  sim_lock_state_t state;
+  sim_lock(&state);
+  channels[channel].config = *config;
+  if (trigger) {
+    sim_dma_trigger(channel);
+  }
+  sim_unlock(&state);
+}
+
+void dma_channel_set_read_addr(
+  uint channel, const volatile void *read_addr, bool trigger
+) {
+  sim_lock_state_t state;
+  sim_lock(&state);
+  channels[channel].read_addr = (uintptr_t) read_addr;
+  if (trigger) {
+    sim_dma_trigger(channel);
+  }
+  sim_unlock(&state);
+}
+
+void dma_channel_set_write_addr(
+  uint channel, volatile void *write_addr, bool trigger
+) {
+  sim_lock_state_t state;
+  sim_lock(&state);
+  channels[channel].write_addr = (uintptr_t) write_addr;
+  if (trigger) {
+    sim_dma_trigger(channel);
+  }
+  sim_unlock(&state);
+}
+
+void dma_channel_set_trans_count(
+  uint channel, uint32_t trans_count, bool trigger
+) {
+  sim_lock_state_t state;
+  sim_lock(&state);
+  channels[channel].trans_count_reload = trans_count;
+  if (trigger) {
+    sim_dma_trigger(channel);
+  }
+  sim_unlock(&state);
+}
+
+void dma_channel_configure(
+  uint channel,
+  const dma_channel_config *config,
+  volatile void *write_addr,
+  const volatile void *read_addr,
+  uint transfer_count,
+  bool trigger
+) {
+  sim_lock_state_t state;
+  sim_lock(&state);
+  sim_dma_channel_t *ch = &channels[channel];
+  ch->config = *config;
+  ch->write_addr = (uintptr_t) write_addr;
+  ch->read_addr = (uintptr_t) read_addr;
+  ch->trans_count_reload = transfer_count;
+  if (trigger) {
+    sim_dma_trigger(channel);
+  }
+  sim_unlock(&state);
+}
+
+void dma_channel_transfer_from_buffer_now(
+  uint channel, const volatile void *read_addr, uint32_t transfer_count
+) {
+  sim_lock_state_t state;
+  sim_lock(&state);
+  channels[channel].read_addr = (uintptr_t) read_addr;
+  channels[channel].trans_count_reload = transfer_count;
+  sim_dma_trigger(channel);
+  sim_unlock(&state);
+}
+
+void dma_channel_transfer_to_buffer_now(
+  uint channel, volatile void *write_addr, uint32_t transfer_count
+) {
+  sim_lock_state_t state;
+  sim_lock(&state);
+  channels[channel].write_addr = (uintptr_t) write_addr;
+  channels[channel].trans_count_reload = transfer_count;
+  sim_dma_trigger(channel);
+  sim_unlock(&state);
+}
+
+void dma_channel_start(uint channel) {
+  sim_lock_state_t state;
+  sim_lock(&state);
+  sim_dma_trigger(channel);
+  sim_unlock(&state);
+}
+
+void dma_start_channel_mask(uint32_t chan_mask) {
+  sim_lock_state_t state;
+  sim_lock(&state);
+  for (uint channel = 0; channel != NUM_DMA_CHANNELS; ++channel) {
+    if (chan_mask & (1u << channel)) {
+      sim_dma_trigger(channel);
+    }
+  }
+  sim_unlock(&state);
+}
+
+void dma_channel_abort(uint channel) {
+  sim_lock_state_t state;
+  sim_lock(&state);
+  // An aborted channel stops without raising a completion interrupt.
+  channels[channel].busy = false;
+  sim_notify();
+  sim_unlock(&state);
+}
+
+bool dma_channel_is_busy(uint channel) {
+  return channels[channel].busy;
+}
+
+void dma_channel_wait_for_finish_blocking(uint channel) {
+  while (__atomic_load_n(&channels[channel].busy, __ATOMIC_ACQUIRE)) {
+  }
+}
+
+uint32_t dma_channel_get_trans_count(uint channel) {
+  return channels[channel].trans_count;
+}
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled) {
+  sim_lock_state_t state;
+  sim_lock(&state);
+  if (enabled) {
+    inte0 |= 1u << channel;
+    if (intr & (1u << channel)) {
+      sim_irq_raise(DMA_IRQ_0);
+    }
+  } else {
+    inte0 &= ~(1u << channel);
+  }
+  sim_unlock(&state);
+}
+
+void dma_channel_set_irq1_enabled(uint channel, bool enabled) {
+  sim_lock_state_t state;
+  sim_lock(&state);
+  if (enabled) {
+    inte1 |= 1u << channel;
+    if (intr & (1u << channel)) {
+      sim_irq_raise(DMA_IRQ_1);
+    }
+  } else {
+    inte1 &= ~(1u << channel);
+  }
+  sim_unlock(&state);
+}
+
+bool dma_channel_get_irq0_status(uint channel) {
+  return (intr & inte0 & (1u << channel)) != 0;
+}
+
+bool dma_channel_get_irq1_status(uint channel) {
+  return (intr & inte1 & (1u << channel)) != 0;
+}
+
+void dma_channel_acknowledge_irq0(uint channel) {
+  sim_lock_state_t state;
+  sim_lock(&state);
+  intr &= ~(1u << channel);
+  sim_unlock(&state);
+}
+
+void dma_channel_acknowledge_irq1(uint channel) {
+  sim_lock_state_t state;
+  sim_lock(&state);
+  intr &= ~(1u << channel);
+  sim_unlock(&state);
+}
+
+void dma_irqn_set_channel_enabled(uint irq_index, uint channel, bool enabled) {
+  if (irq_index == 0) {
+    dma_channel_set_irq0_enabled(channel, enabled);
+  } else {
+    dma_channel_set_irq1_enabled(channel, enabled);
+  }
+}
+
+bool dma_irqn_get_channel_status(uint irq_index, uint channel) {
+  return irq_index == 0 ?
+    dma_channel_get_irq0_status(channel) :
+    dma_channel_get_irq1_status(channel);
+}
+
+void dma_irqn_acknowledge_channel(uint irq_index, uint channel) {
+  if (irq_index == 0) {
+    dma_channel_acknowledge_irq0(channel);
+  } else {
+    dma_channel_acknowledge_irq1(channel);
+  }
+}
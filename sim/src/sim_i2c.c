@@ -0,0 +1,367 @@
+#include <stdatomic.h>
+#include <time.h>
+#include "hardware/i2c.h"
+#include "sim.h"
+#include "sim_internal.h"
+
+#define SIM_I2C_FIFO_DEPTH 16
+
+// Bits on the wire for the pieces of a transaction. A data byte and an
+// address byte are each followed by an ACK/NACK bit.
+#define SIM_I2C_START_BITS 10 // (Repeated) start, address, R/W, ACK
+#define SIM_I2C_BYTE_BITS  9  // Data byte, ACK
+#define SIM_I2C_STOP_BITS  1
+
+// Sleeping is only accurate to tens of microseconds on a typical host, the
+// last part of every wait is spun.
+#define SIM_I2C_SPIN_NS 200000
+
+typedef struct {
+  i2c_hw_t hw;
+  uint irq_num;
+  uint tx_dreq;
+  uint rx_dreq;
+  uint baudrate;
+
+  pthread_t thread;
+  bool thread_started;
+
+  uint16_t tx_fifo[SIM_I2C_FIFO_DEPTH];
+  uint tx_head;
+  uint tx_count;
+  uint8_t rx_fifo[SIM_I2C_FIFO_DEPTH];
+  uint rx_head;
+  uint rx_count;
+
+  atomic_uint raw_intr;
+  uint latched_intr;
+  uint raised_while_latched;
+  bool tx_abort_hold;
+  bool sda_stuck_low;
+
+  bool in_transaction;
+  bool reading;
+  sim_i2c_device_t *devices;
+  sim_i2c_device_t *current;
+
+  uint64_t t_ns;
+  uint64_t transaction_start_ns;
+  uint64_t busy_ns;
+} sim_i2c_t;
+
+static sim_i2c_t buses[2] = {
+  {.irq_num = I2C0_IRQ, .tx_dreq = DREQ_I2C0_TX, .rx_dreq = DREQ_I2C0_RX},
+  {.irq_num = I2C1_IRQ, .tx_dreq = DREQ_I2C1_TX, .rx_dreq = DREQ_I2C1_RX},
+};
+
+i2c_inst_t i2c0_inst = {&buses[0].hw, false};
+i2c_inst_t i2c1_inst = {&buses[1].hw, false};
+
+static sim_i2c_t *sim_i2c_get(i2c_inst_t *i2c) {
+  return &buses[i2c_hw_index(i2c)];
+}
+
+static sim_i2c_t *sim_i2c_from_irq(uint num) {
+  return num == I2C1_IRQ ? &buses[1] : &buses[0];
+}
+
+static void sim_i2c_update_intr_stat(sim_i2c_t *bus) {
+  const uint raw = atomic_load(&bus->raw_intr);
+  bus->hw.raw_intr_stat = raw;
+  bus->hw.intr_stat = raw & bus->hw.intr_mask;
+}
+
+// Lock must be held.
+static void sim_i2c_raise(sim_i2c_t *bus, uint bits) {
+  atomic_fetch_or(&bus->raw_intr, bits);
+  bus->raised_while_latched |= bits;
+  sim_i2c_update_intr_stat(bus);
+  if (bus->hw.intr_stat & bits) {
+    sim_irq_raise(bus->irq_num);
+  }
+}
+
+static void sim_i2c_irq_enter(uint num) {
+  sim_i2c_t *bus = sim_i2c_from_irq(num);
+
+  sim_lock_state_t state;
+  sim_lock(&state);
+  sim_i2c_update_intr_stat(bus);
+  bus->latched_intr = bus->hw.intr_stat;
+  bus->raised_while_latched = 0;
+  sim_unlock(&state);
+}
+
+// The handler has read intr_stat and the clr_* registers for the sources it
+// saw. Clear exactly those. A source raised again while the handler was
+// running, for example the stop of the next transfer started by a task that
+// ran before the handler returned, happened after the clr_* read and stays
+// pending.
+static void sim_i2c_irq_exit(uint num) {
+  sim_i2c_t *bus = sim_i2c_from_irq(num);
+
+  sim_lock_state_t state;
+  sim_lock(&state);
+
+  const uint cleared = bus->latched_intr & ~bus->raised_while_latched;
+
+  if (cleared & I2C_IC_INTR_STAT_R_TX_ABRT_BITS) {
+    bus->tx_abort_hold = false;
+    sim_notify();
+  }
+
+  atomic_fetch_and(&bus->raw_intr, ~cleared);
+  bus->latched_intr = 0;
+  sim_i2c_update_intr_stat(bus);
+  if (bus->hw.intr_stat != 0) {
+    sim_irq_raise(bus->irq_num);
+  }
+
+  sim_unlock(&state);
+}
+
+static void sim_i2c_sleep_until(uint64_t t_ns) {
+  while (true) {
+    const uint64_t now = sim_time_ns();
+    if (now >= t_ns) {
+      return;
+    }
+
+    if (t_ns - now > SIM_I2C_SPIN_NS) {
+      const uint64_t ns = t_ns - now - SIM_I2C_SPIN_NS / 2;
+      struct timespec ts = {ns / 1000000000u, ns % 1000000000u};
+      nanosleep(&ts, NULL);
+    }
+  }
+}
+
+// Advances the bus timeline by a number of SCL periods and waits until the
+// wall clock catches up.
+static void sim_i2c_clock(sim_i2c_t *bus, uint bits) {
+  bus->t_ns += (uint64_t) bits * 1000000000u / bus->baudrate;
+  sim_i2c_sleep_until(bus->t_ns);
+}
+
+static sim_i2c_device_t *sim_i2c_find(sim_i2c_t *bus, uint8_t addr) {
+  for (sim_i2c_device_t *dev = bus->devices; dev != NULL; dev = dev->next) {
+    if (dev->addr == addr) {
+      return dev;
+    }
+  }
+  return NULL;
+}
+
+// Moves words from an active TX DMA channel into the TX FIFO, as far as the
+// DREQ allows. Lock must be held.
+static void sim_i2c_fill_tx_fifo(sim_i2c_t *bus) {
+  uint16_t word;
+
+  while (bus->tx_count != SIM_I2C_FIFO_DEPTH) {
+    if (!sim_dma_tx_pop(bus->tx_dreq, &word)) {
+      break;
+    }
+
+    // While an abort is pending the FIFO is flushed and held in reset.
+    if (!bus->tx_abort_hold) {
+      const uint tail = (bus->tx_head + bus->tx_count) % SIM_I2C_FIFO_DEPTH;
+      bus->tx_fifo[tail] = word;
+      bus->tx_count += 1;
+    }
+  }
+
+  bus->hw.txflr = bus->tx_count;
+}
+
+// Moves bytes from the RX FIFO to an active RX DMA channel. Lock must be
+// held.
+static void sim_i2c_drain_rx_fifo(sim_i2c_t *bus) {
+  while (bus->rx_count != 0) {
+    if (!sim_dma_rx_push(bus->rx_dreq, bus->rx_fifo[bus->rx_head])) {
+      break;
+    }
+    bus->rx_head = (bus->rx_head + 1) % SIM_I2C_FIFO_DEPTH;
+    bus->rx_count -= 1;
+  }
+
+  bus->hw.rxflr = bus->rx_count;
+}
+
+static void sim_i2c_stop(sim_i2c_t *bus) {
+  sim_i2c_clock(bus, SIM_I2C_STOP_BITS);
+
+  if (bus->current != NULL && bus->current->stop != NULL) {
+    bus->current->stop(bus->current);
+  }
+
+  sim_lock_state_t state;
+  sim_lock(&state);
+  bus->in_transaction = false;
+  bus->current = NULL;
+  bus->busy_ns += bus->t_ns - bus->transaction_start_ns;
+  sim_i2c_raise(bus, I2C_IC_INTR_STAT_R_STOP_DET_BITS);
+  sim_unlock(&state);
+}
+
+static void sim_i2c_abort(sim_i2c_t *bus, uint source) {
+  sim_lock_state_t state;
+  sim_lock(&state);
+  bus->hw.tx_abrt_source = source;
+  bus->tx_count = 0;
+  bus->tx_abort_hold = true;
+  sim_i2c_raise(bus, I2C_IC_INTR_STAT_R_TX_ABRT_BITS);
+  sim_unlock(&state);
+
+  // The controller always terminates an aborted transfer with a stop.
+  sim_i2c_stop(bus);
+}
+
+// Puts one IC_DATA_CMD word on the wire. Called without the lock held, the
+// device callbacks and the wait for the bit times run unlocked.
+static void sim_i2c_execute(sim_i2c_t *bus, uint16_t cmd) {
+  const bool read = (cmd & I2C_IC_DATA_CMD_CMD_BITS) != 0;
+  const bool restart = (cmd & I2C_IC_DATA_CMD_RESTART_BITS) != 0;
+  const bool stop = (cmd & I2C_IC_DATA_CMD_STOP_BITS) != 0;
+
+  // A start is generated for the first byte after a stop, a repeated start
+  // if requested or if the direction changes.
+  if (!bus->in_transaction || restart || read != bus->reading) {
+    if (!bus->in_transaction) {
+      const uint64_t now = sim_time_ns();
+      if (bus->t_ns < now) {
+        bus->t_ns = now;
+      }
+      bus->transaction_start_ns = bus->t_ns;
+    }
+
+    sim_i2c_clock(bus, SIM_I2C_START_BITS);
+
+    bus->in_transaction = true;
+    bus->reading = read;
+    bus->current = sim_i2c_find(bus, bus->hw.tar & 0x7f);
+
+    if (bus->current == NULL || !bus->current->start(bus->current, read)) {
+      sim_i2c_abort(bus, I2C_IC_TX_ABRT_SOURCE_ABRT_7B_ADDR_NOACK_BITS);
+      return;
+    }
+  }
+
+  sim_i2c_clock(bus, SIM_I2C_BYTE_BITS);
+
+  if (read) {
+    const uint8_t byte = bus->current->read(bus->current);
+
+    sim_lock_state_t state;
+    sim_lock(&state);
+    const uint tail = (bus->rx_head + bus->rx_count) % SIM_I2C_FIFO_DEPTH;
+    bus->rx_fifo[tail] = byte;
+    bus->rx_count += 1;
+    sim_i2c_drain_rx_fifo(bus);
+    sim_unlock(&state);
+  } else if (!bus->current->write(bus->current, cmd & 0xff)) {
+    sim_i2c_abort(bus, I2C_IC_TX_ABRT_SOURCE_ABRT_TXDATA_NOACK_BITS);
+    return;
+  }
+
+  if (stop) {
+    sim_i2c_stop(bus);
+  }
+}
+
+static void *sim_i2c_thread(void *arg) {
+  sim_i2c_t *bus = (sim_i2c_t *) arg;
+
+  sim_block_signals();
+
+  sim_lock_state_t state;
+  sim_lock(&state);
+
+  while (true) {
+    sim_i2c_fill_tx_fifo(bus);
+    sim_i2c_drain_rx_fifo(bus);
+
+    // With a full RX FIFO the controller stretches SCL until it's drained.
+    if (
+      !bus->hw.enable || bus->sda_stuck_low ||
+      bus->tx_count == 0 || bus->rx_count == SIM_I2C_FIFO_DEPTH
+    ) {
+      sim_wait();
+      continue;
+    }
+
+    const uint16_t cmd = bus->tx_fifo[bus->tx_head];
+    bus->tx_head = (bus->tx_head + 1) % SIM_I2C_FIFO_DEPTH;
+    bus->tx_count -= 1;
+
+    sim_unlock(&state);
+    sim_i2c_execute(bus, cmd);
+    sim_lock(&state);
+  }
+
+  return NULL;
+}
+
+uint i2c_init(i2c_inst_t *i2c, uint baudrate) {
+  sim_i2c_t *bus = sim_i2c_get(i2c);
+
+  sim_lock_state_t state;
+  sim_lock(&state);
+
+  bus->hw.enable = 0;
+  bus->hw.intr_mask = 0;
+  bus->hw.tar = 0;
+  bus->baudrate = baudrate;
+  bus->tx_head = bus->tx_count = 0;
+  bus->rx_head = bus->rx_count = 0;
+  bus->tx_abort_hold = false;
+  bus->in_transaction = false;
+  bus->current = NULL;
+  atomic_store(&bus->raw_intr, 0);
+  sim_i2c_update_intr_stat(bus);
+  bus->hw.enable = 1;
+
+  if (!bus->thread_started) {
+    sim_irq_set_hooks(bus->irq_num, sim_i2c_irq_enter, sim_i2c_irq_exit);
+    // Signals are blocked here, the new thread inherits that.
+    pthread_create(&bus->thread, NULL, sim_i2c_thread, bus);
+    bus->thread_started = true;
+  }
+
+  sim_notify();
+  sim_unlock(&state);
+
+  return baudrate;
+}
+
+void sim_i2c_attach(i2c_inst_t *i2c, sim_i2c_device_t *dev) {
+  sim_i2c_t *bus = sim_i2c_get(i2c);
+
+  sim_lock_state_t state;
+  sim_lock(&state);
+  dev->next = bus->devices;
+  bus->devices = dev;
+  sim_unlock(&state);
+}
+
+void sim_i2c_set_sda_stuck_low(i2c_inst_t *i2c, bool stuck) {
+  sim_i2c_t *bus = sim_i2c_get(i2c);
+
+  sim_lock_state_t state;
+  sim_lock(&state);
+  bus->sda_stuck_low = stuck;
+  sim_notify();
+  sim_unlock(&state);
+}
+
+bool sim_i2c_gpio_stuck_low(uint gpio) {
+  // SDA of I2C0 is on GPIOs 0, 4, 8, ..., SDA of I2C1 on GPIOs 2, 6, 10, ...
+  if (gpio % 4 == 0) {
+    return buses[0].sda_stuck_low;
+  } else if (gpio % 4 == 2) {
+    return buses[1].sda_stuck_low;
+  }
+  return false;
+}
+
+uint64_t sim_i2c_busy_ns(i2c_inst_t *i2c) {
+  return sim_i2c_get(i2c)->busy_ns;
+}
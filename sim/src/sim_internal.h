@@ -0,0 +1,53 @@
+#ifndef _SIM_INTERNAL_H
+#define _SIM_INTERNAL_H
+
+#include <pthread.h>
+#include <signal.h>
+#include "pico.h"
+
+// All simulated hardware state is protected by one mutex. It is taken from
+// FreeRTOS tasks, from simulated interrupt handlers and from the bus threads.
+// sim_lock blocks all signals before taking the mutex so a simulated
+// interrupt can never preempt a holder on the same thread, and so the
+// FreeRTOS tick can't switch tasks while the mutex is held.
+typedef struct {
+  sigset_t saved_mask;
+} sim_lock_state_t;
+
+void sim_lock(sim_lock_state_t *state);
+void sim_unlock(sim_lock_state_t *state);
+
+// Wakes the bus threads after DMA or I2C register state has changed. Must be
+// called with the lock held.
+void sim_notify(void);
+
+// Waits for sim_notify. Must be called with the lock held by a bus thread.
+void sim_wait(void);
+
+// Pops the next element a DMA channel paced by dreq would write into a TX
+// FIFO. Returns false if no such channel is active. Lock must be held.
+bool sim_dma_tx_pop(uint dreq, uint16_t *word);
+
+// Hands a byte from an RX FIFO to a DMA channel paced by dreq. Returns false
+// if no such channel is active. Lock must be held.
+bool sim_dma_rx_push(uint dreq, uint8_t byte);
+
+// Marks an interrupt as pending and delivers it if it's enabled.
+void sim_irq_raise(uint num);
+
+// Hooks called right before and right after the handlers for an interrupt
+// run. A simulated peripheral uses them to latch the interrupt sources the
+// handlers see and to clear exactly those afterwards, standing in for the
+// read-to-clear registers of the real hardware.
+typedef void (*sim_irq_hook_t)(uint num);
+void sim_irq_set_hooks(uint num, sim_irq_hook_t enter, sim_irq_hook_t exit);
+
+// Returns true if gpio is the SDA pin of a bus with an injected stuck low
+// fault. Uses the fixed RP2040 pin to I2C function mapping.
+bool sim_i2c_gpio_stuck_low(uint gpio);
+
+// Blocks all signals in the calling thread. Used for host threads that must
+// never run simulated interrupt handlers.
+void sim_block_signals(void);
+
+#endif
@@ -0,0 +1,170 @@
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include "hardware/irq.h"
+#include "sim.h"
+#include "sim_internal.h"
+
+#define SIM_NUM_IRQS 32
+#define SIM_MAX_SHARED_HANDLERS 4
+
+#define SIM_IRQ_SIGNAL SIGUSR1
+
+static irq_handler_t handlers[SIM_NUM_IRQS][SIM_MAX_SHARED_HANDLERS];
+static sim_irq_hook_t enter_hooks[SIM_NUM_IRQS];
+static sim_irq_hook_t exit_hooks[SIM_NUM_IRQS];
+static atomic_uint enabled_mask;
+static atomic_uint pending_mask;
+static atomic_flag dispatching = ATOMIC_FLAG_INIT;
+
+static atomic_uint_fast64_t irq_cpu_ns;
+static atomic_uint irq_cnt;
+
+static pthread_once_t signal_once = PTHREAD_ONCE_INIT;
+
+static uint64_t sim_thread_cpu_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void sim_irq_dispatch(uint num) {
+  const uint64_t t0 = sim_thread_cpu_ns();
+
+  if (enter_hooks[num] != NULL) {
+    enter_hooks[num](num);
+  }
+
+  for (int i = 0; i != SIM_MAX_SHARED_HANDLERS; ++i) {
+    if (handlers[num][i] != NULL) {
+      handlers[num][i]();
+    }
+  }
+
+  if (exit_hooks[num] != NULL) {
+    exit_hooks[num](num);
+  }
+
+  atomic_fetch_add(&irq_cpu_ns, sim_thread_cpu_ns() - t0);
+  atomic_fetch_add(&irq_cnt, 1);
+}
+
+// Runs on whichever thread is executing the current FreeRTOS task, with all
+// signals blocked, in the same way an ISR runs on the RP2040. Handlers that
+// call portYIELD_FROM_ISR switch tasks from here just like the tick handler
+// of the POSIX port does.
+//
+// Only one thread dispatches at a time, as there is only one core taking
+// these interrupts on the RP2040. A signal that arrives on another thread
+// while dispatching leaves its pending bit for the dispatching thread, which
+// checks again after giving up the dispatcher role.
+static void sim_irq_signal_handler(int sig) {
+  (void) sig;
+
+  while (!atomic_flag_test_and_set(&dispatching)) {
+    uint runnable;
+    while (
+      (runnable = atomic_load(&pending_mask) & atomic_load(&enabled_mask)) != 0
+    ) {
+      const uint num = __builtin_ctz(runnable);
+      atomic_fetch_and(&pending_mask, ~(1u << num));
+      sim_irq_dispatch(num);
+    }
+
+    atomic_flag_clear(&dispatching);
+
+    if ((atomic_load(&pending_mask) & atomic_load(&enabled_mask)) == 0) {
+      break;
+    }
+  }
+}
+
+static void sim_irq_install_signal_handler(void) {
+  struct sigaction sa = {0};
+  sa.sa_handler = sim_irq_signal_handler;
+  sigfillset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  sigaction(SIM_IRQ_SIGNAL, &sa, NULL);
+}
+
+static void sim_irq_deliver(void) {
+  kill(getpid(), SIM_IRQ_SIGNAL);
+}
+
+static void sim_irq_add_handler(uint num, irq_handler_t handler) {
+  pthread_once(&signal_once, sim_irq_install_signal_handler);
+
+  for (int i = 0; i != SIM_MAX_SHARED_HANDLERS; ++i) {
+    if (handlers[num][i] == handler) {
+      return;
+    }
+  }
+
+  for (int i = 0; i != SIM_MAX_SHARED_HANDLERS; ++i) {
+    if (handlers[num][i] == NULL) {
+      handlers[num][i] = handler;
+      return;
+    }
+  }
+}
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler) {
+  for (int i = 0; i != SIM_MAX_SHARED_HANDLERS; ++i) {
+    handlers[num][i] = NULL;
+  }
+  sim_irq_add_handler(num, handler);
+}
+
+void irq_add_shared_handler(
+  uint num, irq_handler_t handler, uint8_t order_priority
+) {
+  (void) order_priority;
+  sim_irq_add_handler(num, handler);
+}
+
+void irq_remove_handler(uint num, irq_handler_t handler) {
+  for (int i = 0; i != SIM_MAX_SHARED_HANDLERS; ++i) {
+    if (handlers[num][i] == handler) {
+      handlers[num][i] = NULL;
+    }
+  }
+}
+
+void irq_set_enabled(uint num, bool enabled) {
+  if (enabled) {
+    atomic_fetch_or(&enabled_mask, 1u << num);
+    if (atomic_load(&pending_mask) & (1u << num)) {
+      sim_irq_deliver();
+    }
+  } else {
+    atomic_fetch_and(&enabled_mask, ~(1u << num));
+  }
+}
+
+bool irq_is_enabled(uint num) {
+  return (atomic_load(&enabled_mask) & (1u << num)) != 0;
+}
+
+void irq_set_pending(uint num) {
+  sim_irq_raise(num);
+}
+
+void sim_irq_raise(uint num) {
+  atomic_fetch_or(&pending_mask, 1u << num);
+  if (atomic_load(&enabled_mask) & (1u << num)) {
+    sim_irq_deliver();
+  }
+}
+
+void sim_irq_set_hooks(uint num, sim_irq_hook_t enter, sim_irq_hook_t exit) {
+  enter_hooks[num] = enter;
+  exit_hooks[num] = exit;
+}
+
+uint64_t sim_irq_cpu_ns(void) {
+  return atomic_load(&irq_cpu_ns);
+}
+
+uint32_t sim_irq_count(void) {
+  return atomic_load(&irq_cnt);
+}
@@ -0,0 +1,173 @@
+#include <time.h>
+#include "hardware/irq.h"
+#include "hardware/timer.h"
+#include "pico/time.h"
+#include "sim_internal.h"
+
+// Repeating timers. A thread sleeps until the earliest timer is due, marks
+// the timers that are due as fired and raises TIMER_IRQ_3. The interrupt
+// handler calls their callbacks and schedules them again.
+//
+// The timers have a mutex of their own as the thread needs a timed wait. It's
+// taken with signals blocked, like the one of sim_lock.
+
+static pthread_mutex_t timer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timer_cond;
+static pthread_once_t timer_once = PTHREAD_ONCE_INIT;
+static repeating_timer_t *timers;
+
+static void sim_timer_lock(sigset_t *saved_mask) {
+  sigset_t all;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, saved_mask);
+  pthread_mutex_lock(&timer_mutex);
+}
+
+static void sim_timer_unlock(sigset_t *saved_mask) {
+  pthread_mutex_unlock(&timer_mutex);
+  pthread_sigmask(SIG_SETMASK, saved_mask, NULL);
+}
+
+// Removes timer from the list. Returns false if it wasn't in it. Lock must
+// be held.
+static bool sim_timer_remove(repeating_timer_t *timer) {
+  for (repeating_timer_t **p = &timers; *p != NULL; p = &(*p)->next) {
+    if (*p == timer) {
+      *p = timer->next;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static void sim_timer_irq_handler(void) {
+  while (true) {
+    sigset_t saved_mask;
+    sim_timer_lock(&saved_mask);
+    repeating_timer_t *timer = timers;
+    while (timer != NULL && !timer->fired) {
+      timer = timer->next;
+    }
+    sim_timer_unlock(&saved_mask);
+
+    if (timer == NULL) {
+      return;
+    }
+
+    const bool repeat = timer->callback(timer);
+
+    // The callback may have cancelled the timer, or cancelled it and added
+    // it again.
+    sim_timer_lock(&saved_mask);
+    if (timer->fired) {
+      timer->fired = false;
+      if (!repeat) {
+        sim_timer_remove(timer);
+      } else if (timer->delay_us < 0) {
+        timer->due_us -= timer->delay_us;
+      } else {
+        timer->due_us = time_us_64() + timer->delay_us;
+      }
+      pthread_cond_signal(&timer_cond);
+    }
+    sim_timer_unlock(&saved_mask);
+  }
+}
+
+static void *sim_timer_thread(void *arg) {
+  (void) arg;
+
+  sim_block_signals();
+
+  pthread_mutex_lock(&timer_mutex);
+
+  while (true) {
+    const uint64_t now_us = time_us_64();
+    uint64_t next_us = UINT64_MAX;
+    bool fired = false;
+
+    for (repeating_timer_t *t = timers; t != NULL; t = t->next) {
+      if (t->fired) {
+        continue;
+      }
+      if (t->due_us <= now_us) {
+        t->fired = true;
+        fired = true;
+      } else if (t->due_us < next_us) {
+        next_us = t->due_us;
+      }
+    }
+
+    if (fired) {
+      pthread_mutex_unlock(&timer_mutex);
+      sim_irq_raise(TIMER_IRQ_3);
+      pthread_mutex_lock(&timer_mutex);
+    } else if (next_us == UINT64_MAX) {
+      pthread_cond_wait(&timer_cond, &timer_mutex);
+    } else {
+      const struct timespec ts = {
+        .tv_sec = next_us / 1000000,
+        .tv_nsec = (next_us % 1000000) * 1000,
+      };
+      pthread_cond_timedwait(&timer_cond, &timer_mutex, &ts);
+    }
+  }
+
+  return NULL;
+}
+
+static void sim_timer_start(void) {
+  // time_us_64 is CLOCK_MONOTONIC.
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&timer_cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  irq_set_exclusive_handler(TIMER_IRQ_3, sim_timer_irq_handler);
+  irq_set_enabled(TIMER_IRQ_3, true);
+
+  // The thread blocks signals itself, it may be created from a task.
+  pthread_t thread;
+  pthread_create(&thread, NULL, sim_timer_thread, NULL);
+  pthread_detach(thread);
+}
+
+bool add_repeating_timer_us(
+  int64_t delay_us,
+  repeating_timer_callback_t callback,
+  void *user_data,
+  repeating_timer_t *out
+) {
+  if (delay_us == 0) {
+    return false;
+  }
+
+  pthread_once(&timer_once, sim_timer_start);
+
+  out->delay_us = delay_us;
+  out->callback = callback;
+  out->user_data = user_data;
+  out->due_us = time_us_64() + (delay_us < 0 ? -delay_us : delay_us);
+  out->fired = false;
+
+  sigset_t saved_mask;
+  sim_timer_lock(&saved_mask);
+  out->next = timers;
+  timers = out;
+  pthread_cond_signal(&timer_cond);
+  sim_timer_unlock(&saved_mask);
+
+  return true;
+}
+
+bool cancel_repeating_timer(repeating_timer_t *timer) {
+  sigset_t saved_mask;
+  sim_timer_lock(&saved_mask);
+  const bool removed = sim_timer_remove(timer);
+  timer->fired = false;
+  sim_timer_unlock(&saved_mask);
+
+  return removed;
+}
@@ -1,376 +1,2568 @@
-#include "FreeRTOS.h"
-#include "semphr.h"
+#include <string.h>
 #include "hardware/clocks.h"
 #include "hardware/dma.h"
 #include "hardware/gpio.h"
 #include "hardware/irq.h"
+#include "hardware/timer.h"
 #include "i2c_dma.h"
-
-#define I2C_MAX_TRANSFER_SIZE     1056
-// A transfer timeout of 1000ms will allow a 10000 bit transfer to complete
-// successfully without timeouts at baudrates as low as 10000 baud.
-#define I2C_TRANSFER_TIMEOUT_MS   1000
-#define I2C_TAKE_MUTEX_TIMEOUT_MS 10000
+#include "i2c_dma_os.h"
+
+// Transfers are encoded into IC_DATA_CMD values I2C_CHUNK_SIZE at a time.
+// With a 16 entry TX FIFO, a chunk takes long enough to go out on the bus to
+// cover the latency of the DMA interrupt that starts the next one.
+#define I2C_CHUNK_SIZE            32
+// The default transfer timeout of 1000ms will allow a 10000 bit transfer,
+// about 1056 bytes, to complete successfully without timeouts at baudrates
+// as low as 10000 baud. Longer transfers are given the transfer timeout for
+// every 1056 bytes.
+#define I2C_TRANSFER_TIMEOUT_SIZE 1056
+// With I2C_DMA_TIMEOUT_AUTO, transfers are given twice the time they take on
+// the bus plus a margin for interrupt latency and short clock stretching.
+#define I2C_AUTO_TIMEOUT_MARGIN_MS 2
+// Time i2c_dma_periodic_stop gives the completion callback of a periodic
+// job's last transaction to run once the transaction is done.
+#define I2C_PERIODIC_STOP_TIMEOUT_MS 1000
+
+// A queued transfer can be overtaken by at most I2C_DMA_MAX_BYPASS transfers
+// with a higher priority before it's next in line regardless, so low
+// priority transfers aren't starved.
+#ifndef I2C_DMA_MAX_BYPASS
+#define I2C_DMA_MAX_BYPASS 4
+#endif
+
+// A transfer is made up of pieces, each of which is a run of bytes to write
+// to or read from a device. See i2c_dma_get_piece.
+typedef struct {
+  uint8_t addr;        // 7 bit I2C address
+  bool read;           // Read rather than write
+  bool restart;        // Preceded by a start/restart
+  bool stop;           // Followed by a stop, see I2C_DMA_M_STOP
+  const uint8_t *wbuf; // Bytes to write if not reading
+  uint8_t *rbuf;       // Buffer for bytes read if reading
+  size_t len;          // Number of bytes
+} i2c_dma_piece_t;
+
+// Position of the next byte to encode in the pieces of a transfer.
+typedef struct {
+  size_t piece;        // Index of the piece the byte is in
+  size_t off;          // Offset of the byte in the piece
+  bool restart;        // The byte needs a start/restart
+} i2c_dma_cursor_t;
 
 typedef struct i2c_dma_s {
   i2c_inst_t *i2c;
 
   uint irq_num;
   irq_handler_t irq_handler;
+  irq_handler_t dma_irq_handler;
+  bool dma_irq_handler_added;
+  uint dma_irq_handler_num; // DMA IRQ dma_irq_handler was added to
+
+  // Core that runs irq_handler and dma_irq_handler. NVIC settings are per
+  // core, so the interrupts are only enabled on this core. irqs_enabled is
+  // set once they have been enabled. The DMA channels raise DMA IRQ
+  // dma_irq_index, see i2c_dma_get_dma_irq_index.
+  uint irq_core;
+  bool irqs_enabled;
+  uint dma_irq_index;
 
   uint baudrate;
   uint sda_gpio;
   uint scl_gpio;
 
-  SemaphoreHandle_t semaphore;
-  SemaphoreHandle_t mutex;
+  // completion wakes the tasks waiting for transfers. mutex serializes
+  // recovering from timeouts. Both are created by the first
+  // i2c_dma_init_with_options for the bus and kept when it's initialized
+  // again, os_initialized is set once they have been created.
+  i2c_dma_os_completion_t completion;
+  i2c_dma_os_mutex_t mutex;
+  bool os_initialized;
 
   volatile bool stop_detected;
   volatile bool abort_detected;
 
-  uint16_t data_cmds[I2C_MAX_TRANSFER_SIZE];
+  // The transfer on the bus, if any, the DMA channels it uses, the tick
+  // count when it was started and the number of ticks it may take. Only one
+  // transfer at a time can be on the bus.
+  i2c_dma_xfer_t *volatile active;
+  int tx_chan;
+  int rx_chan;
+  volatile i2c_dma_os_ticks_t start_tick;
+  volatile i2c_dma_os_ticks_t timeout_ticks;
+
+  // See i2c_dma_set_transfer_timeout and i2c_dma_set_mutex_timeout.
+  volatile uint32_t transfer_timeout_ms;
+  volatile uint32_t mutex_timeout_ms;
+
+  // If channels_reserved is true, reserved_tx_chan and reserved_rx_chan were
+  // claimed and configured by i2c_dma_init_with_options and are used for
+  // every transfer.
+  bool channels_reserved;
+  uint reserved_tx_chan;
+  uint reserved_rx_chan;
+
+  // Transfers waiting for the bus, highest priority first, linked through
+  // their next fields. Transfers with the same priority are in the order
+  // they were submitted. When a transfer completes, the interrupt handler
+  // starts the first of them straight away. See i2c_dma_queue_insert.
+  i2c_dma_xfer_t *queue_head;
+
+  // Set if a transfer timed out. No further transfers are started until the
+  // I2C peripheral has been reinitialized in task context.
+  volatile bool reinit_required;
+
+  // Address in the I2C peripheral's TAR register, -1 if not known.
+  int target_addr;
+
+  // The active transfer is sent as one I2C transaction for each run of
+  // consecutive pieces with the same address. A transaction is encoded into
+  // data_cmds one chunk at a time. While the DMA sends one half of
+  // data_cmds, the other half holds the next chunk. A transaction that fits
+  // into a single chunk is sent in one go, a longer one is continued from
+  // the DMA interrupt handler each time a chunk has been sent. Likewise, the
+  // RX DMA channel is moved on to the next piece to read from the DMA
+  // interrupt handler.
+  uint16_t data_cmds[2][I2C_CHUNK_SIZE];
+  size_t cmds_len;         // Number of IC_DATA_CMD values in the transaction
+  size_t cmds_encoded;     // Number of them encoded so far
+  size_t cmds_sent;        // Number of them handed to the DMA so far
+  uint chunk_next;         // Half of data_cmds to send next
+  i2c_dma_cursor_t cursor; // Next byte to encode
+  size_t npieces;          // Number of pieces in the active transfer
+  size_t group_end;        // First piece after the transaction
+  bool group_safe;         // Other transfers may run after the transaction
+  size_t rx_piece;         // Piece the RX DMA channel is reading into
+  bool rx_draining;        // Stop detected, RX DMA channel still reading
+
+#ifdef I2C_DMA_STATS
+  // See i2c_dma_get_stats. Updated with the lock held.
+  i2c_dma_stats_t stats;
+#endif
 } i2c_dma_t;
 
 static i2c_dma_t i2c_dma_list[2];
 
-static void i2c_dma_irq_handler(i2c_dma_t *i2c_dma) {
-  const uint32_t status = i2c_get_hw(i2c_dma->i2c)->intr_stat;
+#ifdef I2C_DMA_TRACE
+_Static_assert(
+  (I2C_DMA_TRACE_ENTRIES & (I2C_DMA_TRACE_ENTRIES - 1)) == 0,
+  "I2C_DMA_TRACE_ENTRIES must be a power of two"
+);
+
+// The last I2C_DMA_TRACE_ENTRIES transfers completed on either bus. Entry
+// seq is stored at index seq % I2C_DMA_TRACE_ENTRIES. The seq field of an
+// entry is written last, so an entry whose seq field doesn't match its
+// position hasn't been completely written yet. See i2c_dma_trace_record.
+static struct {
+  i2c_dma_trace_entry_t entries[I2C_DMA_TRACE_ENTRIES];
+  uint32_t seq;          // Sequence number of the next entry
+  uint32_t dropped;      // Entries not recorded while frozen
+  volatile bool frozen;
+} i2c_dma_trace;
+#endif
+
+// active, the queue and start_tick are accessed by tasks and by the interrupt
+// handler, possibly on different cores.
+static i2c_dma_os_lock_state_t i2c_dma_lock(bool from_isr) {
+  return i2c_dma_os_lock(from_isr);
+}
 
-  // If there is an abort, normally there is an abort interrupt followed by a
-  // stop interrupt. On the rare occasion, for example, if the first I2C
-  // transaction after reset is aborted, the abort and stop interrupt flags
-  // appear to be set at the same instant or almost the same instant.
-  if (status & I2C_IC_INTR_STAT_R_TX_ABRT_BITS) {
-    // Transfer aborted.
-    i2c_get_hw(i2c_dma->i2c)->clr_tx_abrt;
-    i2c_dma->abort_detected = true;
+static void i2c_dma_unlock(bool from_isr, i2c_dma_os_lock_state_t saved) {
+  i2c_dma_os_unlock(from_isr, saved);
+}
+
+// Removes the transfer on the bus from i2c_dma->active and returns it. If
+// xfer isn't NULL, it's only removed if it's xfer. Whoever removes a
+// transfer completes it, so a transfer can only be completed once even if the
+// interrupt handler and a task that timed out try at the same time.
+static i2c_dma_xfer_t *i2c_dma_take_active(
+  i2c_dma_t *i2c_dma, i2c_dma_xfer_t *xfer, bool from_isr
+) {
+  const i2c_dma_os_lock_state_t saved = i2c_dma_lock(from_isr);
+  i2c_dma_xfer_t *active = i2c_dma->active;
+  if (xfer == NULL || active == xfer) {
+    i2c_dma->active = NULL;
+  } else {
+    active = NULL;
   }
+  i2c_dma_unlock(from_isr, saved);
 
-  if (status & I2C_IC_INTR_STAT_R_STOP_DET_BITS) {
-    // Transfer complete.
-    i2c_get_hw(i2c_dma->i2c)->clr_stop_det;
-    i2c_dma->stop_detected = true;
+  return active;
+}
+
+// Inserts xfer into the queue behind the transfers it may not overtake:
+// those with the same or a higher priority and those that have already been
+// overtaken I2C_DMA_MAX_BYPASS times. The transfers behind it have been
+// overtaken once more. Called with the lock held.
+static void i2c_dma_queue_insert(i2c_dma_t *i2c_dma, i2c_dma_xfer_t *xfer) {
+  i2c_dma_xfer_t **link = &i2c_dma->queue_head;
+
+  for (i2c_dma_xfer_t **p = link; *p != NULL; p = &(*p)->next) {
+    if ((*p)->prio >= xfer->prio || (*p)->bypassed >= I2C_DMA_MAX_BYPASS) {
+      link = &(*p)->next;
+    }
+  }
+
+  xfer->next = *link;
+  *link = xfer;
 
-    // If xSemaphoreGiveFromISR fails and returns errQUEUE_FULL the error
-    // isn't handled here. There isn't much that can be done. If
-    // xSemaphoreGiveFromISR fails, the corresponding call to xSemaphoreTake
-    // will eventually timeout.
-    BaseType_t task_switch_required = pdFALSE;
-    xSemaphoreGiveFromISR(i2c_dma->semaphore, &task_switch_required);
-    portYIELD_FROM_ISR(task_switch_required);
+  for (i2c_dma_xfer_t *q = xfer->next; q != NULL; q = q->next) {
+    q->bypassed += 1;
   }
 }
 
-static void i2c0_dma_irq_handler(void) {
-  i2c_dma_irq_handler(&i2c_dma_list[0]);
+// Puts xfer, which was stopped at a safe point to let a transfer with a
+// higher priority onto the bus, back into the queue. It goes behind as many
+// of the transfers with a higher priority at the front of the queue as it
+// may still be overtaken by. Called with the lock held.
+static void i2c_dma_queue_park(i2c_dma_t *i2c_dma, i2c_dma_xfer_t *xfer) {
+  i2c_dma_xfer_t **link = &i2c_dma->queue_head;
+
+  while (
+    *link != NULL &&
+    (*link)->prio > xfer->prio &&
+    xfer->bypassed < I2C_DMA_MAX_BYPASS
+  ) {
+    xfer->bypassed += 1;
+    link = &(*link)->next;
+  }
+
+  xfer->next = *link;
+  *link = xfer;
 }
 
-static void i2c1_dma_irq_handler(void) {
-  i2c_dma_irq_handler(&i2c_dma_list[1]);
+// Removes xfer from the queue if it hasn't been started yet. Returns true if
+// it was removed. Called with the lock held.
+static bool i2c_dma_queue_remove(i2c_dma_t *i2c_dma, i2c_dma_xfer_t *xfer) {
+  if (xfer->resume_piece != 0) {
+    return false;
+  }
+
+  for (
+    i2c_dma_xfer_t **p = &i2c_dma->queue_head; *p != NULL; p = &(*p)->next
+  ) {
+    if (*p == xfer) {
+      *p = xfer->next;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Returns true if xfer has been waiting for the bus for longer than its
+// deadline allows. Transfers that have been on the bus don't expire.
+static bool i2c_dma_expired(
+  const i2c_dma_xfer_t *xfer, i2c_dma_os_ticks_t now
+) {
+  return xfer->resume_piece == 0 &&
+    xfer->deadline_ticks != 0 &&
+    now - xfer->submit_tick >= xfer->deadline_ticks;
+}
+
+// Frees the DMA channels used by the last transfer. If the transfer didn't
+// complete successfully, the DMA is aborted first. Reserved channels stay
+// claimed.
+static void i2c_dma_release_channels(i2c_dma_t *i2c_dma, bool abort) {
+  const uint irq_index = i2c_dma->dma_irq_index;
+
+  if (i2c_dma->tx_chan != -1) {
+    if (abort) {
+      dma_channel_abort(i2c_dma->tx_chan);
+    }
+    dma_irqn_set_channel_enabled(irq_index, i2c_dma->tx_chan, false);
+    dma_irqn_acknowledge_channel(irq_index, i2c_dma->tx_chan);
+    if (!i2c_dma->channels_reserved) {
+      dma_channel_unclaim(i2c_dma->tx_chan);
+    }
+    i2c_dma->tx_chan = -1;
+  }
+
+  if (i2c_dma->rx_chan != -1) {
+    if (abort) {
+      dma_channel_abort(i2c_dma->rx_chan);
+    }
+    dma_irqn_set_channel_enabled(irq_index, i2c_dma->rx_chan, false);
+    dma_irqn_acknowledge_channel(irq_index, i2c_dma->rx_chan);
+    if (!i2c_dma->channels_reserved) {
+      dma_channel_unclaim(i2c_dma->rx_chan);
+    }
+    i2c_dma->rx_chan = -1;
+  }
 }
 
-static void i2c_dma_set_target_addr(i2c_inst_t *i2c, uint8_t addr) {
-  i2c_get_hw(i2c)->enable = 0;
-  i2c_get_hw(i2c)->tar = addr;
-  i2c_get_hw(i2c)->enable = 1;
+// The target address can only be changed while the I2C peripheral is
+// disabled. Skip that if the address is the same as for the last transfer.
+static void i2c_dma_set_target_addr(i2c_dma_t *i2c_dma, uint8_t addr) {
+  if (i2c_dma->target_addr == addr) {
+    return;
+  }
+
+  i2c_get_hw(i2c_dma->i2c)->enable = 0;
+  i2c_get_hw(i2c_dma->i2c)->tar = addr;
+  i2c_get_hw(i2c_dma->i2c)->enable = 1;
+  i2c_dma->target_addr = addr;
 }
 
-static void i2c_dma_tx_channel_configure(
-  i2c_inst_t *i2c, int tx_channel, const uint16_t *tx_buf, size_t len
+static dma_channel_config i2c_dma_tx_channel_config(
+  i2c_inst_t *i2c, int tx_channel
 ) {
   dma_channel_config tx_config = dma_channel_get_default_config(tx_channel);
   channel_config_set_read_increment(&tx_config, true);
   channel_config_set_write_increment(&tx_config, false);
   channel_config_set_transfer_data_size(&tx_config, DMA_SIZE_16);
   channel_config_set_dreq(&tx_config, i2c_get_dreq(i2c, true));
-  dma_channel_configure(
-    tx_channel, &tx_config, &i2c_get_hw(i2c)->data_cmd, tx_buf, len, true
-  );
+  return tx_config;
 }
 
-static void i2c_dma_rx_channel_configure(
-  i2c_inst_t *i2c, int rx_channel, uint8_t *rx_buf, size_t len
+static dma_channel_config i2c_dma_rx_channel_config(
+  i2c_inst_t *i2c, int rx_channel
 ) {
   dma_channel_config rx_config = dma_channel_get_default_config(rx_channel);
   channel_config_set_read_increment(&rx_config, false);
   channel_config_set_write_increment(&rx_config, true);
   channel_config_set_transfer_data_size(&rx_config, DMA_SIZE_8);
   channel_config_set_dreq(&rx_config, i2c_get_dreq(i2c, false));
+  return rx_config;
+}
+
+// Configures the DMA channels without starting them. After this, a transfer
+// only needs to set the buffer address and count of a channel, which also
+// triggers it. rx_channel may be -1 if there's nothing to read.
+static void i2c_dma_channels_configure(
+  i2c_dma_t *i2c_dma, int tx_channel, int rx_channel
+) {
+  const dma_channel_config tx_config =
+    i2c_dma_tx_channel_config(i2c_dma->i2c, tx_channel);
   dma_channel_configure(
-    rx_channel, &rx_config, rx_buf, &i2c_get_hw(i2c)->data_cmd, len, true
+    tx_channel, &tx_config, &i2c_get_hw(i2c_dma->i2c)->data_cmd,
+    i2c_dma->data_cmds[0], 0, false
   );
-}
 
-static void i2c_dma_pin_open_drain(uint gpio) {
-  gpio_set_function(gpio, GPIO_FUNC_SIO);
-  gpio_set_dir(gpio, GPIO_IN);
-  gpio_put(gpio, 0);
+  if (rx_channel != -1) {
+    const dma_channel_config rx_config =
+      i2c_dma_rx_channel_config(i2c_dma->i2c, rx_channel);
+    dma_channel_configure(
+      rx_channel, &rx_config, NULL, &i2c_get_hw(i2c_dma->i2c)->data_cmd, 0,
+      false
+    );
+  }
 }
 
-static void i2c_dma_pin_od_low(uint gpio) {
-  gpio_set_dir(gpio, GPIO_OUT);
+// Claims a TX and an RX DMA channel for the lifetime of the bus and
+// configures them.
+static int i2c_dma_reserve_channels(i2c_dma_t *i2c_dma) {
+  const int tx_chan = dma_claim_unused_channel(false);
+  if (tx_chan == -1) {
+    return PICO_ERROR_GENERIC;
+  }
+
+  const int rx_chan = dma_claim_unused_channel(false);
+  if (rx_chan == -1) {
+    dma_channel_unclaim(tx_chan);
+    return PICO_ERROR_GENERIC;
+  }
+
+  i2c_dma_channels_configure(i2c_dma, tx_chan, rx_chan);
+
+  i2c_dma->reserved_tx_chan = tx_chan;
+  i2c_dma->reserved_rx_chan = rx_chan;
+  i2c_dma->channels_reserved = true;
+
+  return PICO_OK;
 }
 
-static void i2c_dma_pin_od_high(uint gpio) {
-  gpio_set_dir(gpio, GPIO_IN);
+static void i2c_dma_unreserve_channels(i2c_dma_t *i2c_dma) {
+  dma_channel_unclaim(i2c_dma->reserved_tx_chan);
+  dma_channel_unclaim(i2c_dma->reserved_rx_chan);
+  i2c_dma->channels_reserved = false;
 }
 
-static void i2c_dma_unblock(i2c_dma_t *i2c_dma) {
-  i2c_dma_pin_open_drain(i2c_dma->sda_gpio);
-  i2c_dma_pin_open_drain(i2c_dma->scl_gpio);
+// Returns the number of pieces in xfer. A transfer with msgs has one piece
+// per message and one with writes has one piece per write. Otherwise there's
+// one piece per segment of bytes to write, where wbuf counts as one segment,
+// followed by one piece for the bytes to read if there are any.
+static size_t i2c_dma_piece_count(const i2c_dma_xfer_t *xfer) {
+  if (xfer->msgs != NULL) {
+    return xfer->nmsgs;
+  }
 
-  bool sda_high;
-  int max_tries = 9;
+  if (xfer->writes != NULL) {
+    return xfer->nwrites;
+  }
 
-  // Make sure the frequency of the bit-bannged I2C clock is at most 100KHz.
-  const uint32_t f_clk_sys_khz =
-    frequency_count_khz(CLOCKS_FC0_SRC_VALUE_CLK_SYS);
-  const uint32_t i2c_delay = f_clk_sys_khz / 100 / 2;
+  return (xfer->wiov != NULL ? xfer->wiovcnt : 1) + (xfer->rbuf_len > 0);
+}
 
-  do {
-    i2c_dma_pin_od_low(i2c_dma->scl_gpio);
-    for (int i = i2c_delay; i > 0; i -= 1) {
-      __asm__("nop");
-    }
+// Gets piece index of xfer.
+static void i2c_dma_get_piece(
+  const i2c_dma_xfer_t *xfer, size_t index, i2c_dma_piece_t *piece
+) {
+  if (xfer->msgs != NULL) {
+    const i2c_dma_msg_t *msg = &xfer->msgs[index];
+    piece->addr = msg->addr;
+    piece->read = (msg->flags & I2C_DMA_M_RD) != 0;
+    piece->restart = (msg->flags & I2C_DMA_M_NOSTART) == 0;
+    piece->stop = (msg->flags & I2C_DMA_M_STOP) != 0;
+    piece->wbuf = msg->buf;
+    piece->rbuf = msg->buf;
+    piece->len = msg->len;
+    return;
+  }
 
-    i2c_dma_pin_od_high(i2c_dma->scl_gpio);
-    for (int i = i2c_delay; i > 0; i -= 1) {
-      __asm__("nop");
-    }
+  // Each write is a transaction of its own.
+  if (xfer->writes != NULL) {
+    const i2c_dma_write_t *write = &xfer->writes[index];
+    piece->addr = write->addr;
+    piece->read = false;
+    piece->restart = true;
+    piece->stop = true;
+    piece->wbuf = write->buf;
+    piece->rbuf = NULL;
+    piece->len = write->len;
+    return;
+  }
 
-    max_tries -= 1;
-    sda_high = gpio_get(i2c_dma->sda_gpio);
-  } while (!sda_high && max_tries > 0);
+  const size_t nsegs = xfer->wiov != NULL ? xfer->wiovcnt : 1;
+
+  piece->addr = xfer->addr;
+  piece->stop = false;
+
+  if (index < nsegs) {
+    const i2c_dma_iovec_t *seg =
+      xfer->wiov != NULL ? &xfer->wiov[index] : &xfer->wbuf_iov;
+    piece->read = false;
+    piece->restart = index == 0;
+    piece->wbuf = seg->buf;
+    piece->rbuf = NULL;
+    piece->len = seg->len;
+  } else {
+    piece->read = true;
+    piece->restart = true;
+    piece->wbuf = NULL;
+    piece->rbuf = xfer->rbuf;
+    piece->len = xfer->rbuf_len;
+  }
 }
 
-static bool i2c_dma_is_blocked(i2c_dma_t *i2c_dma) {
-  i2c_dma_pin_open_drain(i2c_dma->sda_gpio);
-  i2c_dma_pin_open_drain(i2c_dma->scl_gpio);
+// Returns the current time in microseconds for the statistics and the trace,
+// 0 if neither of them is compiled in.
+static uint64_t i2c_dma_now_us(void) {
+#if defined(I2C_DMA_STATS) || defined(I2C_DMA_TRACE)
+  return time_us_64();
+#else
+  return 0;
+#endif
+}
 
-  const bool sda_high = gpio_get(i2c_dma->sda_gpio);
-  const bool scl_high = gpio_get(i2c_dma->scl_gpio);
+#ifdef I2C_DMA_STATS
+static void i2c_dma_histogram_add(i2c_dma_histogram_t *hist, uint64_t us) {
+  uint bucket = us == 0 ? 0 : 64 - __builtin_clzll(us);
+  if (bucket >= I2C_DMA_STATS_BUCKETS) {
+    bucket = I2C_DMA_STATS_BUCKETS - 1;
+  }
 
-  return !sda_high || !scl_high;
+  hist->buckets[bucket] += 1;
+  hist->count += 1;
+  hist->total_us += us;
+  if (us > hist->max_us) {
+    hist->max_us = us > UINT32_MAX ? UINT32_MAX : us;
+  }
 }
+#endif
 
-static int i2c_dma_init_intern(i2c_dma_t *i2c_dma) {
-  irq_set_enabled(i2c_dma->irq_num, false);
+// Records the completion of xfer with result rc.
+static void i2c_dma_stats_xfer_done(
+  i2c_dma_t *i2c_dma, const i2c_dma_xfer_t *xfer, int rc, bool from_isr
+) {
+#ifdef I2C_DMA_STATS
+  const uint64_t now = time_us_64();
+  const i2c_dma_os_lock_state_t saved = i2c_dma_lock(from_isr);
+  i2c_dma_stats_t *stats = &i2c_dma->stats;
+
+  stats->transactions += 1;
+  if (rc == PICO_OK) {
+    stats->bytes_written += xfer->len - xfer->rlen;
+    stats->bytes_read += xfer->rlen;
+  } else if (rc == PICO_ERROR_IO) {
+    stats->aborts += 1;
+  } else if (rc == PICO_ERROR_TIMEOUT && xfer->start_us == 0) {
+    stats->deadline_misses += 1;
+  } else if (rc == PICO_ERROR_TIMEOUT) {
+    stats->timeouts += 1;
+  }
 
-  i2c_dma->stop_detected = false;
-  i2c_dma->abort_detected = false;
+  // A transfer that missed its deadline or failed because it couldn't claim
+  // a DMA channel never got onto the bus.
+  if (xfer->start_us != 0 && rc != PICO_ERROR_GENERIC) {
+    i2c_dma_histogram_add(&stats->wire, now - xfer->start_us);
+  }
+  i2c_dma_histogram_add(&stats->latency, now - xfer->submit_us);
+
+  i2c_dma_unlock(from_isr, saved);
+#else
+  (void) i2c_dma;
+  (void) xfer;
+  (void) rc;
+  (void) from_isr;
+#endif
+}
 
-  if (uxSemaphoreGetCount(i2c_dma->semaphore) != 0) {
-    if (xSemaphoreTake(i2c_dma->semaphore, 0) != pdTRUE) {
-      return PICO_ERROR_GENERIC;
+#ifdef I2C_DMA_TRACE
+// Copies up to max of the first bytes xfer writes to bytes and returns how
+// many were copied.
+static uint8_t i2c_dma_trace_bytes(
+  const i2c_dma_xfer_t *xfer, uint8_t *bytes, uint8_t max
+) {
+  uint8_t n = 0;
+
+  if (xfer->prepared != NULL) {
+    const i2c_dma_prepared_t *prepared = xfer->prepared;
+    for (size_t i = 0; i != prepared->data_cmds_len && n != max; ++i) {
+      if (prepared->data_cmds[i] & I2C_IC_DATA_CMD_CMD_BITS) {
+        break;
+      }
+      bytes[n++] = prepared->data_cmds[i];
+    }
+    return n;
+  }
+
+  const size_t npieces = i2c_dma_piece_count(xfer);
+  for (size_t i = 0; i != npieces && n != max; ++i) {
+    i2c_dma_piece_t piece;
+    i2c_dma_get_piece(xfer, i, &piece);
+    for (size_t j = 0; !piece.read && j != piece.len && n != max; ++j) {
+      bytes[n++] = piece.wbuf[j];
     }
   }
 
-  // Don't do anything with i2c_dma->mutex here, let i2c_dma_write_read take
-  // care of it. Also, directly after creation with xSemaphoreCreateMutex a
-  // mutex can be successfully taken.
+  return n;
+}
+#endif
 
-  // Attempt to unblock a blocked bus. If it can't be unblocked, continue
-  // anyway.
-  if (i2c_dma_is_blocked(i2c_dma)) {
-    i2c_dma_unblock(i2c_dma);
+// Adds the completion of xfer with result rc at time now to the trace.
+static void i2c_dma_trace_record(
+  i2c_dma_t *i2c_dma,
+  const i2c_dma_xfer_t *xfer,
+  int rc,
+  uint64_t now,
+  bool from_isr
+) {
+#ifdef I2C_DMA_TRACE
+  // Only reserving a slot is done with the lock held. The Cortex-M0+ has no
+  // exclusive loads and stores, so an atomic increment would need a spin
+  // lock or masked interrupts anyway.
+  const i2c_dma_os_lock_state_t saved = i2c_dma_lock(from_isr);
+  const bool frozen = i2c_dma_trace.frozen;
+  uint32_t seq = 0;
+  if (frozen) {
+    i2c_dma_trace.dropped += 1;
+  } else {
+    seq = i2c_dma_trace.seq++;
   }
+  i2c_dma_unlock(from_isr, saved);
 
-  i2c_init(i2c_dma->i2c, i2c_dma->baudrate);
+  if (frozen) {
+    return;
+  }
 
-  gpio_set_function(i2c_dma->sda_gpio, GPIO_FUNC_I2C);
-  gpio_set_function(i2c_dma->scl_gpio, GPIO_FUNC_I2C);
-  gpio_pull_up(i2c_dma->sda_gpio);
-  gpio_pull_up(i2c_dma->scl_gpio);
+  // The slot is reserved, fill it in without holding the lock. Its seq
+  // field is invalidated first and set last, so that i2c_dma_trace_dump
+  // can tell when the slot is being written.
+  i2c_dma_trace_entry_t *entry =
+    &i2c_dma_trace.entries[seq & (I2C_DMA_TRACE_ENTRIES - 1)];
+  __atomic_store_n(&entry->seq, ~seq, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
 
-  i2c_get_hw(i2c_dma->i2c)->intr_mask =
-    I2C_IC_INTR_MASK_M_STOP_DET_BITS |
-    I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+  i2c_dma_piece_t first;
 
-  irq_set_exclusive_handler(i2c_dma->irq_num, i2c_dma->irq_handler);
-  irq_set_enabled(i2c_dma->irq_num, true);
+  if (xfer->prepared != NULL) {
+    first.addr = xfer->addr;
+  } else {
+    i2c_dma_get_piece(xfer, 0, &first);
+  }
 
-  return PICO_OK;
+  entry->start_us = xfer->start_us != 0 ? xfer->start_us : now;
+  entry->stop_us = now;
+  entry->wlen = xfer->len - xfer->rlen;
+  entry->rlen = xfer->rlen;
+  entry->abort_source = xfer->abort_source;
+  entry->bus = i2c_dma == &i2c_dma_list[0] ? 0 : 1;
+  entry->addr = first.addr;
+  entry->rc = rc;
+  entry->nbytes = i2c_dma_trace_bytes(
+    xfer, entry->bytes, sizeof(entry->bytes)
+  );
+
+  __atomic_store_n(&entry->seq, seq, __ATOMIC_RELEASE);
+#else
+  (void) i2c_dma;
+  (void) xfer;
+  (void) rc;
+  (void) now;
+  (void) from_isr;
+#endif
 }
 
-static int i2c_dma_reinit(i2c_dma_t *i2c_dma) {
-  return i2c_dma_init_intern(i2c_dma);
+// Records a failure to claim a DMA channel.
+static void i2c_dma_stats_claim_failed(i2c_dma_t *i2c_dma, bool from_isr) {
+#ifdef I2C_DMA_STATS
+  const i2c_dma_os_lock_state_t saved = i2c_dma_lock(from_isr);
+  i2c_dma->stats.dma_claim_failures += 1;
+  i2c_dma_unlock(from_isr, saved);
+#else
+  (void) i2c_dma;
+  (void) from_isr;
+#endif
 }
 
-int i2c_dma_init(
-  i2c_dma_t **pi2c_dma,
-  i2c_inst_t *i2c,
-  uint baudrate,
-  uint sda_gpio,
-  uint scl_gpio
+// Records a reinitialization of the I2C peripheral. Called from tasks.
+static void i2c_dma_stats_reinit(i2c_dma_t *i2c_dma) {
+#ifdef I2C_DMA_STATS
+  const i2c_dma_os_lock_state_t saved = i2c_dma_lock(false);
+  i2c_dma->stats.reinits += 1;
+  i2c_dma_unlock(false, saved);
+#else
+  (void) i2c_dma;
+#endif
+}
+
+// Records the time xfer waited in the queue before it was first started.
+static void i2c_dma_stats_started(
+  i2c_dma_t *i2c_dma, const i2c_dma_xfer_t *xfer, bool from_isr
 ) {
-  i2c_dma_t *i2c_dma;
+#ifdef I2C_DMA_STATS
+  const i2c_dma_os_lock_state_t saved = i2c_dma_lock(from_isr);
+  i2c_dma_histogram_add(
+    &i2c_dma->stats.queue_wait, xfer->start_us - xfer->submit_us
+  );
+  i2c_dma_unlock(from_isr, saved);
+#else
+  (void) i2c_dma;
+  (void) xfer;
+  (void) from_isr;
+#endif
+}
 
-  if (i2c == i2c0) {
-    i2c_dma = &i2c_dma_list[0];
-    i2c_dma->i2c = i2c0;
-    i2c_dma->irq_num = I2C0_IRQ;
-    i2c_dma->irq_handler = i2c0_dma_irq_handler;
-  } else {
-    i2c_dma = &i2c_dma_list[1];
-    i2c_dma->i2c = i2c1;
-    i2c_dma->irq_num = I2C1_IRQ;
-    i2c_dma->irq_handler = i2c1_dma_irq_handler;
-  }
+// Stores the result of xfer, calls its callback and wakes the task waiting
+// for it.
+static void i2c_dma_finish(i2c_dma_xfer_t *xfer, int rc, bool from_isr) {
+  i2c_dma_t *i2c_dma = xfer->i2c_dma;
 
-  *pi2c_dma = i2c_dma;
+  i2c_dma_stats_xfer_done(i2c_dma, xfer, rc, from_isr);
+  i2c_dma_trace_record(i2c_dma, xfer, rc, i2c_dma_now_us(), from_isr);
 
-  i2c_dma->baudrate = baudrate;
-  i2c_dma->sda_gpio = sda_gpio;
-  i2c_dma->scl_gpio = scl_gpio;
+  // Once done is set the owner of xfer may reuse it, so fetch the callback
+  // first. The waiter is set with the lock held by i2c_dma_wait_intern
+  // before it checks done.
+  const i2c_dma_callback_t callback = xfer->callback;
+  void *const callback_arg = xfer->callback_arg;
 
-  i2c_dma->semaphore = xSemaphoreCreateBinary();
-  if (i2c_dma->semaphore == NULL) {
-    return PICO_ERROR_GENERIC;
-  }
+  const i2c_dma_os_lock_state_t saved = i2c_dma_lock(from_isr);
+  void *const waiter = xfer->waiter;
+  xfer->rc = rc;
+  xfer->done = true;
+  i2c_dma_unlock(from_isr, saved);
 
-  i2c_dma->mutex = xSemaphoreCreateMutex();
-  if (i2c_dma->mutex == NULL) {
-    return PICO_ERROR_GENERIC;
+  if (callback != NULL) {
+    callback(xfer, callback_arg, from_isr);
   }
 
-  return i2c_dma_init_intern(i2c_dma);
+  i2c_dma_os_completion_signal(&i2c_dma->completion, waiter, from_isr);
 }
 
-static int i2c_dma_write_read_internal(
-  i2c_dma_t *i2c_dma,
-  uint8_t addr,
-  const uint8_t *wbuf,
-  size_t wbuf_len,
-  uint8_t *rbuf,
-  size_t rbuf_len
+// Returns the number of ticks xfer may take once it's on the bus.
+static i2c_dma_os_ticks_t i2c_dma_timeout_ticks(
+  i2c_dma_t *i2c_dma, const i2c_dma_xfer_t *xfer
 ) {
-  if (
-    (wbuf_len > 0 && wbuf == NULL) ||
-    (rbuf_len > 0 && rbuf == NULL) ||
-    (wbuf_len == 0 && rbuf_len == 0) ||
-    (wbuf_len + rbuf_len > I2C_MAX_TRANSFER_SIZE)
-  ) {
-    return PICO_ERROR_INVALID_ARG;
+  const uint32_t timeout_ms = xfer->timeout_ms != I2C_DMA_TIMEOUT_DEFAULT ?
+    xfer->timeout_ms : i2c_dma->transfer_timeout_ms;
+
+  if (timeout_ms != I2C_DMA_TIMEOUT_AUTO) {
+    const size_t blocks =
+      (xfer->len + I2C_TRANSFER_TIMEOUT_SIZE - 1) / I2C_TRANSFER_TIMEOUT_SIZE;
+    return i2c_dma_os_ms_to_ticks((uint64_t) blocks * timeout_ms);
   }
 
-  const bool writing = (wbuf_len > 0);
-  const bool reading = (rbuf_len > 0);
+  // 9 bits for each byte and, at most, a start or restart with an address
+  // and a stop for each piece.
+  const uint64_t bits = 9 * (uint64_t) xfer->len +
+    11 * (uint64_t) i2c_dma_piece_count(xfer);
+  const uint64_t bus_ms =
+    (bits * 1000 + i2c_dma->baudrate - 1) / i2c_dma->baudrate;
+
+  // The tick count may advance right after the transfer was started, so
+  // give it one more tick.
+  return i2c_dma_os_ms_to_ticks(2 * bus_ms + I2C_AUTO_TIMEOUT_MARGIN_MS) + 1;
+}
 
-  int tx_chan = 0; // Channel for writing data_cmds to I2C peripheral.
-  int rx_chan = 0; // Channel for reading data from I2C peripheral, if needed.
+// Encodes the next count IC_DATA_CMD values of xfer, one value per byte
+// written or read, starting at cursor, which is advanced past them. If stop
+// is true, the last of them is the end of the transaction.
+static void i2c_dma_encode(
+  uint16_t *data_cmds,
+  const i2c_dma_xfer_t *xfer,
+  i2c_dma_cursor_t *cursor,
+  size_t count,
+  bool stop
+) {
+  while (count > 0) {
+    i2c_dma_piece_t piece;
+    i2c_dma_get_piece(xfer, cursor->piece, &piece);
+
+    // The first byte of a piece may have to be preceded by a start/restart.
+    // If the piece is empty, that's the first byte of the next piece.
+    if (cursor->off == 0 && piece.restart) {
+      cursor->restart = true;
+    }
 
-  if (writing) {
-    // Setup commands for each byte to write to the I2C bus.
-    for (size_t i = 0; i != wbuf_len; ++i) {
-      i2c_dma->data_cmds[i] = wbuf[i];
+    const size_t left = piece.len - cursor->off;
+    const size_t n = left < count ? left : count;
+
+    if (n > 0) {
+      if (piece.read) {
+        // Setup commands for each byte to read from the I2C bus.
+        for (size_t i = 0; i != n; ++i) {
+          data_cmds[i] = I2C_IC_DATA_CMD_CMD_BITS;
+        }
+      } else {
+        // Setup commands for each byte to write to the I2C bus.
+        const uint8_t *wbuf = piece.wbuf + cursor->off;
+        for (size_t i = 0; i != n; ++i) {
+          data_cmds[i] = wbuf[i];
+        }
+      }
+
+      if (cursor->restart) {
+        data_cmds[0] |= I2C_IC_DATA_CMD_RESTART_BITS;
+        cursor->restart = false;
+      }
+
+      data_cmds += n;
+      count -= n;
+      cursor->off += n;
     }
 
-    // The first byte written must be preceded by a start.
-    i2c_dma->data_cmds[0] |= I2C_IC_DATA_CMD_RESTART_BITS;
+    if (cursor->off == piece.len) {
+      cursor->piece += 1;
+      cursor->off = 0;
+    }
   }
 
-  // DMA tx_chan is needed for both writing and reading.
-  tx_chan = dma_claim_unused_channel(false);
-  if (tx_chan == -1) {
-    return PICO_ERROR_GENERIC;
+  // The last byte transfered must be followed by a stop.
+  if (stop) {
+    data_cmds[-1] |= I2C_IC_DATA_CMD_STOP_BITS;
   }
+}
 
-  if (reading) {
-    // Setup commands for each byte to read from the I2C bus.
-    for (size_t i = 0; i != rbuf_len; ++i) {
-      i2c_dma->data_cmds[wbuf_len + i] = I2C_IC_DATA_CMD_CMD_BITS;
-    }
+// Encodes the next chunk of the transaction on the bus into the half of
+// data_cmds given by half.
+static void i2c_dma_encode_chunk(
+  i2c_dma_t *i2c_dma, const i2c_dma_xfer_t *xfer, uint half
+) {
+  const size_t remaining = i2c_dma->cmds_len - i2c_dma->cmds_encoded;
+  const size_t count = remaining < I2C_CHUNK_SIZE ? remaining : I2C_CHUNK_SIZE;
 
-    // The first byte read must be preceded by a start/restart.
-    i2c_dma->data_cmds[wbuf_len] |= I2C_IC_DATA_CMD_RESTART_BITS;
+  i2c_dma_encode(
+    i2c_dma->data_cmds[half], xfer, &i2c_dma->cursor, count,
+    count == remaining
+  );
+  i2c_dma->cmds_encoded += count;
+}
 
-    // DMA rx_chan is only needed for reading.
-    rx_chan = dma_claim_unused_channel(false);
-    if (rx_chan == -1) {
-      dma_channel_unclaim(tx_chan);
-      return PICO_ERROR_GENERIC;
+// Hands the next encoded chunk of the transaction to the TX DMA channel.
+// The completion interrupt is only needed while there are chunks left. The
+// completion of the previous chunk is latched even if its interrupt wasn't
+// enabled, so it's acknowledged first.
+static void i2c_dma_send_chunk(i2c_dma_t *i2c_dma) {
+  const size_t remaining = i2c_dma->cmds_len - i2c_dma->cmds_sent;
+  const size_t count = remaining < I2C_CHUNK_SIZE ? remaining : I2C_CHUNK_SIZE;
+  const uint16_t *chunk = i2c_dma->data_cmds[i2c_dma->chunk_next];
+
+  i2c_dma->cmds_sent += count;
+  i2c_dma->chunk_next ^= 1;
+
+  const uint irq_index = i2c_dma->dma_irq_index;
+  dma_irqn_acknowledge_channel(irq_index, i2c_dma->tx_chan);
+  if (i2c_dma->cmds_sent == i2c_dma->cmds_len) {
+    dma_irqn_set_channel_enabled(irq_index, i2c_dma->tx_chan, false);
+  } else {
+    dma_irqn_set_channel_enabled(irq_index, i2c_dma->tx_chan, true);
+  }
+
+  dma_channel_transfer_from_buffer_now(i2c_dma->tx_chan, chunk, count);
+}
+
+// Returns the index of the first piece to read from index on in the
+// transaction on the bus, or i2c_dma->group_end if there is none.
+static size_t i2c_dma_next_rx_piece(
+  i2c_dma_t *i2c_dma, const i2c_dma_xfer_t *xfer, size_t index
+) {
+  for (; index != i2c_dma->group_end; ++index) {
+    i2c_dma_piece_t piece;
+    i2c_dma_get_piece(xfer, index, &piece);
+    if (piece.read && piece.len > 0) {
+      break;
     }
   }
 
-  // The last byte transfered must be followed by a stop.
-  i2c_dma->data_cmds[wbuf_len + rbuf_len - 1] |= I2C_IC_DATA_CMD_STOP_BITS;
+  return index;
+}
 
-  // Tell the I2C peripheral the adderss of the device for the transfer.
-  i2c_dma_set_target_addr(i2c_dma->i2c, addr);
+// Returns true if the RX DMA channel is reading into the last piece of the
+// transaction on the bus. A prepared transfer is read in one go.
+static bool i2c_dma_last_rx_piece(
+  i2c_dma_t *i2c_dma, const i2c_dma_xfer_t *xfer
+) {
+  return xfer->prepared != NULL || i2c_dma->group_end ==
+    i2c_dma_next_rx_piece(i2c_dma, xfer, i2c_dma->rx_piece + 1);
+}
 
-  i2c_dma->stop_detected = false;
-  i2c_dma->abort_detected = false;
+// Points the RX DMA channel at piece index. The completion interrupt is
+// only needed if there's another piece to read after it, or if the stop has
+// already been detected. See i2c_dma_send_chunk for the acknowledge.
+static void i2c_dma_start_rx_piece(
+  i2c_dma_t *i2c_dma, const i2c_dma_xfer_t *xfer, size_t index
+) {
+  i2c_dma_piece_t piece;
+  i2c_dma_get_piece(xfer, index, &piece);
 
-  // Start the I2C transfer on required DMA channels.
-  if (reading) {
-    i2c_dma_rx_channel_configure(i2c_dma->i2c, rx_chan, rbuf, rbuf_len);
-  }
-  i2c_dma_tx_channel_configure(
-    i2c_dma->i2c, tx_chan, i2c_dma->data_cmds, wbuf_len + rbuf_len
+  i2c_dma->rx_piece = index;
+
+  const uint irq_index = i2c_dma->dma_irq_index;
+  dma_irqn_acknowledge_channel(irq_index, i2c_dma->rx_chan);
+  dma_irqn_set_channel_enabled(
+    irq_index,
+    i2c_dma->rx_chan,
+    i2c_dma->rx_draining || !i2c_dma_last_rx_piece(i2c_dma, xfer)
   );
 
-  // The I2C transfer via DMA has been started. Wait for it to complete. Under
-  // normal circumstances, the transfer is complete when a stop is detected on
-  // the bus. If the hardware detects problems during the transfer, there will
-  // normally be an abort followed by a stop. Scenarios where a stop and/or
-  // abort are not detected are also possible, for these scenarios a timeout
-  // is needed. As an example, no stop will be detected if SDA gets stuck low.
-  const bool timeout = xSemaphoreTake(
-    i2c_dma->semaphore, I2C_TRANSFER_TIMEOUT_MS * portTICK_PERIOD_MS
-  ) == pdFALSE;
+  dma_channel_transfer_to_buffer_now(i2c_dma->rx_chan, piece.rbuf, piece.len);
+}
 
-  // If there were problems, abort the DMA.
-  if (timeout || i2c_dma->abort_detected || !i2c_dma->stop_detected) {
-    dma_channel_abort(tx_chan);
-    if (reading) {
-      dma_channel_abort(rx_chan);
-    }
+// Moves the RX DMA channel on to the next piece to read if it has finished
+// the current one. Returns true if it has finished the last piece of a
+// transaction whose stop has already been detected, in which case the
+// caller ends the transaction. Called with the lock held.
+static bool i2c_dma_continue_rx(
+  i2c_dma_t *i2c_dma, const i2c_dma_xfer_t *xfer
+) {
+  const uint irq_index = i2c_dma->dma_irq_index;
+  const int rx_chan = i2c_dma->rx_chan;
+  if (rx_chan == -1 || !dma_irqn_get_channel_status(irq_index, rx_chan)) {
+    return false;
   }
 
-  // Free the DMA channels.
-  dma_channel_unclaim(tx_chan);
-  if (reading) {
-    dma_channel_unclaim(rx_chan);
+  dma_irqn_acknowledge_channel(irq_index, rx_chan);
+
+  if (xfer == NULL || i2c_dma->abort_detected) {
+    return false;
+  }
+
+  if (i2c_dma_last_rx_piece(i2c_dma, xfer)) {
+    const bool drained = i2c_dma->rx_draining;
+    i2c_dma->rx_draining = false;
+    return drained;
   }
 
-  int rc = PICO_OK;
+  i2c_dma_start_rx_piece(
+    i2c_dma, xfer, i2c_dma_next_rx_piece(i2c_dma, xfer, i2c_dma->rx_piece + 1)
+  );
+
+  return false;
+}
 
-  if (timeout) {
-    rc = PICO_ERROR_TIMEOUT;
-  } else if (i2c_dma->abort_detected || !i2c_dma->stop_detected) {
-    rc = PICO_ERROR_IO;
+// Short pieces at the end of a transaction may be entirely in the RX FIFO
+// by the time the stop is detected, and the I2C interrupt can be handled
+// before the DMA interrupt that moves the RX DMA channel on to them. Rather
+// than waiting for the RX DMA channel here, returns true if it still has
+// bytes to read. The DMA interrupt handler then ends the transaction once
+// it has read them, see i2c_dma_continue_rx. Called with the lock held.
+static bool i2c_dma_start_draining(i2c_dma_t *i2c_dma) {
+  const i2c_dma_xfer_t *xfer = i2c_dma->active;
+  const int rx_chan = i2c_dma->rx_chan;
+  if (xfer == NULL || i2c_dma->abort_detected || rx_chan == -1) {
+    return false;
   }
 
-  // Attempt to recover from errors.
-  if (rc != PICO_OK) {
-    i2c_dma_reinit(i2c_dma);
+  if (
+    !dma_channel_is_busy(rx_chan) &&
+    i2c_dma_last_rx_piece(i2c_dma, xfer)
+  ) {
+    return false;
   }
 
-  return rc;
+  // If the RX DMA channel has already finished the last piece, its
+  // completion is latched and enabling the interrupt raises it.
+  i2c_dma->rx_draining = true;
+  dma_irqn_set_channel_enabled(i2c_dma->dma_irq_index, rx_chan, true);
+
+  return true;
 }
 
-int i2c_dma_write_read(
-  i2c_dma_t *i2c_dma,
-  uint8_t addr,
-  const uint8_t *wbuf,
-  size_t wbuf_len,
-  uint8_t *rbuf,
-  size_t rbuf_len
-) {
-  if (xSemaphoreTake(
-      i2c_dma->mutex, I2C_TAKE_MUTEX_TIMEOUT_MS * portTICK_PERIOD_MS
-    ) != pdTRUE) {
-    return PICO_ERROR_TIMEOUT;
+// Starts the next transaction of the active transfer. It's made up of the
+// pieces from i2c_dma->cursor on that have the same address, up to and
+// including the first one that's followed by a stop.
+static void i2c_dma_start_group(i2c_dma_t *i2c_dma, i2c_dma_xfer_t *xfer) {
+  const size_t first = i2c_dma->cursor.piece;
+
+  i2c_dma_piece_t piece;
+  i2c_dma_get_piece(xfer, first, &piece);
+  const uint8_t addr = piece.addr;
+
+  size_t len = 0;
+  size_t end = first;
+  bool safe = false;
+  while (end != i2c_dma->npieces && !safe) {
+    i2c_dma_get_piece(xfer, end, &piece);
+    if (piece.addr != addr) {
+      break;
+    }
+    len += piece.len;
+    safe = piece.stop;
+    end += 1;
   }
 
-  const int rc = i2c_dma_write_read_internal(
-    i2c_dma, addr, wbuf, wbuf_len, rbuf, rbuf_len
-  );
-
-  if (xSemaphoreGive(i2c_dma->mutex) != pdTRUE && rc == PICO_OK) {
-    return PICO_ERROR_GENERIC;
+  i2c_dma->group_end = end;
+  i2c_dma->group_safe = safe;
+
+  // Encode the first chunk, and the second one if there is one.
+  i2c_dma->cmds_len = len;
+  i2c_dma->cmds_encoded = 0;
+  i2c_dma->cmds_sent = 0;
+  i2c_dma->chunk_next = 0;
+  i2c_dma_encode_chunk(i2c_dma, xfer, 0);
+  if (i2c_dma->cmds_encoded < i2c_dma->cmds_len) {
+    i2c_dma_encode_chunk(i2c_dma, xfer, 1);
   }
 
-  return rc;
-}
+  // Tell the I2C peripheral the adderss of the device for the transfer.
+  i2c_dma_set_target_addr(i2c_dma, addr);
 
+  i2c_dma->stop_detected = false;
+  i2c_dma->abort_detected = false;
+  i2c_dma->rx_draining = false;
+
+  // Start the I2C transfer on required DMA channels.
+  const size_t rx_piece = i2c_dma_next_rx_piece(i2c_dma, xfer, first);
+  if (rx_piece != end) {
+    i2c_dma_start_rx_piece(i2c_dma, xfer, rx_piece);
+  }
+  i2c_dma_send_chunk(i2c_dma);
+}
+
+// Claims and configures the DMA channels for xfer and starts it. xfer must
+// already be in i2c_dma->active. Called from tasks and from the interrupt
+// handler.
+static int i2c_dma_arm(i2c_dma_t *i2c_dma, i2c_dma_xfer_t *xfer) {
+  // DMA tx_chan is needed for both writing and reading, rx_chan is only
+  // needed for reading. Reserved channels are already configured.
+  if (i2c_dma->channels_reserved) {
+    i2c_dma->tx_chan = i2c_dma->reserved_tx_chan;
+    if (xfer->rlen > 0) {
+      i2c_dma->rx_chan = i2c_dma->reserved_rx_chan;
+    }
+  } else {
+    const int tx_chan = dma_claim_unused_channel(false);
+    if (tx_chan == -1) {
+      return PICO_ERROR_GENERIC;
+    }
+    i2c_dma->tx_chan = tx_chan;
+
+    if (xfer->rlen > 0) {
+      const int rx_chan = dma_claim_unused_channel(false);
+      if (rx_chan == -1) {
+        i2c_dma_release_channels(i2c_dma, false);
+        return PICO_ERROR_GENERIC;
+      }
+      i2c_dma->rx_chan = rx_chan;
+    }
+
+    i2c_dma_channels_configure(i2c_dma, i2c_dma->tx_chan, i2c_dma->rx_chan);
+  }
+
+  // A prepared transfer is already encoded.
+  if (xfer->prepared != NULL) {
+    i2c_dma->npieces = 0;
+    i2c_dma->group_end = 0;
+    i2c_dma->group_safe = false;
+
+    i2c_dma_set_target_addr(i2c_dma, xfer->addr);
+
+    i2c_dma->stop_detected = false;
+    i2c_dma->abort_detected = false;
+    i2c_dma->rx_draining = false;
+
+    if (xfer->rlen > 0) {
+      dma_irqn_acknowledge_channel(i2c_dma->dma_irq_index, i2c_dma->rx_chan);
+      dma_channel_transfer_to_buffer_now(
+        i2c_dma->rx_chan, xfer->rbuf, xfer->rbuf_len
+      );
+    }
+    dma_channel_transfer_from_buffer_now(
+      i2c_dma->tx_chan,
+      xfer->prepared->data_cmds,
+      xfer->prepared->data_cmds_len
+    );
+
+    return PICO_OK;
+  }
+
+  // A transfer that was stopped at a safe point resumes where it stopped.
+  i2c_dma->npieces = i2c_dma_piece_count(xfer);
+  i2c_dma->cursor.piece = xfer->resume_piece;
+  i2c_dma->cursor.off = 0;
+  i2c_dma->cursor.restart = false;
+
+  i2c_dma_start_group(i2c_dma, xfer);
+
+  return PICO_OK;
+}
+
+// Makes xfer the active transfer. Called with the lock held.
+static void i2c_dma_activate(
+  i2c_dma_t *i2c_dma, i2c_dma_xfer_t *xfer, i2c_dma_os_ticks_t now
+) {
+  i2c_dma->active = xfer;
+  i2c_dma->start_tick = now;
+  i2c_dma->timeout_ticks = i2c_dma_timeout_ticks(i2c_dma, xfer);
+}
+
+// Starts the first queued transfer if the bus is idle. Transfers that can't
+// be started are completed with an error and the next one is tried.
+static void i2c_dma_start_queued(i2c_dma_t *i2c_dma, bool from_isr) {
+  while (true) {
+    const i2c_dma_os_ticks_t now = i2c_dma_os_ticks(from_isr);
+    const i2c_dma_os_lock_state_t saved = i2c_dma_lock(from_isr);
+    i2c_dma_xfer_t *xfer = NULL;
+    bool expired = false;
+    if (
+      i2c_dma->active == NULL &&
+      !i2c_dma->reinit_required &&
+      i2c_dma->queue_head != NULL
+    ) {
+      xfer = i2c_dma->queue_head;
+      i2c_dma->queue_head = xfer->next;
+      expired = i2c_dma_expired(xfer, now);
+      if (!expired) {
+        i2c_dma_activate(i2c_dma, xfer, now);
+      }
+    }
+    i2c_dma_unlock(from_isr, saved);
+
+    if (xfer == NULL) {
+      return;
+    }
+
+    // A transfer that missed its deadline completes without using the bus.
+    if (expired) {
+      i2c_dma_finish(xfer, PICO_ERROR_TIMEOUT, from_isr);
+      continue;
+    }
+
+    // A transfer resumed after a safe point has already been started.
+    const bool first_start = xfer->start_us == 0;
+    if (first_start) {
+      xfer->start_us = i2c_dma_now_us();
+    }
+
+    if (i2c_dma_arm(i2c_dma, xfer) == PICO_OK) {
+      if (first_start) {
+        i2c_dma_stats_started(i2c_dma, xfer, from_isr);
+      }
+      return;
+    }
+
+    i2c_dma_stats_claim_failed(i2c_dma, from_isr);
+
+    if (i2c_dma_take_active(i2c_dma, xfer, from_isr) == xfer) {
+      i2c_dma_finish(xfer, PICO_ERROR_GENERIC, from_isr);
+    }
+  }
+}
+
+// Ends the transaction on the bus once its stop has been detected and the
+// RX DMA channel has read all of it. Called from the I2C interrupt handler
+// or, if the RX DMA channel was still reading, from the DMA interrupt
+// handler.
+static void i2c_dma_end_transaction(i2c_dma_t *i2c_dma) {
+  // If the active transfer has more transactions, start the next one,
+  // unless the transaction ended at a safe point and a transfer with a
+  // higher priority is waiting. In that case the active transfer goes
+  // back into the queue and resumes later with its next transaction.
+  // Otherwise the transfer is complete.
+  const i2c_dma_os_lock_state_t saved = i2c_dma_lock(true);
+  i2c_dma_xfer_t *xfer = i2c_dma->active;
+  const bool aborted = i2c_dma->abort_detected;
+  const bool more = xfer != NULL &&
+    !aborted &&
+    i2c_dma->group_end != i2c_dma->npieces;
+  const bool yield = more &&
+    i2c_dma->group_safe &&
+    i2c_dma->queue_head != NULL &&
+    i2c_dma->queue_head->prio > xfer->prio &&
+    xfer->bypassed < I2C_DMA_MAX_BYPASS;
+  if (yield) {
+    xfer->resume_piece = i2c_dma->group_end;
+    i2c_dma_queue_park(i2c_dma, xfer);
+  }
+  if (!more || yield) {
+    i2c_dma->active = NULL;
+  }
+  i2c_dma_unlock(true, saved);
+
+  if (yield) {
+    i2c_dma_release_channels(i2c_dma, false);
+    i2c_dma_start_queued(i2c_dma, true);
+    return;
+  }
+
+  if (more) {
+    i2c_dma_start_group(i2c_dma, xfer);
+    return;
+  }
+
+  if (xfer != NULL) {
+    i2c_dma_release_channels(i2c_dma, aborted);
+
+    // Discard anything an aborted read left in the RX FIFO.
+    if (aborted) {
+      for (uint n = i2c_get_hw(i2c_dma->i2c)->rxflr; n > 0; n -= 1) {
+        i2c_get_hw(i2c_dma->i2c)->data_cmd;
+      }
+    }
+
+    // Get the next transfer onto the bus before doing anything else.
+    i2c_dma_start_queued(i2c_dma, true);
+
+    i2c_dma_finish(xfer, aborted ? PICO_ERROR_IO : PICO_OK, true);
+  }
+}
+
+static void i2c_dma_irq_handler(i2c_dma_t *i2c_dma) {
+  const uint32_t status = i2c_get_hw(i2c_dma->i2c)->intr_stat;
+
+  // Reinitializing the I2C peripheral resets its interrupt mask, enabling
+  // interrupts that aren't handled here. The peripheral may be reinitialized
+  // by a task on another core while this core has its interrupt enabled, so
+  // mask them again rather than interrupting over and over until the task
+  // gets there.
+  if (status & ~(I2C_IC_INTR_STAT_R_STOP_DET_BITS |
+      I2C_IC_INTR_STAT_R_TX_ABRT_BITS)) {
+    i2c_get_hw(i2c_dma->i2c)->intr_mask =
+      I2C_IC_INTR_MASK_M_STOP_DET_BITS |
+      I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+  }
+
+  // If there is an abort, normally there is an abort interrupt followed by a
+  // stop interrupt. On the rare occasion, for example, if the first I2C
+  // transaction after reset is aborted, the abort and stop interrupt flags
+  // appear to be set at the same instant or almost the same instant.
+  if (status & I2C_IC_INTR_STAT_R_TX_ABRT_BITS) {
+    // Transfer aborted. The I2C peripheral flushes its TX FIFO and keeps
+    // it flushed until the abort is cleared. Stop the DMA first so that
+    // the rest of the aborted transfer doesn't end up on the bus. Setting
+    // abort_detected first stops the DMA interrupt handler from sending
+    // further chunks.
+    const i2c_dma_os_lock_state_t saved = i2c_dma_lock(true);
+    i2c_dma->abort_detected = true;
+    if (i2c_dma->active != NULL) {
+      i2c_dma->active->abort_source =
+        i2c_get_hw(i2c_dma->i2c)->tx_abrt_source;
+    }
+    if (i2c_dma->tx_chan != -1) {
+      dma_channel_abort(i2c_dma->tx_chan);
+    }
+    if (i2c_dma->rx_chan != -1) {
+      dma_channel_abort(i2c_dma->rx_chan);
+    }
+    i2c_dma_unlock(true, saved);
+    i2c_get_hw(i2c_dma->i2c)->clr_tx_abrt;
+  }
+
+  if (status & I2C_IC_INTR_STAT_R_STOP_DET_BITS) {
+    // Transaction complete.
+    i2c_get_hw(i2c_dma->i2c)->clr_stop_det;
+    i2c_dma->stop_detected = true;
+
+    const i2c_dma_os_lock_state_t saved = i2c_dma_lock(true);
+    const bool draining = i2c_dma_start_draining(i2c_dma);
+    i2c_dma_unlock(true, saved);
+
+    if (!draining) {
+      i2c_dma_end_transaction(i2c_dma);
+    }
+  }
+}
+
+static void i2c0_dma_irq_handler(void) {
+  i2c_dma_irq_handler(&i2c_dma_list[0]);
+}
+
+static void i2c1_dma_irq_handler(void) {
+  i2c_dma_irq_handler(&i2c_dma_list[1]);
+}
+
+// The DMA IRQ of a bus is shared with the other I2C peripheral and the
+// application. The DMA channels of a bus only raise it while a transaction
+// has chunks left to send or pieces left to read. It's only enabled on the
+// core of the bus, see i2c_dma_get_dma_irq_index.
+static void i2c_dma_dma_irq_handler(i2c_dma_t *i2c_dma) {
+  const i2c_dma_os_lock_state_t saved = i2c_dma_lock(true);
+
+  i2c_dma_xfer_t *xfer = i2c_dma->active;
+  const bool continue_xfer = xfer != NULL && !i2c_dma->abort_detected;
+
+  const uint irq_index = i2c_dma->dma_irq_index;
+  const int tx_chan = i2c_dma->tx_chan;
+  if (tx_chan != -1 && dma_irqn_get_channel_status(irq_index, tx_chan)) {
+    dma_irqn_acknowledge_channel(irq_index, tx_chan);
+
+    if (continue_xfer && i2c_dma->cmds_sent < i2c_dma->cmds_len) {
+      i2c_dma_send_chunk(i2c_dma);
+
+      // The half that was just sent is free for the chunk after next.
+      if (i2c_dma->cmds_encoded < i2c_dma->cmds_len) {
+        i2c_dma_encode_chunk(i2c_dma, xfer, i2c_dma->chunk_next);
+      }
+    }
+  }
+
+  const bool drained = i2c_dma_continue_rx(i2c_dma, xfer);
+
+  i2c_dma_unlock(true, saved);
+
+  if (drained) {
+    i2c_dma_end_transaction(i2c_dma);
+  }
+}
+
+static void i2c0_dma_dma_irq_handler(void) {
+  i2c_dma_dma_irq_handler(&i2c_dma_list[0]);
+}
+
+static void i2c1_dma_dma_irq_handler(void) {
+  i2c_dma_dma_irq_handler(&i2c_dma_list[1]);
+}
+
+static void i2c_dma_pin_open_drain(uint gpio) {
+  gpio_set_function(gpio, GPIO_FUNC_SIO);
+  gpio_set_dir(gpio, GPIO_IN);
+  gpio_put(gpio, 0);
+}
+
+static void i2c_dma_pin_od_low(uint gpio) {
+  gpio_set_dir(gpio, GPIO_OUT);
+}
+
+static void i2c_dma_pin_od_high(uint gpio) {
+  gpio_set_dir(gpio, GPIO_IN);
+}
+
+static void i2c_dma_unblock(i2c_dma_t *i2c_dma) {
+  i2c_dma_pin_open_drain(i2c_dma->sda_gpio);
+  i2c_dma_pin_open_drain(i2c_dma->scl_gpio);
+
+  bool sda_high;
+  int max_tries = 9;
+
+  // Make sure the frequency of the bit-bannged I2C clock is at most 100KHz.
+  const uint32_t f_clk_sys_khz =
+    frequency_count_khz(CLOCKS_FC0_SRC_VALUE_CLK_SYS);
+  const uint32_t i2c_delay = f_clk_sys_khz / 100 / 2;
+
+  do {
+    i2c_dma_pin_od_low(i2c_dma->scl_gpio);
+    for (int i = i2c_delay; i > 0; i -= 1) {
+      __asm__("nop");
+    }
+
+    i2c_dma_pin_od_high(i2c_dma->scl_gpio);
+    for (int i = i2c_delay; i > 0; i -= 1) {
+      __asm__("nop");
+    }
+
+    max_tries -= 1;
+    sda_high = gpio_get(i2c_dma->sda_gpio);
+  } while (!sda_high && max_tries > 0);
+}
+
+static bool i2c_dma_is_blocked(i2c_dma_t *i2c_dma) {
+  i2c_dma_pin_open_drain(i2c_dma->sda_gpio);
+  i2c_dma_pin_open_drain(i2c_dma->scl_gpio);
+
+  const bool sda_high = gpio_get(i2c_dma->sda_gpio);
+  const bool scl_high = gpio_get(i2c_dma->scl_gpio);
+
+  return !sda_high || !scl_high;
+}
+
+static int i2c_dma_init_intern(i2c_dma_t *i2c_dma) {
+  // The interrupt stays enabled in the NVIC of the core it's routed to,
+  // which needn't be this core. Mask it in the peripheral instead.
+  if (i2c_dma->irqs_enabled) {
+    i2c_get_hw(i2c_dma->i2c)->intr_mask = 0;
+  }
+
+  i2c_dma->stop_detected = false;
+  i2c_dma->abort_detected = false;
+
+  // Don't do anything with i2c_dma->mutex here, let i2c_dma_recover_once
+  // take care of it. Also, directly after creation with
+  // i2c_dma_os_mutex_init a mutex can be successfully taken.
+
+  // Attempt to unblock a blocked bus. If it can't be unblocked, continue
+  // anyway.
+  if (i2c_dma_is_blocked(i2c_dma)) {
+    i2c_dma_unblock(i2c_dma);
+  }
+
+  i2c_init(i2c_dma->i2c, i2c_dma->baudrate);
+  i2c_dma->target_addr = -1;
+
+  gpio_set_function(i2c_dma->sda_gpio, GPIO_FUNC_I2C);
+  gpio_set_function(i2c_dma->scl_gpio, GPIO_FUNC_I2C);
+  gpio_pull_up(i2c_dma->sda_gpio);
+  gpio_pull_up(i2c_dma->scl_gpio);
+
+  i2c_get_hw(i2c_dma->i2c)->intr_mask =
+    I2C_IC_INTR_MASK_M_STOP_DET_BITS |
+    I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+
+  return PICO_OK;
+}
+
+static int i2c_dma_reinit(i2c_dma_t *i2c_dma) {
+  i2c_dma_stats_reinit(i2c_dma);
+  return i2c_dma_init_intern(i2c_dma);
+}
+
+// Gets the index of the DMA IRQ for the bus in *dma_irq_index. DMA IRQs are
+// level triggered. If a bus's DMA IRQ were enabled on a core that doesn't
+// run its handler, that core would be interrupted over and over until the
+// bus's core acknowledged it. So the other bus may only use the same DMA IRQ
+// if its interrupts are on the same core.
+static int i2c_dma_get_dma_irq_index(
+  const i2c_dma_t *i2c_dma,
+  const i2c_dma_options_t *options,
+  uint irq_core,
+  uint *dma_irq_index
+) {
+  const i2c_dma_dma_irq_t option =
+    options != NULL ? options->dma_irq : I2C_DMA_DMA_IRQ_DEFAULT;
+
+  switch (option) {
+    case I2C_DMA_DMA_IRQ_DEFAULT:
+      *dma_irq_index = irq_core;
+      break;
+    case I2C_DMA_DMA_IRQ_0:
+      *dma_irq_index = 0;
+      break;
+    case I2C_DMA_DMA_IRQ_1:
+      *dma_irq_index = 1;
+      break;
+    default:
+      return PICO_ERROR_INVALID_ARG;
+  }
+
+  const i2c_dma_t *other =
+    &i2c_dma_list[i2c_dma == &i2c_dma_list[0] ? 1 : 0];
+
+  return other->irqs_enabled &&
+    other->irq_core != irq_core &&
+    other->dma_irq_index == *dma_irq_index ?
+    PICO_ERROR_INVALID_ARG : PICO_OK;
+}
+
+static void i2c_dma_enable_irqs(i2c_dma_t *i2c_dma) {
+  irq_set_exclusive_handler(i2c_dma->irq_num, i2c_dma->irq_handler);
+  irq_set_enabled(i2c_dma->irq_num, true);
+
+  const uint dma_irq_num =
+    i2c_dma->dma_irq_index == 0 ? DMA_IRQ_0 : DMA_IRQ_1;
+
+  if (
+    i2c_dma->dma_irq_handler_added &&
+    i2c_dma->dma_irq_handler_num != dma_irq_num
+  ) {
+    irq_remove_handler(
+      i2c_dma->dma_irq_handler_num, i2c_dma->dma_irq_handler
+    );
+    i2c_dma->dma_irq_handler_added = false;
+  }
+  if (!i2c_dma->dma_irq_handler_added) {
+    irq_add_shared_handler(
+      dma_irq_num,
+      i2c_dma->dma_irq_handler,
+      PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY
+    );
+    i2c_dma->dma_irq_handler_num = dma_irq_num;
+    i2c_dma->dma_irq_handler_added = true;
+  }
+  irq_set_enabled(dma_irq_num, true);
+}
+
+// The DMA IRQ is left enabled as the other bus or the application may need
+// it on this core.
+static void i2c_dma_disable_irq(i2c_dma_t *i2c_dma) {
+  irq_set_enabled(i2c_dma->irq_num, false);
+}
+
+// Returns true if i2c_dma_run_on_core can run code on core for the caller.
+// With the FreeRTOS SMP port and core affinity, a task can be moved to any
+// core. Otherwise, only the calling core can be used.
+static bool i2c_dma_can_run_on_core(uint core) {
+  return i2c_dma_os_can_move_task() || core == get_core_num();
+}
+
+// Calls fn on core, see i2c_dma_can_run_on_core. The calling task is kept on
+// core for the duration of the call and then given back its affinity.
+static void i2c_dma_run_on_core(
+  uint core,
+  void (*fn)(i2c_dma_t *i2c_dma),
+  i2c_dma_t *i2c_dma
+) {
+  if (i2c_dma_os_can_move_task()) {
+    const i2c_dma_os_affinity_t affinity = i2c_dma_os_move_task(core);
+    fn(i2c_dma);
+    i2c_dma_os_restore_task(affinity);
+    return;
+  }
+
+  fn(i2c_dma);
+}
+
+static int i2c_dma_get_irq_core(
+  const i2c_dma_options_t *options,
+  uint *irq_core
+) {
+  const i2c_dma_irq_core_t option =
+    options != NULL ? options->irq_core : I2C_DMA_IRQ_CORE_CALLER;
+
+  switch (option) {
+    case I2C_DMA_IRQ_CORE_CALLER:
+      *irq_core = get_core_num();
+      break;
+    case I2C_DMA_IRQ_CORE_0:
+      *irq_core = 0;
+      break;
+    case I2C_DMA_IRQ_CORE_1:
+      *irq_core = 1;
+      break;
+    default:
+      return PICO_ERROR_INVALID_ARG;
+  }
+
+  return i2c_dma_can_run_on_core(*irq_core) ?
+    PICO_OK : PICO_ERROR_INVALID_ARG;
+}
+
+int i2c_dma_init(
+  i2c_dma_t **pi2c_dma,
+  i2c_inst_t *i2c,
+  uint baudrate,
+  uint sda_gpio,
+  uint scl_gpio
+) {
+  return i2c_dma_init_with_options(
+    pi2c_dma, i2c, baudrate, sda_gpio, scl_gpio, NULL
+  );
+}
+
+int i2c_dma_init_with_options(
+  i2c_dma_t **pi2c_dma,
+  i2c_inst_t *i2c,
+  uint baudrate,
+  uint sda_gpio,
+  uint scl_gpio,
+  const i2c_dma_options_t *options
+) {
+  uint irq_core;
+  const int irq_core_rc = i2c_dma_get_irq_core(options, &irq_core);
+  if (irq_core_rc != PICO_OK) {
+    return irq_core_rc;
+  }
+
+  i2c_dma_t *i2c_dma = &i2c_dma_list[i2c == i2c0 ? 0 : 1];
+
+  uint dma_irq_index;
+  const int dma_irq_rc =
+    i2c_dma_get_dma_irq_index(i2c_dma, options, irq_core, &dma_irq_index);
+  if (dma_irq_rc != PICO_OK) {
+    return dma_irq_rc;
+  }
+
+  if (i2c == i2c0) {
+    i2c_dma->i2c = i2c0;
+    i2c_dma->irq_num = I2C0_IRQ;
+    i2c_dma->irq_handler = i2c0_dma_irq_handler;
+    i2c_dma->dma_irq_handler = i2c0_dma_dma_irq_handler;
+  } else {
+    i2c_dma->i2c = i2c1;
+    i2c_dma->irq_num = I2C1_IRQ;
+    i2c_dma->irq_handler = i2c1_dma_irq_handler;
+    i2c_dma->dma_irq_handler = i2c1_dma_dma_irq_handler;
+  }
+
+  *pi2c_dma = i2c_dma;
+
+  i2c_dma->baudrate = baudrate;
+  i2c_dma->sda_gpio = sda_gpio;
+  i2c_dma->scl_gpio = scl_gpio;
+
+  i2c_dma->active = NULL;
+  i2c_dma->tx_chan = -1;
+  i2c_dma->rx_chan = -1;
+  i2c_dma->queue_head = NULL;
+  i2c_dma->reinit_required = false;
+
+  i2c_dma->transfer_timeout_ms = I2C_DMA_DEFAULT_TRANSFER_TIMEOUT_MS;
+  i2c_dma->mutex_timeout_ms = I2C_DMA_DEFAULT_MUTEX_TIMEOUT_MS;
+
+#ifdef I2C_DMA_STATS
+  memset(&i2c_dma->stats, 0, sizeof(i2c_dma->stats));
+#endif
+
+  const bool reserve_dma_channels =
+    options != NULL && options->reserve_dma_channels;
+
+  if (reserve_dma_channels && !i2c_dma->channels_reserved) {
+    const int rc = i2c_dma_reserve_channels(i2c_dma);
+    if (rc != PICO_OK) {
+      return rc;
+    }
+  } else if (!reserve_dma_channels && i2c_dma->channels_reserved) {
+    i2c_dma_unreserve_channels(i2c_dma);
+  }
+
+  if (!i2c_dma->os_initialized) {
+    if (i2c_dma_os_completion_init(&i2c_dma->completion) != PICO_OK) {
+      return PICO_ERROR_GENERIC;
+    }
+
+    if (i2c_dma_os_mutex_init(&i2c_dma->mutex) != PICO_OK) {
+      return PICO_ERROR_GENERIC;
+    }
+
+    i2c_dma->os_initialized = true;
+  }
+
+  const int rc = i2c_dma_init_intern(i2c_dma);
+  if (rc != PICO_OK) {
+    return rc;
+  }
+
+  if (i2c_dma->irqs_enabled && i2c_dma->irq_core != irq_core) {
+    i2c_dma_run_on_core(i2c_dma->irq_core, i2c_dma_disable_irq, i2c_dma);
+  }
+  i2c_dma->irq_core = irq_core;
+  i2c_dma->dma_irq_index = dma_irq_index;
+  i2c_dma_run_on_core(irq_core, i2c_dma_enable_irqs, i2c_dma);
+  i2c_dma->irqs_enabled = true;
+
+  return PICO_OK;
+}
+
+int i2c_dma_set_transfer_timeout(i2c_dma_t *i2c_dma, uint32_t timeout_ms) {
+  if (timeout_ms == I2C_DMA_TIMEOUT_DEFAULT) {
+    return PICO_ERROR_INVALID_ARG;
+  }
+
+  i2c_dma->transfer_timeout_ms = timeout_ms;
+
+  return PICO_OK;
+}
+
+uint32_t i2c_dma_get_transfer_timeout(const i2c_dma_t *i2c_dma) {
+  return i2c_dma->transfer_timeout_ms;
+}
+
+int i2c_dma_set_mutex_timeout(i2c_dma_t *i2c_dma, uint32_t timeout_ms) {
+  i2c_dma->mutex_timeout_ms = timeout_ms;
+
+  return PICO_OK;
+}
+
+uint32_t i2c_dma_get_mutex_timeout(const i2c_dma_t *i2c_dma) {
+  return i2c_dma->mutex_timeout_ms;
+}
+
+int i2c_dma_get_stats(i2c_dma_t *i2c_dma, i2c_dma_stats_t *stats, bool reset) {
+#ifdef I2C_DMA_STATS
+  const i2c_dma_os_lock_state_t saved = i2c_dma_lock(false);
+  if (stats != NULL) {
+    *stats = i2c_dma->stats;
+  }
+  if (reset) {
+    memset(&i2c_dma->stats, 0, sizeof(i2c_dma->stats));
+  }
+  i2c_dma_unlock(false, saved);
+
+  return PICO_OK;
+#else
+  (void) i2c_dma;
+  (void) reset;
+
+  if (stats != NULL) {
+    memset(stats, 0, sizeof(*stats));
+  }
+
+  return PICO_ERROR_GENERIC;
+#endif
+}
+
+void i2c_dma_trace_freeze(bool freeze) {
+#ifdef I2C_DMA_TRACE
+  i2c_dma_trace.frozen = freeze;
+#else
+  (void) freeze;
+#endif
+}
+
+#ifdef I2C_DMA_TRACE
+// Copies entry i of the trace to copy and returns true if it has been
+// completely written. Entries that are still being written are skipped.
+static bool i2c_dma_trace_copy(uint32_t i, i2c_dma_trace_entry_t *copy) {
+  const i2c_dma_trace_entry_t *entry =
+    &i2c_dma_trace.entries[i & (I2C_DMA_TRACE_ENTRIES - 1)];
+
+  if (__atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE) != i) {
+    return false;
+  }
+
+  *copy = *entry;
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+  return __atomic_load_n(&entry->seq, __ATOMIC_RELAXED) == i;
+}
+#endif
+
+int i2c_dma_trace_dump(i2c_dma_trace_write_t write, void *arg) {
+#ifdef I2C_DMA_TRACE
+  // The trace is frozen while it's dumped, so no slot is reserved again and
+  // an entry that has been completely written stays that way. Entries whose
+  // slots were reserved before that may still be being written, they're
+  // left out. valid remembers which entries are dumped so that the count in
+  // the header matches.
+  const i2c_dma_os_lock_state_t saved = i2c_dma_lock(false);
+  const bool frozen = i2c_dma_trace.frozen;
+  i2c_dma_trace.frozen = true;
+  const uint32_t seq = i2c_dma_trace.seq;
+  const uint32_t dropped = i2c_dma_trace.dropped;
+  i2c_dma_unlock(false, saved);
+
+  const uint32_t window =
+    seq < I2C_DMA_TRACE_ENTRIES ? seq : I2C_DMA_TRACE_ENTRIES;
+  uint32_t valid[(I2C_DMA_TRACE_ENTRIES + 31) / 32] = {0};
+  uint32_t count = 0;
+  i2c_dma_trace_entry_t copy;
+
+  for (uint32_t n = 0; n != window; ++n) {
+    if (i2c_dma_trace_copy(seq - window + n, &copy)) {
+      valid[n / 32] |= 1u << (n % 32);
+      count += 1;
+    }
+  }
+
+  const i2c_dma_trace_header_t header = {
+    .magic = {'I', '2', 'C', 'T'},
+    .version = I2C_DMA_TRACE_VERSION,
+    .entry_size = sizeof(i2c_dma_trace_entry_t),
+    .count = count,
+    .dropped = dropped,
+  };
+  write(&header, sizeof(header), arg);
+
+  // Oldest first.
+  for (uint32_t n = 0; n != window; ++n) {
+    if (valid[n / 32] & (1u << (n % 32))) {
+      i2c_dma_trace_copy(seq - window + n, &copy);
+      write(&copy, sizeof(copy), arg);
+    }
+  }
+
+  i2c_dma_trace.frozen = frozen;
+
+  return PICO_OK;
+#else
+  (void) write;
+  (void) arg;
+
+  return PICO_ERROR_GENERIC;
+#endif
+}
+
+// Reinitializes the I2C peripheral after a timeout and starts the queued
+// transfers. The mutex must be held.
+static void i2c_dma_recover(i2c_dma_t *i2c_dma) {
+  i2c_dma_reinit(i2c_dma);
+  i2c_dma->reinit_required = false;
+  i2c_dma_start_queued(i2c_dma, false);
+}
+
+// Recovers from a timeout unless another task already has. Called from
+// tasks, several of which may find that a reinit is required at the same
+// time.
+static void i2c_dma_recover_once(i2c_dma_t *i2c_dma) {
+  if (!i2c_dma_os_mutex_take(&i2c_dma->mutex, i2c_dma->mutex_timeout_ms)) {
+    return;
+  }
+
+  if (i2c_dma->reinit_required) {
+    i2c_dma_recover(i2c_dma);
+  }
+
+  i2c_dma_os_mutex_give(&i2c_dma->mutex);
+}
+
+// Completes active, the transfer that was timed, with PICO_ERROR_TIMEOUT. It
+// may have completed in the meantime, in which case nothing is done. No
+// further transfers are started until the I2C peripheral has been
+// reinitialized.
+static void i2c_dma_time_out(
+  i2c_dma_t *i2c_dma, i2c_dma_xfer_t *active, bool from_isr
+) {
+  const i2c_dma_os_lock_state_t saved = i2c_dma_lock(from_isr);
+  const bool timed_out = i2c_dma->active == active;
+  if (timed_out) {
+    i2c_dma->active = NULL;
+    i2c_dma->reinit_required = true;
+  }
+  i2c_dma_unlock(from_isr, saved);
+
+  if (timed_out) {
+    i2c_dma_release_channels(i2c_dma, true);
+    i2c_dma_finish(active, PICO_ERROR_TIMEOUT, from_isr);
+  }
+}
+
+// Waits until xfer is complete.
+//
+// Under normal circumstances, a transfer is complete when a stop is detected
+// on the bus. If the hardware detects problems during the transfer, there
+// will normally be an abort followed by a stop. Scenarios where a stop and/or
+// abort are not detected are also possible, for these scenarios a timeout is
+// needed. As an example, no stop will be detected if SDA gets stuck low.
+//
+// Any number of tasks may wait for their own transfers at the same time.
+// xfer may be queued behind other transfers, the one on the bus is the one
+// that's timed, by every task waiting. While xfer hasn't been started, its
+// deadline is also checked.
+static void i2c_dma_wait_intern(i2c_dma_t *i2c_dma, i2c_dma_xfer_t *xfer) {
+  void *const waiter = i2c_dma_os_completion_begin_wait(&i2c_dma->completion);
+
+  // The lock orders setting the waiter with respect to i2c_dma_finish, so
+  // xfer is either seen to be done below or the waiter is signalled.
+  i2c_dma_os_lock_state_t saved = i2c_dma_lock(false);
+  xfer->waiter = waiter;
+  i2c_dma_unlock(false, saved);
+
+  while (!xfer->done) {
+    if (i2c_dma->reinit_required) {
+      i2c_dma_recover_once(i2c_dma);
+      continue;
+    }
+
+    // The interrupt handler may replace the active transfer at any time.
+    const i2c_dma_os_ticks_t now = i2c_dma_os_ticks(false);
+    saved = i2c_dma_lock(false);
+    i2c_dma_xfer_t *active = i2c_dma->active;
+    const i2c_dma_os_ticks_t start_tick = i2c_dma->start_tick;
+    const i2c_dma_os_ticks_t timeout = i2c_dma->timeout_ticks;
+    const bool expired = i2c_dma_expired(xfer, now) &&
+      i2c_dma_queue_remove(i2c_dma, xfer);
+    const bool waiting = xfer != active && xfer->resume_piece == 0;
+    i2c_dma_unlock(false, saved);
+
+    if (expired) {
+      i2c_dma_finish(xfer, PICO_ERROR_TIMEOUT, false);
+      break;
+    }
+
+    if (active == NULL) {
+      i2c_dma_start_queued(i2c_dma, false);
+      continue;
+    }
+
+    const i2c_dma_os_ticks_t elapsed = now - start_tick;
+
+    if (elapsed < timeout) {
+      i2c_dma_os_ticks_t ticks = timeout - elapsed;
+
+      // Wake up in time to give up on the bus if the deadline passes first.
+      if (waiting && xfer->deadline_ticks != 0) {
+        const i2c_dma_os_ticks_t left =
+          xfer->deadline_ticks - (now - xfer->submit_tick);
+        if (left < ticks) {
+          ticks = left;
+        }
+      }
+
+      i2c_dma_os_completion_wait(&i2c_dma->completion, ticks);
+      continue;
+    }
+
+    i2c_dma_time_out(i2c_dma, active, false);
+  }
+
+  i2c_dma_os_completion_end_wait(&i2c_dma->completion);
+}
+
+// Returns the priority of xfer on the bus, see i2c_dma_xfer_t.priority. An
+// interrupt handler has no task priority, 0 is used instead.
+static uint8_t i2c_dma_priority(const i2c_dma_xfer_t *xfer, bool from_isr) {
+  if (xfer->priority != I2C_DMA_PRIORITY_TASK || from_isr) {
+    return xfer->priority;
+  }
+
+  const uint prio = i2c_dma_os_task_priority();
+  return prio < UINT8_MAX ? prio : UINT8_MAX;
+}
+
+// Returns the number of ticks xfer may wait for the bus, 0 if there's no
+// limit. One tick is added as the tick count may advance right after the
+// transfer was submitted.
+static i2c_dma_os_ticks_t i2c_dma_deadline_ticks(
+  i2c_dma_t *i2c_dma, const i2c_dma_xfer_t *xfer
+) {
+  const uint32_t deadline_ms = xfer->deadline_ms != I2C_DMA_TIMEOUT_DEFAULT ?
+    xfer->deadline_ms : i2c_dma->mutex_timeout_ms;
+
+  if (deadline_ms == I2C_DMA_DEADLINE_NONE) {
+    return 0;
+  }
+
+  const i2c_dma_os_ticks_t ticks = i2c_dma_os_ms_to_ticks(deadline_ms);
+  return ticks < (i2c_dma_os_ticks_t) -1 ? ticks + 1 : ticks;
+}
+
+// Starts xfer straight away if the bus is idle, otherwise queues it. xfer
+// must already be valid.
+static int i2c_dma_enqueue(
+  i2c_dma_t *i2c_dma, i2c_dma_xfer_t *xfer, bool from_isr
+) {
+  xfer->i2c_dma = i2c_dma;
+  xfer->rc = PICO_OK;
+  xfer->done = false;
+  xfer->next = NULL;
+  xfer->waiter = NULL;
+  xfer->submit_us = i2c_dma_now_us();
+  xfer->start_us = 0;
+  xfer->abort_source = 0;
+  xfer->submit_tick = i2c_dma_os_ticks(from_isr);
+  xfer->deadline_ticks = i2c_dma_deadline_ticks(i2c_dma, xfer);
+  xfer->resume_piece = 0;
+  xfer->prio = i2c_dma_priority(xfer, from_isr);
+  xfer->bypassed = 0;
+
+  const i2c_dma_os_lock_state_t saved = i2c_dma_lock(from_isr);
+  const bool start = i2c_dma->active == NULL &&
+    i2c_dma->queue_head == NULL &&
+    !i2c_dma->reinit_required;
+  if (start) {
+    i2c_dma_activate(i2c_dma, xfer, xfer->submit_tick);
+  } else {
+    i2c_dma_queue_insert(i2c_dma, xfer);
+  }
+  i2c_dma_unlock(from_isr, saved);
+
+  if (!start) {
+    return PICO_OK;
+  }
+
+  xfer->start_us = xfer->submit_us;
+
+  // If the DMA channels can't be claimed, xfer completes as it would from
+  // the queue. The error is returned all the same so that the caller knows
+  // it's already complete. If another context got to xfer first, for example
+  // to time it out, it has completed it.
+  if (i2c_dma_arm(i2c_dma, xfer) != PICO_OK) {
+    i2c_dma_stats_claim_failed(i2c_dma, from_isr);
+    if (i2c_dma_take_active(i2c_dma, xfer, from_isr) != xfer) {
+      return PICO_OK;
+    }
+    i2c_dma_finish(xfer, PICO_ERROR_GENERIC, from_isr);
+    i2c_dma_start_queued(i2c_dma, from_isr);
+    return PICO_ERROR_GENERIC;
+  }
+
+  i2c_dma_stats_started(i2c_dma, xfer, from_isr);
+
+  return PICO_OK;
+}
+
+// Returns the number of bytes in the segments of iov, or SIZE_MAX if a
+// segment is invalid.
+static size_t i2c_dma_iovec_len(const i2c_dma_iovec_t *iov, size_t iovcnt) {
+  size_t len = 0;
+
+  for (size_t i = 0; i != iovcnt; ++i) {
+    if (iov[i].len > 0 && iov[i].buf == NULL) {
+      return SIZE_MAX;
+    }
+    len += iov[i].len;
+  }
+
+  return len;
+}
+
+// Returns the number of bytes written and read by the nmsgs messages in
+// msgs, or SIZE_MAX if a message is invalid. rlen is set to the number of
+// bytes read.
+static size_t i2c_dma_msgs_len(
+  const i2c_dma_msg_t *msgs, size_t nmsgs, size_t *rlen
+) {
+  size_t len = 0;
+
+  *rlen = 0;
+
+  if (nmsgs == 0) {
+    return SIZE_MAX;
+  }
+
+  for (size_t i = 0; i != nmsgs; ++i) {
+    const i2c_dma_msg_t *msg = &msgs[i];
+
+    if (
+      msg->buf == NULL ||
+      msg->len == 0 ||
+      (msg->flags &
+        ~(I2C_DMA_M_RD | I2C_DMA_M_NOSTART | I2C_DMA_M_STOP)) != 0
+    ) {
+      return SIZE_MAX;
+    }
+
+    // A message can only be continued by one for the same device in the
+    // same direction, and not after a stop.
+    if (
+      (msg->flags & I2C_DMA_M_NOSTART) != 0 && (
+        i == 0 ||
+        msg->addr != msgs[i - 1].addr ||
+        (msg->flags & I2C_DMA_M_RD) != (msgs[i - 1].flags & I2C_DMA_M_RD) ||
+        (msgs[i - 1].flags & I2C_DMA_M_STOP) != 0
+      )
+    ) {
+      return SIZE_MAX;
+    }
+
+    if ((msg->flags & I2C_DMA_M_RD) != 0) {
+      *rlen += msg->len;
+    }
+    len += msg->len;
+  }
+
+  return len;
+}
+
+// Returns the number of bytes written by the nwrites writes in writes, or
+// SIZE_MAX if a write is invalid.
+static size_t i2c_dma_writes_len(
+  const i2c_dma_write_t *writes, size_t nwrites
+) {
+  size_t len = 0;
+
+  if (nwrites == 0) {
+    return SIZE_MAX;
+  }
+
+  for (size_t i = 0; i != nwrites; ++i) {
+    if (writes[i].buf == NULL || writes[i].len == 0) {
+      return SIZE_MAX;
+    }
+    len += writes[i].len;
+  }
+
+  return len;
+}
+
+static int i2c_dma_submit_intern(i2c_dma_t *i2c_dma, i2c_dma_xfer_t *xfer) {
+  if (xfer == NULL || (xfer->i2c_dma != NULL && !xfer->done)) {
+    return PICO_ERROR_INVALID_ARG;
+  }
+
+  if (xfer->msgs != NULL) {
+    xfer->len = i2c_dma_msgs_len(xfer->msgs, xfer->nmsgs, &xfer->rlen);
+    if (xfer->len == SIZE_MAX) {
+      return PICO_ERROR_INVALID_ARG;
+    }
+  } else if (xfer->writes != NULL) {
+    xfer->len = i2c_dma_writes_len(xfer->writes, xfer->nwrites);
+    if (xfer->len == SIZE_MAX) {
+      return PICO_ERROR_INVALID_ARG;
+    }
+    xfer->rlen = 0;
+  } else {
+    size_t wlen;
+    if (xfer->wiov != NULL) {
+      wlen = i2c_dma_iovec_len(xfer->wiov, xfer->wiovcnt);
+    } else {
+      xfer->wbuf_iov.buf = xfer->wbuf;
+      xfer->wbuf_iov.len = xfer->wbuf_len;
+      wlen = i2c_dma_iovec_len(&xfer->wbuf_iov, 1);
+    }
+
+    if (
+      wlen == SIZE_MAX ||
+      (xfer->rbuf_len > 0 && xfer->rbuf == NULL) ||
+      (wlen == 0 && xfer->rbuf_len == 0)
+    ) {
+      return PICO_ERROR_INVALID_ARG;
+    }
+
+    xfer->len = wlen + xfer->rbuf_len;
+    xfer->rlen = xfer->rbuf_len;
+  }
+
+  xfer->prepared = NULL;
+
+  return i2c_dma_enqueue(i2c_dma, xfer, false);
+}
+
+int i2c_dma_submit(i2c_dma_t *i2c_dma, i2c_dma_xfer_t *xfer) {
+  const int rc = i2c_dma_submit_intern(i2c_dma, xfer);
+
+  // After a timeout, xfer has been queued but nothing is started until the
+  // I2C peripheral has been reinitialized. Don't leave that to a task that
+  // may never call i2c_dma_wait.
+  if (rc == PICO_OK && i2c_dma->reinit_required) {
+    i2c_dma_recover_once(i2c_dma);
+  }
+
+  return rc;
+}
+
+int i2c_dma_wait(i2c_dma_xfer_t *xfer) {
+  if (xfer == NULL || xfer->i2c_dma == NULL) {
+    return PICO_ERROR_INVALID_ARG;
+  }
+
+  if (!xfer->done) {
+    i2c_dma_wait_intern(xfer->i2c_dma, xfer);
+  }
+
+  return xfer->rc;
+}
+
+void i2c_dma_notify_task(i2c_dma_xfer_t *xfer, void *task, bool from_isr) {
+  (void) xfer;
+  i2c_dma_os_notify_task(task, from_isr);
+}
+
+// Submits xfer and waits for it to complete. xfer is on the caller's stack,
+// so it must be complete before returning, i2c_dma_wait_intern makes sure
+// of that.
+static int i2c_dma_transfer_sync(i2c_dma_t *i2c_dma, i2c_dma_xfer_t *xfer) {
+  const int rc = i2c_dma_submit_intern(i2c_dma, xfer);
+  if (rc != PICO_OK) {
+    return rc;
+  }
+
+  i2c_dma_wait_intern(i2c_dma, xfer);
+
+  return xfer->rc;
+}
+
+int i2c_dma_write_read(
+  i2c_dma_t *i2c_dma,
+  uint8_t addr,
+  const uint8_t *wbuf,
+  size_t wbuf_len,
+  uint8_t *rbuf,
+  size_t rbuf_len
+) {
+  i2c_dma_xfer_t xfer = {
+    .addr = addr,
+    .wbuf = wbuf,
+    .wbuf_len = wbuf_len,
+    .rbuf = rbuf,
+    .rbuf_len = rbuf_len,
+  };
+
+  return i2c_dma_transfer_sync(i2c_dma, &xfer);
+}
+
+int i2c_dma_write_readv(
+  i2c_dma_t *i2c_dma,
+  uint8_t addr,
+  const i2c_dma_iovec_t *wiov,
+  size_t wiovcnt,
+  uint8_t *rbuf,
+  size_t rbuf_len
+) {
+  if (wiov == NULL && wiovcnt > 0) {
+    return PICO_ERROR_INVALID_ARG;
+  }
+
+  i2c_dma_xfer_t xfer = {
+    .addr = addr,
+    .wiov = wiov,
+    .wiovcnt = wiovcnt,
+    .rbuf = rbuf,
+    .rbuf_len = rbuf_len,
+  };
+
+  return i2c_dma_transfer_sync(i2c_dma, &xfer);
+}
+
+int i2c_dma_transfer(i2c_dma_t *i2c_dma, i2c_dma_msg_t *msgs, size_t nmsgs) {
+  if (msgs == NULL) {
+    return PICO_ERROR_INVALID_ARG;
+  }
+
+  i2c_dma_xfer_t xfer = {
+    .msgs = msgs,
+    .nmsgs = nmsgs,
+  };
+
+  return i2c_dma_transfer_sync(i2c_dma, &xfer);
+}
+
+int i2c_dma_write_batch(
+  i2c_dma_t *i2c_dma, const i2c_dma_write_t *writes, size_t nwrites
+) {
+  if (writes == NULL) {
+    return PICO_ERROR_INVALID_ARG;
+  }
+
+  i2c_dma_xfer_t xfer = {
+    .writes = writes,
+    .nwrites = nwrites,
+  };
+
+  return i2c_dma_transfer_sync(i2c_dma, &xfer);
+}
+
+int i2c_dma_prepare(
+  i2c_dma_t *i2c_dma,
+  i2c_dma_prepared_t *prepared,
+  uint16_t *data_cmds,
+  uint8_t addr,
+  const uint8_t *wbuf,
+  size_t wbuf_len,
+  size_t rbuf_len
+) {
+  if (
+    i2c_dma == NULL ||
+    prepared == NULL ||
+    data_cmds == NULL ||
+    (wbuf_len > 0 && wbuf == NULL) ||
+    (wbuf_len == 0 && rbuf_len == 0)
+  ) {
+    return PICO_ERROR_INVALID_ARG;
+  }
+
+  const i2c_dma_xfer_t xfer = {
+    .wbuf_iov = {wbuf, wbuf_len},
+    .rbuf_len = rbuf_len,
+  };
+  i2c_dma_cursor_t cursor = {0, 0, false};
+  i2c_dma_encode(data_cmds, &xfer, &cursor, wbuf_len + rbuf_len, true);
+
+  prepared->i2c_dma = i2c_dma;
+  prepared->addr = addr;
+  prepared->data_cmds = data_cmds;
+  prepared->data_cmds_len = wbuf_len + rbuf_len;
+  prepared->rbuf_len = rbuf_len;
+
+  return PICO_OK;
+}
+
+int i2c_dma_execute(const i2c_dma_prepared_t *prepared, uint8_t *rbuf) {
+  if (prepared->rbuf_len > 0 && rbuf == NULL) {
+    return PICO_ERROR_INVALID_ARG;
+  }
+
+  i2c_dma_t *i2c_dma = prepared->i2c_dma;
+
+  i2c_dma_xfer_t xfer = {
+    .addr = prepared->addr,
+    .rbuf = rbuf,
+    .rbuf_len = prepared->rbuf_len,
+    .len = prepared->data_cmds_len,
+    .rlen = prepared->rbuf_len,
+    .prepared = prepared,
+  };
+
+  // As for i2c_dma_transfer_sync, xfer is on the stack.
+  const int rc = i2c_dma_enqueue(i2c_dma, &xfer, false);
+  if (rc != PICO_OK) {
+    return rc;
+  }
+
+  i2c_dma_wait_intern(i2c_dma, &xfer);
+
+  return xfer.rc;
+}
+
+// Completion callback of the transactions of a periodic job. A successful
+// transaction has read into the half of job->buf after the latest sample,
+// bumping the sequence number publishes it.
+static void i2c_dma_periodic_done(
+  i2c_dma_xfer_t *xfer, void *arg, bool from_isr
+) {
+  i2c_dma_periodic_t *job = arg;
+
+  if (xfer->rc == PICO_OK) {
+    // 0 means there's no sample yet. Skipping it keeps the parity of the
+    // sequence number, which selects the half of buf.
+    const uint32_t seq = job->seq + 1;
+    job->seq = seq != 0 ? seq : 2;
+  } else {
+    job->errors += 1;
+    job->last_rc = xfer->rc;
+  }
+
+  job->busy = false;
+
+  if (xfer->rc == PICO_OK && job->callback != NULL) {
+    job->callback(job, job->callback_arg, from_isr);
+  }
+}
+
+// Alarm handler of a periodic job. Starts the next transaction unless the
+// last one is still in progress. In that case the transfer on the bus is
+// checked for a timeout, there may be no task waiting to do that.
+static bool i2c_dma_periodic_alarm(repeating_timer_t *timer) {
+  i2c_dma_periodic_t *job = timer->user_data;
+  i2c_dma_t *i2c_dma = job->prepared->i2c_dma;
+
+  if (!job->running) {
+    return false;
+  }
+
+  if (job->busy) {
+    job->overruns += 1;
+
+    const i2c_dma_os_ticks_t now = i2c_dma_os_ticks(true);
+    const i2c_dma_os_lock_state_t saved = i2c_dma_lock(true);
+    i2c_dma_xfer_t *active = i2c_dma->active;
+    const i2c_dma_os_ticks_t start_tick = i2c_dma->start_tick;
+    const i2c_dma_os_ticks_t timeout = i2c_dma->timeout_ticks;
+    i2c_dma_unlock(true, saved);
+
+    if (active != NULL && now - start_tick >= timeout) {
+      i2c_dma_time_out(i2c_dma, active, true);
+    }
+
+    return true;
+  }
+
+  // The other half of buf holds the latest sample.
+  job->xfer.rbuf = job->buf + (job->seq & 1) * job->prepared->rbuf_len;
+  job->busy = true;
+
+  // A failure to start is recorded by i2c_dma_periodic_done.
+  i2c_dma_enqueue(i2c_dma, &job->xfer, true);
+
+  return true;
+}
+
+int i2c_dma_periodic_start(i2c_dma_periodic_t *job) {
+  if (
+    job == NULL ||
+    job->prepared == NULL ||
+    job->prepared->rbuf_len == 0 ||
+    job->buf == NULL ||
+    job->period_us == 0 ||
+    job->running ||
+    job->busy
+  ) {
+    return PICO_ERROR_INVALID_ARG;
+  }
+
+  const i2c_dma_prepared_t *prepared = job->prepared;
+
+  job->xfer = (i2c_dma_xfer_t) {
+    .addr = prepared->addr,
+    .rbuf = job->buf,
+    .rbuf_len = prepared->rbuf_len,
+    .callback = i2c_dma_periodic_done,
+    .callback_arg = job,
+    .priority = job->priority,
+    .deadline_ms = (job->period_us + 999) / 1000,
+    .len = prepared->data_cmds_len,
+    .rlen = prepared->rbuf_len,
+    .prepared = prepared,
+  };
+
+  // The alarm handler has no task priority, so it's resolved here.
+  job->xfer.priority = i2c_dma_priority(&job->xfer, false);
+
+  job->seq = 0;
+  job->errors = 0;
+  job->overruns = 0;
+  job->last_rc = PICO_OK;
+  job->busy = false;
+  job->running = true;
+
+  // A negative delay times the period from the start of one call of the
+  // handler to the start of the next.
+  if (
+    !add_repeating_timer_us(
+      -(int64_t) job->period_us, i2c_dma_periodic_alarm, job, &job->timer
+    )
+  ) {
+    job->running = false;
+    return PICO_ERROR_GENERIC;
+  }
+
+  return PICO_OK;
+}
+
+int i2c_dma_periodic_stop(i2c_dma_periodic_t *job) {
+  // After a timeout, the job is stopped but may still be busy.
+  if (job == NULL || (!job->running && !job->busy)) {
+    return PICO_ERROR_INVALID_ARG;
+  }
+
+  job->running = false;
+  cancel_repeating_timer(&job->timer);
+
+  // The alarm handler may have started a transaction on the other core
+  // while the alarm was being cancelled. busy is cleared by the completion
+  // callback after the transaction is done, or is set by the alarm handler
+  // before the transaction is submitted. The callback may run in a task
+  // with a lower priority than the caller, so the caller sleeps a tick at a
+  // time rather than spinning while busy is set and there's no transaction
+  // to wait for.
+  i2c_dma_os_completion_t *completion = &job->prepared->i2c_dma->completion;
+  const i2c_dma_os_ticks_t timeout =
+    i2c_dma_os_ms_to_ticks(I2C_PERIODIC_STOP_TIMEOUT_MS);
+  i2c_dma_os_ticks_t start = i2c_dma_os_ticks(false);
+
+  while (job->busy) {
+    if (!job->xfer.done) {
+      i2c_dma_wait(&job->xfer);
+      start = i2c_dma_os_ticks(false);
+      continue;
+    }
+
+    if (i2c_dma_os_ticks(false) - start >= timeout) {
+      return PICO_ERROR_TIMEOUT;
+    }
+
+    i2c_dma_os_completion_begin_wait(completion);
+    i2c_dma_os_completion_wait(completion, 1);
+    i2c_dma_os_completion_end_wait(completion);
+  }
+
+  return PICO_OK;
+}
+
+uint32_t i2c_dma_periodic_read(i2c_dma_periodic_t *job, uint8_t *sample) {
+  if (job == NULL || job->prepared == NULL) {
+    return 0;
+  }
+
+  i2c_dma_t *i2c_dma = job->prepared->i2c_dma;
+
+  // Nothing is started after a timeout until the I2C peripheral has been
+  // reinitialized, the alarm handler can't do that.
+  if (i2c_dma->reinit_required) {
+    i2c_dma_recover_once(i2c_dma);
+  }
+
+  // The half of buf holding the latest sample isn't written to until a new
+  // sample has been published, so the copy is only retried if that happened
+  // while copying.
+  const size_t len = job->prepared->rbuf_len;
+  uint32_t seq;
+
+  do {
+    seq = job->seq;
+    if (seq == 0) {
+      return 0;
+    }
+    if (sample != NULL) {
+      memcpy(sample, job->buf + ((seq - 1) & 1) * len, len);
+    }
+  } while (job->seq != seq);
+
+  return seq;
+}
+
+// Returns the register cache entry for reg or NULL if reg isn't cached.
+static i2c_dma_reg_t *i2c_dma_regcache_find(
+  i2c_dma_regcache_t *cache, uint8_t reg
+) {
+  for (size_t i = 0; i != cache->nregs; ++i) {
+    if (cache->regs[i].reg == reg) {
+      return &cache->regs[i];
+    }
+  }
+
+  return NULL;
+}
+
+// Returns true if the cached value of entry can be used at time now_us.
+static bool i2c_dma_regcache_fresh(
+  const i2c_dma_reg_t *entry, uint64_t now_us
+) {
+  switch (entry->policy) {
+    case I2C_DMA_REG_CACHED:
+      return entry->valid;
+    case I2C_DMA_REG_TTL:
+      return entry->valid &&
+        now_us - entry->update_us < (uint64_t) entry->ttl_ms * 1000;
+    default:
+      return false;
+  }
+}
+
+int i2c_dma_regcache_init(
+  i2c_dma_regcache_t *cache,
+  i2c_dma_t *i2c_dma,
+  uint8_t addr,
+  i2c_dma_reg_t *regs,
+  size_t nregs
+) {
+  if (cache == NULL || i2c_dma == NULL || (regs == NULL && nregs > 0)) {
+    return PICO_ERROR_INVALID_ARG;
+  }
+
+  for (size_t i = 0; i != nregs; ++i) {
+    i2c_dma_reg_t *entry = &regs[i];
+
+    if (
+      entry->policy > I2C_DMA_REG_TTL ||
+      (entry->policy != I2C_DMA_REG_VOLATILE &&
+        (entry->len == 0 || entry->value == NULL))
+    ) {
+      return PICO_ERROR_INVALID_ARG;
+    }
+
+    for (size_t j = 0; j != i; ++j) {
+      if (regs[j].reg == entry->reg) {
+        return PICO_ERROR_INVALID_ARG;
+      }
+    }
+
+    entry->update_us = 0;
+    entry->hits = 0;
+    entry->misses = 0;
+    entry->valid = false;
+  }
+
+  cache->i2c_dma = i2c_dma;
+  cache->addr = addr;
+  cache->regs = regs;
+  cache->nregs = nregs;
+  cache->hits = 0;
+  cache->misses = 0;
+  cache->uncached = 0;
+  cache->seq = 0;
+
+  return PICO_OK;
+}
+
+// Values are copied in and out of the cache with the lock held so a task
+// never sees a value that's half updated by another. The transactions are
+// performed without it. cache->seq is incremented under the lock when a write
+// starts and when it ends, a read only caches its value if seq didn't change
+// while it was on the bus, otherwise the value may predate the write.
+int i2c_dma_regcache_read(
+  i2c_dma_regcache_t *cache, uint8_t reg, uint8_t *rbuf, size_t len
+) {
+  if (cache == NULL || rbuf == NULL || len == 0) {
+    return PICO_ERROR_INVALID_ARG;
+  }
+
+  i2c_dma_reg_t *entry = i2c_dma_regcache_find(cache, reg);
+
+  i2c_dma_os_lock_state_t saved = i2c_dma_lock(false);
+  const uint32_t seq = cache->seq;
+  if (entry == NULL) {
+    cache->uncached += 1;
+  } else if (
+    len <= entry->len && i2c_dma_regcache_fresh(entry, time_us_64())
+  ) {
+    memcpy(rbuf, entry->value, len);
+    entry->hits += 1;
+    cache->hits += 1;
+    i2c_dma_unlock(false, saved);
+    return PICO_OK;
+  } else {
+    entry->misses += 1;
+    cache->misses += 1;
+  }
+  i2c_dma_unlock(false, saved);
+
+  const int rc = i2c_dma_write_read(
+    cache->i2c_dma, cache->addr, &reg, 1, rbuf, len
+  );
+
+  if (
+    rc == PICO_OK &&
+    entry != NULL &&
+    entry->policy != I2C_DMA_REG_VOLATILE &&
+    len == entry->len
+  ) {
+    saved = i2c_dma_lock(false);
+    if (cache->seq == seq) {
+      memcpy(entry->value, rbuf, len);
+      entry->update_us = time_us_64();
+      entry->valid = true;
+    }
+    i2c_dma_unlock(false, saved);
+  }
+
+  return rc;
+}
+
+// The device increments its register pointer after each byte, so a write of
+// len bytes to reg changes every register in [reg, reg + len). Cached values
+// that lie entirely within the bytes written are updated, the others that
+// overlap them are invalidated as only part of them was written. Nothing is
+// updated if the write failed or if another write started while it was on
+// the bus, as it's not known which of them the device saw last.
+int i2c_dma_regcache_write(
+  i2c_dma_regcache_t *cache, uint8_t reg, const uint8_t *wbuf, size_t len
+) {
+  if (cache == NULL || wbuf == NULL || len == 0) {
+    return PICO_ERROR_INVALID_ARG;
+  }
+
+  i2c_dma_os_lock_state_t saved = i2c_dma_lock(false);
+  const uint32_t seq = ++cache->seq;
+  i2c_dma_unlock(false, saved);
+
+  // The register byte and the value go out as one block.
+  const i2c_dma_iovec_t wiov[2] = {{&reg, 1}, {wbuf, len}};
+  const int rc = i2c_dma_write_readv(
+    cache->i2c_dma, cache->addr, wiov, 2, NULL, 0
+  );
+
+  saved = i2c_dma_lock(false);
+  const bool update = rc == PICO_OK && cache->seq == seq;
+  cache->seq += 1;
+  for (size_t i = 0; i != cache->nregs; ++i) {
+    i2c_dma_reg_t *entry = &cache->regs[i];
+    const size_t start = entry->reg;
+    const size_t end = start + entry->len;
+
+    if (
+      entry->policy == I2C_DMA_REG_VOLATILE ||
+      end <= reg || start >= reg + len
+    ) {
+      continue;
+    }
+
+    if (update && start >= reg && end <= reg + len) {
+      memcpy(entry->value, wbuf + (start - reg), entry->len);
+      entry->update_us = time_us_64();
+      entry->valid = true;
+    } else {
+      entry->valid = false;
+    }
+  }
+  i2c_dma_unlock(false, saved);
+
+  return rc;
+}
+
+void i2c_dma_regcache_invalidate(i2c_dma_regcache_t *cache) {
+  const i2c_dma_os_lock_state_t saved = i2c_dma_lock(false);
+  for (size_t i = 0; i != cache->nregs; ++i) {
+    cache->regs[i].valid = false;
+  }
+  i2c_dma_unlock(false, saved);
+}
@@ -0,0 +1,430 @@
+#ifndef _I2C_DMA_OS_H
+#define _I2C_DMA_OS_H
+
+// The operating system services used by i2c_dma.c. By default they're
+// provided by FreeRTOS. If I2C_DMA_BARE_METAL is defined they're provided by
+// pico_sync and pico_time for programs without an RTOS, see the
+// i2c_dma_bare_metal library in CMakeLists.txt.
+//
+// lock:       Protects state shared by tasks and interrupt handlers,
+//             possibly on different cores. Not recursive.
+// completion: Wakes the tasks waiting for transfers on a bus, with a
+//             timeout in ticks. Any number of tasks may wait at the same
+//             time. begin_wait returns the waiter that's passed to signal
+//             when the transfer waited for completes. wait returns when
+//             signalled or after at most the given number of ticks.
+//             Between begin_wait and end_wait, signals are latched, so none
+//             are lost. Spurious and early wakeups are possible.
+// mutex:      Serializes recovering a bus after a timeout, taken with a
+//             timeout in milliseconds.
+// ticks:      Time base of transfer timeouts and deadlines.
+//
+// Each backend defines the same types and functions.
+
+#include "pico.h"
+
+#ifdef I2C_DMA_BARE_METAL
+
+#include "hardware/sync.h"
+#include "pico/sync.h"
+#include "pico/time.h"
+
+// A bare-metal program has no other use for the spin lock reserved for an
+// RTOS.
+#ifndef I2C_DMA_SPINLOCK_ID
+#define I2C_DMA_SPINLOCK_ID PICO_SPINLOCK_ID_OS1
+#endif
+
+typedef uint32_t i2c_dma_os_lock_state_t;
+typedef uint8_t i2c_dma_os_completion_t; // Unused, cores wait for events
+typedef mutex_t i2c_dma_os_mutex_t;
+typedef uint32_t i2c_dma_os_ticks_t; // Milliseconds since boot
+typedef uint32_t i2c_dma_os_affinity_t;
+
+// Disables interrupts on this core and spins until the other core releases
+// the lock, so the same lock works for code and interrupt handlers on both
+// cores.
+static inline i2c_dma_os_lock_state_t i2c_dma_os_lock(bool from_isr) {
+  (void) from_isr;
+  return spin_lock_blocking(spin_lock_instance(I2C_DMA_SPINLOCK_ID));
+}
+
+static inline void i2c_dma_os_unlock(
+  bool from_isr,
+  i2c_dma_os_lock_state_t state
+) {
+  (void) from_isr;
+  spin_unlock(spin_lock_instance(I2C_DMA_SPINLOCK_ID), state);
+}
+
+static inline i2c_dma_os_ticks_t i2c_dma_os_ms_to_ticks(uint64_t ms) {
+  return ms < UINT32_MAX ? (i2c_dma_os_ticks_t) ms : UINT32_MAX;
+}
+
+static inline i2c_dma_os_ticks_t i2c_dma_os_ticks(bool from_isr) {
+  (void) from_isr;
+  return to_ms_since_boot(get_absolute_time());
+}
+
+// There are no task priorities.
+static inline uint i2c_dma_os_task_priority(void) {
+  return 0;
+}
+
+static inline int i2c_dma_os_completion_init(
+  i2c_dma_os_completion_t *completion
+) {
+  (void) completion;
+  return PICO_OK;
+}
+
+static inline void *i2c_dma_os_completion_begin_wait(
+  i2c_dma_os_completion_t *completion
+) {
+  (void) completion;
+  return NULL;
+}
+
+// Waits with __wfe, so the core sleeps until an event or the timeout. Every
+// completion is signalled with __sev, which wakes both cores, so the waiter
+// isn't needed.
+static inline void i2c_dma_os_completion_wait(
+  i2c_dma_os_completion_t *completion,
+  i2c_dma_os_ticks_t ticks
+) {
+  (void) completion;
+  best_effort_wfe_or_timeout(make_timeout_time_ms(ticks));
+}
+
+static inline void i2c_dma_os_completion_end_wait(
+  i2c_dma_os_completion_t *completion
+) {
+  (void) completion;
+}
+
+static inline void i2c_dma_os_completion_signal(
+  i2c_dma_os_completion_t *completion,
+  void *waiter,
+  bool from_isr
+) {
+  (void) completion;
+  (void) waiter;
+  (void) from_isr;
+  __sev();
+}
+
+static inline int i2c_dma_os_mutex_init(i2c_dma_os_mutex_t *mutex) {
+  mutex_init(mutex);
+  return PICO_OK;
+}
+
+static inline bool i2c_dma_os_mutex_take(
+  i2c_dma_os_mutex_t *mutex,
+  uint32_t timeout_ms
+) {
+  return mutex_enter_timeout_ms(mutex, timeout_ms);
+}
+
+static inline bool i2c_dma_os_mutex_give(i2c_dma_os_mutex_t *mutex) {
+  mutex_exit(mutex);
+  return true;
+}
+
+// There are no tasks. The task argument of i2c_dma_notify_task is ignored
+// and the cores are woken from __wfe instead.
+static inline void i2c_dma_os_notify_task(void *task, bool from_isr) {
+  (void) task;
+  (void) from_isr;
+  __sev();
+}
+
+// Code can't be moved between cores.
+static inline bool i2c_dma_os_can_move_task(void) {
+  return false;
+}
+
+static inline i2c_dma_os_affinity_t i2c_dma_os_move_task(uint core) {
+  (void) core;
+  return 0;
+}
+
+static inline void i2c_dma_os_restore_task(i2c_dma_os_affinity_t affinity) {
+  (void) affinity;
+}
+
+#else
+
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
+
+// By default, completions are signalled with direct to task notifications,
+// which are faster than semaphores, using notification index
+// I2C_DMA_NOTIFY_INDEX of the waiting task. Index 0 is left to the
+// application, see i2c_dma_notify_task, so
+// configTASK_NOTIFICATION_ARRAY_ENTRIES must be greater than
+// I2C_DMA_NOTIFY_INDEX. Otherwise, or if I2C_DMA_TASK_NOTIFY is defined as
+// 0, a counting semaphore is used instead. It's given once for every
+// waiting task, up to I2C_DMA_MAX_WAITERS, each time a transfer completes.
+#ifndef I2C_DMA_NOTIFY_INDEX
+#define I2C_DMA_NOTIFY_INDEX 1
+#endif
+
+#ifndef I2C_DMA_TASK_NOTIFY
+#if configUSE_TASK_NOTIFICATIONS == 1 && \
+  configTASK_NOTIFICATION_ARRAY_ENTRIES > I2C_DMA_NOTIFY_INDEX
+#define I2C_DMA_TASK_NOTIFY 1
+#else
+#define I2C_DMA_TASK_NOTIFY 0
+#endif
+#endif
+
+#ifndef I2C_DMA_MAX_WAITERS
+#define I2C_DMA_MAX_WAITERS 8
+#endif
+
+typedef UBaseType_t i2c_dma_os_lock_state_t;
+#if I2C_DMA_TASK_NOTIFY
+typedef uint8_t i2c_dma_os_completion_t; // Unused, tasks are notified
+#else
+typedef struct {
+  SemaphoreHandle_t semaphore;
+  volatile UBaseType_t waiters; // Number of waiting tasks
+} i2c_dma_os_completion_t;
+#endif
+typedef SemaphoreHandle_t i2c_dma_os_mutex_t;
+typedef TickType_t i2c_dma_os_ticks_t;
+typedef UBaseType_t i2c_dma_os_affinity_t;
+
+// With the SMP port, tasks can be moved between cores if core affinity is
+// enabled.
+#if defined(configNUMBER_OF_CORES) && configNUMBER_OF_CORES > 1 && \
+  configUSE_CORE_AFFINITY == 1
+#define I2C_DMA_OS_CORE_AFFINITY 1
+#else
+#define I2C_DMA_OS_CORE_AFFINITY 0
+#endif
+
+static inline i2c_dma_os_lock_state_t i2c_dma_os_lock(bool from_isr) {
+  if (from_isr) {
+    return taskENTER_CRITICAL_FROM_ISR();
+  }
+
+  taskENTER_CRITICAL();
+  return 0;
+}
+
+static inline void i2c_dma_os_unlock(
+  bool from_isr,
+  i2c_dma_os_lock_state_t state
+) {
+  if (from_isr) {
+    taskEXIT_CRITICAL_FROM_ISR(state);
+  } else {
+    taskEXIT_CRITICAL();
+  }
+}
+
+static inline i2c_dma_os_ticks_t i2c_dma_os_ms_to_ticks(uint64_t ms) {
+  return pdMS_TO_TICKS(ms);
+}
+
+static inline i2c_dma_os_ticks_t i2c_dma_os_ticks(bool from_isr) {
+  return from_isr ? xTaskGetTickCountFromISR() : xTaskGetTickCount();
+}
+
+// Returns the priority of the calling task, 0 before the scheduler starts.
+static inline uint i2c_dma_os_task_priority(void) {
+  if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING) {
+    return 0;
+  }
+
+  return uxTaskPriorityGet(NULL);
+}
+
+#if I2C_DMA_TASK_NOTIFY
+
+static inline int i2c_dma_os_completion_init(
+  i2c_dma_os_completion_t *completion
+) {
+  (void) completion;
+  return PICO_OK;
+}
+
+// A pending notification left over from an earlier wait only causes a
+// spurious wakeup, so it's left alone.
+static inline void *i2c_dma_os_completion_begin_wait(
+  i2c_dma_os_completion_t *completion
+) {
+  (void) completion;
+  return xTaskGetCurrentTaskHandle();
+}
+
+static inline void i2c_dma_os_completion_wait(
+  i2c_dma_os_completion_t *completion,
+  i2c_dma_os_ticks_t ticks
+) {
+  (void) completion;
+  ulTaskNotifyTakeIndexed(I2C_DMA_NOTIFY_INDEX, pdTRUE, ticks);
+}
+
+static inline void i2c_dma_os_completion_end_wait(
+  i2c_dma_os_completion_t *completion
+) {
+  (void) completion;
+}
+
+static inline void i2c_dma_os_completion_signal(
+  i2c_dma_os_completion_t *completion,
+  void *waiter,
+  bool from_isr
+) {
+  (void) completion;
+
+  if (waiter == NULL) {
+    return;
+  }
+
+  if (from_isr) {
+    BaseType_t task_switch_required = pdFALSE;
+    vTaskNotifyGiveIndexedFromISR(
+      (TaskHandle_t) waiter, I2C_DMA_NOTIFY_INDEX, &task_switch_required
+    );
+    portYIELD_FROM_ISR(task_switch_required);
+  } else {
+    xTaskNotifyGiveIndexed((TaskHandle_t) waiter, I2C_DMA_NOTIFY_INDEX);
+  }
+}
+
+#else
+
+static inline int i2c_dma_os_completion_init(
+  i2c_dma_os_completion_t *completion
+) {
+  completion->waiters = 0;
+  completion->semaphore = xSemaphoreCreateCounting(I2C_DMA_MAX_WAITERS, 0);
+  return completion->semaphore != NULL ? PICO_OK : PICO_ERROR_GENERIC;
+}
+
+static inline void *i2c_dma_os_completion_begin_wait(
+  i2c_dma_os_completion_t *completion
+) {
+  taskENTER_CRITICAL();
+  completion->waiters += 1;
+  taskEXIT_CRITICAL();
+  return NULL;
+}
+
+// A task that's woken and goes back to waiting before the others have run
+// may take the tokens meant for them. While there's more than one waiting
+// task they poll every tick, so a lost token costs at most a tick.
+static inline void i2c_dma_os_completion_wait(
+  i2c_dma_os_completion_t *completion,
+  i2c_dma_os_ticks_t ticks
+) {
+  if (completion->waiters > 1 && ticks > 1) {
+    ticks = 1;
+  }
+
+  xSemaphoreTake(completion->semaphore, ticks);
+}
+
+static inline void i2c_dma_os_completion_end_wait(
+  i2c_dma_os_completion_t *completion
+) {
+  taskENTER_CRITICAL();
+  completion->waiters -= 1;
+  taskEXIT_CRITICAL();
+}
+
+// If giving the semaphore fails with errQUEUE_FULL the error isn't handled
+// here. There isn't much that can be done, the tasks that miss out wake up
+// when their wait times out.
+static inline void i2c_dma_os_completion_signal(
+  i2c_dma_os_completion_t *completion,
+  void *waiter,
+  bool from_isr
+) {
+  (void) waiter;
+
+  const UBaseType_t waiters = completion->waiters;
+
+  if (from_isr) {
+    BaseType_t task_switch_required = pdFALSE;
+    for (UBaseType_t i = 0; i != waiters; ++i) {
+      xSemaphoreGiveFromISR(completion->semaphore, &task_switch_required);
+    }
+    portYIELD_FROM_ISR(task_switch_required);
+  } else {
+    for (UBaseType_t i = 0; i != waiters; ++i) {
+      xSemaphoreGive(completion->semaphore);
+    }
+  }
+}
+
+#endif
+
+static inline int i2c_dma_os_mutex_init(i2c_dma_os_mutex_t *mutex) {
+  *mutex = xSemaphoreCreateMutex();
+  return *mutex != NULL ? PICO_OK : PICO_ERROR_GENERIC;
+}
+
+static inline bool i2c_dma_os_mutex_take(
+  i2c_dma_os_mutex_t *mutex,
+  uint32_t timeout_ms
+) {
+  return xSemaphoreTake(*mutex, pdMS_TO_TICKS(timeout_ms)) == pdTRUE;
+}
+
+static inline bool i2c_dma_os_mutex_give(i2c_dma_os_mutex_t *mutex) {
+  return xSemaphoreGive(*mutex) == pdTRUE;
+}
+
+static inline void i2c_dma_os_notify_task(void *task, bool from_isr) {
+  if (from_isr) {
+    BaseType_t task_switch_required = pdFALSE;
+    vTaskNotifyGiveFromISR((TaskHandle_t) task, &task_switch_required);
+    portYIELD_FROM_ISR(task_switch_required);
+  } else {
+    xTaskNotifyGive((TaskHandle_t) task);
+  }
+}
+
+// Returns true if the calling task can be moved to another core.
+static inline bool i2c_dma_os_can_move_task(void) {
+#if I2C_DMA_OS_CORE_AFFINITY
+  return xTaskGetSchedulerState() == taskSCHEDULER_RUNNING;
+#else
+  return false;
+#endif
+}
+
+// Moves the calling task to core and keeps it there until
+// i2c_dma_os_restore_task is called with the returned affinity.
+static inline i2c_dma_os_affinity_t i2c_dma_os_move_task(uint core) {
+#if I2C_DMA_OS_CORE_AFFINITY
+  const UBaseType_t affinity = vTaskCoreAffinityGet(NULL);
+
+  vTaskCoreAffinitySet(NULL, 1u << core);
+  while (get_core_num() != core) {
+    taskYIELD();
+  }
+
+  return affinity;
+#else
+  (void) core;
+  return 0;
+#endif
+}
+
+static inline void i2c_dma_os_restore_task(i2c_dma_os_affinity_t affinity) {
+#if I2C_DMA_OS_CORE_AFFINITY
+  vTaskCoreAffinitySet(NULL, affinity);
+#else
+  (void) affinity;
+#endif
+}
+
+#endif
+
+#endif
@@ -2,6 +2,7 @@
 #define _I2C_DMA_H
 
 #include "hardware/i2c.h"
+#include "pico/time.h"
 
 // Explanation of symbols used in function documentation below.
 // --------------+------------------------------------------------------------
@@ -18,6 +19,13 @@
 //               | host adapter.
 // --------------+------------------------------------------------------------
 
+// By default the i2c_dma_* functions require FreeRTOS. If I2C_DMA_BARE_METAL
+// is defined, for example by linking the i2c_dma_bare_metal library rather
+// than i2c_dma, they can be used without an RTOS. Their behavior and return
+// codes are the same. Functions that wait put the core to sleep with __wfe
+// until an interrupt handler wakes it, and all timeouts are measured in
+// milliseconds rather than in ticks.
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -33,13 +41,17 @@ typedef struct i2c_dma_s i2c_dma_t;
 // *pi2c_dma. This i2c_dma_t pointer is the pointer passed as the first
 // parameter to all other i2c_dma_* functions.
 //
+// An I2C peripheral can be initialized again, for example to change its
+// baudrate. The bus must be idle when it is: no transaction in progress or
+// queued and no periodic job running. Those are dropped without completing
+// and their tasks are never woken.
+//
 // Returns
 //   PICO_OK
 //     Function completed successfully
 //   PICO_ERROR_GENERIC
 //     Error creating semaphore
 //     Error creating mutex
-//     Error attempting to take a semaphore
 int i2c_dma_init(
   i2c_dma_t **pi2c_dma, // A pointer to an i2c_dma_t pointer
   i2c_inst_t *i2c,      // Either i2c0 or i2c1
@@ -48,6 +60,242 @@ int i2c_dma_init(
   uint scl_gpio         // GPIO number for SCL
 );
 
+// Cores for i2c_dma_options_t.irq_core.
+typedef enum {
+  I2C_DMA_IRQ_CORE_CALLER = 0, // The core calling i2c_dma_init_with_options
+  I2C_DMA_IRQ_CORE_0,          // Core 0
+  I2C_DMA_IRQ_CORE_1,          // Core 1
+} i2c_dma_irq_core_t;
+
+// DMA IRQs for i2c_dma_options_t.dma_irq.
+typedef enum {
+  I2C_DMA_DMA_IRQ_DEFAULT = 0, // DMA_IRQ_0 on core 0, DMA_IRQ_1 on core 1
+  I2C_DMA_DMA_IRQ_0,           // DMA_IRQ_0
+  I2C_DMA_DMA_IRQ_1,           // DMA_IRQ_1
+} i2c_dma_dma_irq_t;
+
+// Options for i2c_dma_init_with_options. Zero initialize and set the fields
+// of interest, a zero initialized i2c_dma_options_t gives the same behavior
+// as i2c_dma_init.
+typedef struct {
+  // If true, a TX and an RX DMA channel are claimed when the I2C peripheral
+  // is initialized and kept until it's initialized again without this
+  // option. Their DMA configuration is set up once, so starting a
+  // transaction only needs a buffer address, a count and a trigger, and
+  // transactions can't fail because other code holds all DMA channels. If
+  // false, DMA channels are claimed at the start of each transaction and
+  // unclaimed at the end.
+  bool reserve_dma_channels;
+
+  // The core that runs the interrupt handlers of the bus. With the FreeRTOS
+  // SMP port and configUSE_CORE_AFFINITY, the calling task is moved to that
+  // core while its interrupts are enabled, so any core can be chosen once
+  // the scheduler is running. Otherwise, only the calling core can be
+  // chosen. Tasks using the bus are best given the same core with
+  // vTaskCoreAffinitySet, so that transfers are started and completed on
+  // one core and two busy buses don't compete for the same core.
+  i2c_dma_irq_core_t irq_core;
+
+  // The DMA IRQ raised by the DMA channels of the bus. A shared handler is
+  // added to it and it's enabled on the core chosen with irq_core. DMA IRQs
+  // are level triggered, so buses with their interrupts on different cores
+  // can't use the same DMA IRQ and the application must not enable the DMA
+  // IRQ of a bus on the other core. The default follows the Pico SDK
+  // convention of DMA_IRQ_0 for core 0 and DMA_IRQ_1 for core 1. Choose the
+  // other DMA IRQ if the application installs an exclusive handler for it.
+  i2c_dma_dma_irq_t dma_irq;
+} i2c_dma_options_t;
+
+// Same as i2c_dma_init but with options. options may be NULL, in which case
+// it's the same as i2c_dma_init. If the peripheral was already initialized
+// with reserve_dma_channels set, the DMA channels reserved then are reused.
+//
+// Returns
+//   PICO_OK
+//     Function completed successfully
+//   PICO_ERROR_INVALID_ARG
+//     irq_core is invalid or can't be chosen by the caller
+//     dma_irq is invalid or used by the other bus on another core
+//   PICO_ERROR_GENERIC
+//     Error creating semaphore
+//     Error creating mutex
+//     Error attempting to claim a DMA channel
+int i2c_dma_init_with_options(
+  i2c_dma_t **pi2c_dma,             // A pointer to an i2c_dma_t pointer
+  i2c_inst_t *i2c,                  // Either i2c0 or i2c1
+  uint baudrate,                    // Baudrate in hertz
+  uint sda_gpio,                    // GPIO number for SDA
+  uint scl_gpio,                    // GPIO number for SCL
+  const i2c_dma_options_t *options  // Options or NULL
+);
+
+// Timeout values for i2c_dma_set_transfer_timeout and
+// i2c_dma_xfer_t.timeout_ms.
+#define I2C_DMA_TIMEOUT_DEFAULT 0          // Use the timeout of the bus
+#define I2C_DMA_TIMEOUT_AUTO    UINT32_MAX // Derive from length and baudrate
+
+// Value for i2c_dma_set_mutex_timeout and i2c_dma_xfer_t.deadline_ms.
+#define I2C_DMA_DEADLINE_NONE   UINT32_MAX // Wait for the bus indefinitely
+
+// Value for i2c_dma_xfer_t.priority.
+#define I2C_DMA_PRIORITY_TASK   0 // The priority of the submitting task
+
+// Default timeouts set by i2c_dma_init and i2c_dma_init_with_options.
+#define I2C_DMA_DEFAULT_TRANSFER_TIMEOUT_MS 1000
+#define I2C_DMA_DEFAULT_MUTEX_TIMEOUT_MS    10000
+
+// Sets the time a transaction on the bus may take before it times out. If
+// timeout_ms is a number of milliseconds, a transaction may take that long
+// for every 1056 bytes it writes and reads. If timeout_ms is
+// I2C_DMA_TIMEOUT_AUTO, the timeout is derived from the number of bytes
+// written and read, the baudrate, and a margin of 2ms, so a stuck bus is
+// detected within milliseconds rather than seconds. Devices that stretch
+// the clock for longer than the margin need a fixed timeout. The timeout
+// can also be set for a single transaction with i2c_dma_xfer_t.timeout_ms.
+//
+// Returns
+//   PICO_OK
+//     Function completed successfully
+//   PICO_ERROR_INVALID_ARG
+//     Invalid argument passed to function
+int i2c_dma_set_transfer_timeout(
+  i2c_dma_t *i2c_dma, // i2c_dma_t pointer for I2C0 or I2C1
+  uint32_t timeout_ms // Timeout in ms or I2C_DMA_TIMEOUT_AUTO
+);
+
+// Returns the timeout set with i2c_dma_set_transfer_timeout.
+uint32_t i2c_dma_get_transfer_timeout(
+  const i2c_dma_t *i2c_dma // i2c_dma_t pointer for I2C0 or I2C1
+);
+
+// Sets the time the i2c_dma_* functions wait for other transactions using
+// the bus before they give up with PICO_ERROR_TIMEOUT. It's the default for
+// i2c_dma_xfer_t.deadline_ms, so it also applies to transactions started
+// with i2c_dma_submit. If timeout_ms is I2C_DMA_DEADLINE_NONE, they wait for
+// as long as it takes. Recovering the bus after a timeout is also given up
+// on after this time.
+//
+// Returns
+//   PICO_OK
+//     Function completed successfully
+int i2c_dma_set_mutex_timeout(
+  i2c_dma_t *i2c_dma, // i2c_dma_t pointer for I2C0 or I2C1
+  uint32_t timeout_ms // Timeout in ms
+);
+
+// Returns the timeout set with i2c_dma_set_mutex_timeout.
+uint32_t i2c_dma_get_mutex_timeout(
+  const i2c_dma_t *i2c_dma // i2c_dma_t pointer for I2C0 or I2C1
+);
+
+// Number of buckets in an i2c_dma_histogram_t.
+#define I2C_DMA_STATS_BUCKETS 24
+
+// A histogram of durations in microseconds on a log2 scale. Bucket 0 counts
+// durations of 0us, bucket n counts durations of at least 2^(n-1)us and
+// less than 2^n us. The last bucket also counts all longer durations.
+typedef struct {
+  uint32_t count;                          // Number of durations
+  uint32_t max_us;                         // Longest duration
+  uint64_t total_us;                       // Sum of all durations
+  uint32_t buckets[I2C_DMA_STATS_BUCKETS]; // Number of durations per bucket
+} i2c_dma_histogram_t;
+
+// Statistics for an I2C bus. They're only collected if the i2c_dma library
+// is compiled with I2C_DMA_STATS defined, for example with
+// target_compile_definitions(app PRIVATE I2C_DMA_STATS=1). Times are taken
+// from the microsecond timer.
+typedef struct {
+  uint32_t transactions;       // Transactions completed, successful or not
+  uint32_t bytes_written;      // Bytes written by successful transactions
+  uint32_t bytes_read;         // Bytes read by successful transactions
+  uint32_t aborts;             // Transactions aborted by the I2C peripheral
+  uint32_t timeouts;           // Transactions that timed out
+  uint32_t reinits;            // Reinitializations of the I2C peripheral
+  uint32_t dma_claim_failures; // Failed attempts to claim a DMA channel
+  uint32_t deadline_misses;    // Transactions that didn't get the bus in time
+  i2c_dma_histogram_t queue_wait; // Time from submit to start on the bus
+  i2c_dma_histogram_t wire;       // Time from start on the bus to completion
+  i2c_dma_histogram_t latency;    // Time from submit to completion
+} i2c_dma_stats_t;
+
+// Copies the statistics for an I2C bus to *stats and, if reset is true,
+// resets them to zero. stats may be NULL to only reset them. The statistics
+// are also reset by i2c_dma_init and i2c_dma_init_with_options.
+//
+// Returns
+//   PICO_OK
+//     Function completed successfully
+//   PICO_ERROR_GENERIC
+//     Statistics not compiled in, *stats is set to zero
+int i2c_dma_get_stats(
+  i2c_dma_t *i2c_dma,     // i2c_dma_t pointer for I2C0 or I2C1
+  i2c_dma_stats_t *stats, // Where to copy the statistics to or NULL
+  bool reset              // Reset the statistics to zero
+);
+
+// Number of entries in the trace, must be a power of two.
+#ifndef I2C_DMA_TRACE_ENTRIES
+#define I2C_DMA_TRACE_ENTRIES 256
+#endif
+
+#define I2C_DMA_TRACE_VERSION 1
+
+// A transaction in the trace. If the i2c_dma library is compiled with
+// I2C_DMA_TRACE defined, the last I2C_DMA_TRACE_ENTRIES transactions
+// completed on either bus are kept in a ring buffer. Times are the low 32
+// bits of the microsecond timer.
+typedef struct {
+  uint32_t seq;          // Sequence number, counts up from 0
+  uint32_t start_us;     // Time the transaction was started on the bus
+  uint32_t stop_us;      // Time the transaction was completed
+  uint32_t wlen;         // Number of bytes to write
+  uint32_t rlen;         // Number of bytes to read
+  uint32_t abort_source; // IC_TX_ABRT_SOURCE if aborted, otherwise 0
+  uint8_t bus;           // 0 for I2C0, 1 for I2C1
+  uint8_t addr;          // 7 bit I2C address of the first message
+  int8_t rc;             // Result, PICO_OK or a PICO_ERROR_* code
+  uint8_t nbytes;        // Number of bytes in bytes
+  uint8_t bytes[4];      // First bytes written, typically a register
+} i2c_dma_trace_entry_t;
+
+// Header of a trace dump. A dump is the header followed by count entries,
+// oldest first, in the byte order of the RP2040, little endian.
+// tools/i2c_dma_trace.py decodes dumps.
+typedef struct {
+  char magic[4];       // "I2CT"
+  uint16_t version;    // I2C_DMA_TRACE_VERSION
+  uint16_t entry_size; // sizeof(i2c_dma_trace_entry_t)
+  uint32_t count;      // Number of entries that follow
+  uint32_t dropped;    // Transactions not traced while frozen
+} i2c_dma_trace_header_t;
+
+// Function called by i2c_dma_trace_dump to output len bytes at data.
+typedef void (*i2c_dma_trace_write_t)(const void *data, size_t len, void *arg);
+
+// Stops or restarts adding transactions to the trace. Freeze the trace
+// when a problem is detected so that the transactions leading up to it
+// are kept, and before dumping it.
+void i2c_dma_trace_freeze(
+  bool freeze // true to freeze, false to unfreeze
+);
+
+// Dumps the trace by calling write one or more times. The trace is frozen
+// while it's dumped, transactions completed in the meantime are counted as
+// dropped. Transactions whose entries were still being written when the dump
+// started are left out. Freeze the trace with i2c_dma_trace_freeze first to
+// keep the transactions leading up to a problem.
+//
+// Returns
+//   PICO_OK
+//     Function completed successfully
+//   PICO_ERROR_GENERIC
+//     Trace not compiled in, write isn't called
+int i2c_dma_trace_dump(
+  i2c_dma_trace_write_t write, // Function to output the dump
+  void *arg                    // Third argument passed to write
+);
+
 // Writes a block of bytes and/or reads a block of bytes in a single I2C
 // transaction.
 //
@@ -63,19 +311,24 @@ int i2c_dma_init(
 // S addr Wr [A] wbuf(0) [A] wbuf(1) [A] ... [A] wbuf(wbuf_len-1) [A]
 //   Sr addr Rd [A] [rbuf(0)] A [rbuf(1)] A ... A [rbuf(rbuf_len-1)] NA P
 //
+// There is no limit on wbuf_len and rbuf_len. The transaction is encoded for
+// the I2C peripheral a few bytes at a time while it's on the bus, so the
+// memory used doesn't depend on its length. By default, a transaction may
+// take up to 1000ms for every 1056 bytes before it times out, see
+// i2c_dma_set_transfer_timeout.
+//
 // Returns
 //   PICO_OK
 //     Function completed successfully
 //   PICO_ERROR_INVALID_ARG
 //     Invalid argument passed to function
 //   PICO_ERROR_TIMEOUT
-//     Timeout waiting to take a mutex
+//     Timeout waiting for the bus
 //     Timeout waiting for I2C transaction to complete
 //   PICO_ERROR_IO
 //     I2C transaction aborted by I2C peripheral
 //     No stop condition for transaction detected by I2C peripheral
 //   PICO_ERROR_GENERIC
-//     Error attempting to give a mutex
 //     Error attemptimg to claim a DMA channel
 int i2c_dma_write_read(
   i2c_dma_t *i2c_dma,  // i2c_dma_t pointer for I2C0 or I2C1
@@ -86,6 +339,462 @@ int i2c_dma_write_read(
   size_t rbuf_len      // Number of bytes of data to read or 0
 );
 
+// A segment of a block of bytes to write. A block of bytes can be made up of
+// several segments that aren't contiguous in memory, for example a header
+// and a frame buffer.
+typedef struct {
+  const uint8_t *buf; // Pointer to the bytes in the segment or NULL
+  size_t len;         // Number of bytes in the segment or 0
+} i2c_dma_iovec_t;
+
+// Same as i2c_dma_write_read except that the block of bytes to write is
+// made up of the wiovcnt segments in wiov. The segments are sent one after
+// the other in the same transaction without first being copied into one
+// buffer.
+//
+// I2C Transaction, where wbuf is wiov[0], wiov[1], ... wiov[wiovcnt-1]:
+// S addr Wr [A] wbuf(0) [A] wbuf(1) [A] ... [A] wbuf(wbuf_len-1) [A]
+//   Sr addr Rd [A] [rbuf(0)] A [rbuf(1)] A ... A [rbuf(rbuf_len-1)] NA P
+//
+// Returns
+//   PICO_OK
+//     Function completed successfully
+//   PICO_ERROR_INVALID_ARG
+//     Invalid argument passed to function
+//   PICO_ERROR_TIMEOUT
+//     Timeout waiting for the bus
+//     Timeout waiting for I2C transaction to complete
+//   PICO_ERROR_IO
+//     I2C transaction aborted by I2C peripheral
+//     No stop condition for transaction detected by I2C peripheral
+//   PICO_ERROR_GENERIC
+//     Error attemptimg to claim a DMA channel
+int i2c_dma_write_readv(
+  i2c_dma_t *i2c_dma,          // i2c_dma_t pointer for I2C0 or I2C1
+  uint8_t addr,                // 7 bit I2C address
+  const i2c_dma_iovec_t *wiov, // Segments of bytes to write or NULL
+  size_t wiovcnt,              // Number of segments in wiov or 0
+  uint8_t *rbuf,               // Block of bytes for data read or NULL
+  size_t rbuf_len              // Number of bytes of data to read or 0
+);
+
+// Flags for i2c_dma_msg_t.
+#define I2C_DMA_M_RD      0x0001 // Read from the device rather than write
+#define I2C_DMA_M_NOSTART 0x4000 // Continue the previous message, no restart
+#define I2C_DMA_M_STOP    0x8000 // End with a stop, other transactions may run
+
+// A message is a block of bytes to write to or read from a device. A
+// sequence of messages is executed by i2c_dma_transfer.
+typedef struct {
+  uint8_t addr;   // 7 bit I2C address
+  uint16_t flags; // I2C_DMA_M_* flags or 0
+  uint8_t *buf;   // Block of bytes to write or for data read
+  size_t len;     // Number of bytes to write or read
+} i2c_dma_msg_t;
+
+// Executes the nmsgs messages in msgs as a combined transaction and waits
+// for it to complete. Each message is preceded by a repeated start unless
+// it has the I2C_DMA_M_NOSTART flag, in which case it continues the
+// previous message, which must be for the same address and in the same
+// direction. The transaction ends with a stop after the last message and
+// after each message with the I2C_DMA_M_STOP flag.
+//
+// I2C Transaction, for example, for a write message followed by a read
+// message to the same address:
+// S addr Wr [A] msgs[0].buf(0) [A] ... [A] msgs[0].buf(len-1) [A]
+//   Sr addr Rd [A] [msgs[1].buf(0)] A ... A [msgs[1].buf(len-1)] NA P
+//
+// The RP2040 I2C peripheral can only address one device per transaction.
+// Consecutive messages for the same address are sent as one transaction.
+// When the address changes, the transaction ends with a stop and a new one
+// is started directly from the I2C interrupt handler. The task is only
+// woken once, when all messages have been executed or one of them fails.
+// No other transaction gets onto the bus in between, except after a message
+// with the I2C_DMA_M_STOP flag. That's a safe point at which a transaction
+// with a higher priority that's waiting for the bus is started first, see
+// i2c_dma_submit. Splitting a long write into messages with I2C_DMA_M_STOP,
+// for example one per display page, limits how long a transaction with a
+// higher priority waits behind it to the time of one message.
+//
+// Returns
+//   PICO_OK
+//     Function completed successfully
+//   PICO_ERROR_INVALID_ARG
+//     Invalid argument passed to function
+//   PICO_ERROR_TIMEOUT
+//     Timeout waiting for the bus
+//     Timeout waiting for I2C transaction to complete
+//   PICO_ERROR_IO
+//     I2C transaction aborted by I2C peripheral
+//     No stop condition for transaction detected by I2C peripheral
+//   PICO_ERROR_GENERIC
+//     Error attemptimg to claim a DMA channel
+int i2c_dma_transfer(
+  i2c_dma_t *i2c_dma,  // i2c_dma_t pointer for I2C0 or I2C1
+  i2c_dma_msg_t *msgs, // Messages to execute
+  size_t nmsgs         // Number of messages in msgs
+);
+
+// A block of bytes written to a device by i2c_dma_write_batch.
+typedef struct {
+  uint8_t addr;       // 7 bit I2C address
+  const uint8_t *buf; // Block of bytes to write
+  size_t len;         // Number of bytes to write
+} i2c_dma_write_t;
+
+// Executes the nwrites writes in writes one after the other and waits for
+// them to complete. Each write is a transaction of its own, so a sequence of
+// commands for one or more devices, such as the initialization of a display,
+// can be described by a table and executed with a single call. Commands for
+// a device that accepts several of them in one transaction, for example
+// after an SSD1306 control byte of 0x00, are faster sent with
+// i2c_dma_writev.
+//
+// I2C Transaction, for each write:
+// S addr Wr [A] buf(0) [A] buf(1) [A] ... [A] buf(len-1) [A] P
+//
+// The writes are queued as a whole and started directly from the I2C
+// interrupt handler as soon as the one before them completes, so they go
+// out back to back. The task is only woken once, when all writes have been
+// executed or one of them fails, in which case the rest aren't executed.
+// Between writes, a transaction with a higher priority that's waiting for
+// the bus is started first, as after a message with the I2C_DMA_M_STOP flag,
+// see i2c_dma_transfer.
+//
+// Returns
+//   PICO_OK
+//     Function completed successfully
+//   PICO_ERROR_INVALID_ARG
+//     Invalid argument passed to function
+//   PICO_ERROR_TIMEOUT
+//     Timeout waiting for the bus
+//     Timeout waiting for I2C transaction to complete
+//   PICO_ERROR_IO
+//     I2C transaction aborted by I2C peripheral
+//     No stop condition for transaction detected by I2C peripheral
+//   PICO_ERROR_GENERIC
+//     Error attemptimg to claim a DMA channel
+int i2c_dma_write_batch(
+  i2c_dma_t *i2c_dma,            // i2c_dma_t pointer for I2C0 or I2C1
+  const i2c_dma_write_t *writes, // Writes to execute
+  size_t nwrites                 // Number of writes in writes
+);
+
+// An i2c_dma_prepared_t holds a transaction that has been encoded once by
+// i2c_dma_prepare so that it can be executed any number of times by
+// i2c_dma_execute without being encoded and checked again. It's allocated by
+// the caller and its fields are set by i2c_dma_prepare.
+typedef struct {
+  i2c_dma_t *i2c_dma;        // i2c_dma_t the transaction is for
+  uint8_t addr;              // 7 bit I2C address
+  const uint16_t *data_cmds; // Encoded transaction
+  size_t data_cmds_len;      // Number of entries in data_cmds
+  size_t rbuf_len;           // Number of bytes of data to read or 0
+} i2c_dma_prepared_t;
+
+// Encodes a transaction that writes a block of bytes and/or reads a block of
+// bytes for execution with i2c_dma_execute. The transaction is the same as
+// for i2c_dma_write_read. The bytes to write are encoded when i2c_dma_prepare
+// is called, later changes to wbuf have no effect. data_cmds is where the
+// encoded transaction is stored, it must have room for wbuf_len + rbuf_len
+// entries and must remain valid and unmodified for as long as prepared is
+// used.
+//
+// Returns
+//   PICO_OK
+//     Function completed successfully
+//   PICO_ERROR_INVALID_ARG
+//     Invalid argument passed to function
+int i2c_dma_prepare(
+  i2c_dma_t *i2c_dma,           // i2c_dma_t pointer for I2C0 or I2C1
+  i2c_dma_prepared_t *prepared, // Prepared transaction to initialize
+  uint16_t *data_cmds,          // Storage for the encoded transaction
+  uint8_t addr,                 // 7 bit I2C address
+  const uint8_t *wbuf,          // Pointer to block of bytes to write or NULL
+  size_t wbuf_len,              // Length of block of bytes to write or 0
+  size_t rbuf_len               // Number of bytes of data to read or 0
+);
+
+// Executes a transaction prepared with i2c_dma_prepare and waits for it to
+// complete. Other than encoding the transaction, it does the same as
+// i2c_dma_write_read.
+//
+// Returns
+//   PICO_OK
+//     Function completed successfully
+//   PICO_ERROR_INVALID_ARG
+//     Invalid argument passed to function
+//   PICO_ERROR_TIMEOUT
+//     Timeout waiting for the bus
+//     Timeout waiting for I2C transaction to complete
+//   PICO_ERROR_IO
+//     I2C transaction aborted by I2C peripheral
+//     No stop condition for transaction detected by I2C peripheral
+//   PICO_ERROR_GENERIC
+//     Error attemptimg to claim a DMA channel
+int i2c_dma_execute(
+  const i2c_dma_prepared_t *prepared, // Transaction from i2c_dma_prepare
+  uint8_t *rbuf                       // Block for data read or NULL
+);
+
+// An i2c_dma_xfer_t describes a transaction started with i2c_dma_submit.
+// It's allocated by the caller and the caller sets the fields in the first
+// group below. The fields in the second group are maintained by the i2c_dma_*
+// functions and must be zero before the first call to i2c_dma_submit, for
+// example by using a designated initializer. From the call to i2c_dma_submit
+// until the transaction is complete, the i2c_dma_xfer_t and the buffers it
+// points to must remain valid and must not be modified.
+typedef struct i2c_dma_xfer_s i2c_dma_xfer_t;
+
+// Function called when a transaction started with i2c_dma_submit is
+// complete. It's usually called from the I2C interrupt handler, in which
+// case from_isr is true. It's called from a task, with from_isr false, if
+// the transaction completes on a timeout or abort path detected there: a
+// timeout detected by i2c_dma_wait, a deadline for the bus that expired or a
+// failure to claim a DMA channel. That task needn't be the one that
+// submitted xfer. Either way the callback must be short and must not call
+// i2c_dma_* functions or blocking FreeRTOS functions. FreeRTOS functions
+// ending in FromISR can be used if from_isr is true, their task counterparts
+// otherwise. xfer->rc has already been set. Without an RTOS, the callback
+// can signal the main loop with a volatile flag.
+typedef void (*i2c_dma_callback_t)(
+  i2c_dma_xfer_t *xfer, void *arg, bool from_isr
+);
+
+struct i2c_dma_xfer_s {
+  uint8_t addr;                // 7 bit I2C address
+  const uint8_t *wbuf;         // Block of bytes to write or NULL
+  size_t wbuf_len;             // Length of block of bytes to write or 0
+  uint8_t *rbuf;               // Block of bytes for data read or NULL
+  size_t rbuf_len;             // Number of bytes of data to read or 0
+  i2c_dma_callback_t callback; // Called on completion or NULL
+  void *callback_arg;          // Second argument passed to callback
+  const i2c_dma_iovec_t *wiov; // Segments to write instead of wbuf or NULL
+  size_t wiovcnt;              // Number of segments in wiov
+  i2c_dma_msg_t *msgs;         // Messages to execute instead or NULL
+  size_t nmsgs;                // Number of messages in msgs
+  const i2c_dma_write_t *writes; // Writes to execute instead or NULL
+  size_t nwrites;              // Number of writes in writes
+  uint32_t timeout_ms;         // Timeout or I2C_DMA_TIMEOUT_DEFAULT
+  uint8_t priority;            // Priority or I2C_DMA_PRIORITY_TASK
+  uint32_t deadline_ms;        // Time to get the bus or I2C_DMA_TIMEOUT_DEFAULT
+
+  i2c_dma_t *i2c_dma;          // i2c_dma_t the transaction was submitted to
+  i2c_dma_iovec_t wbuf_iov;    // wbuf and wbuf_len as a segment
+  size_t len;                  // Number of bytes to write and read
+  size_t rlen;                 // Number of bytes to read
+  i2c_dma_xfer_t *next;        // Next transaction in the queue
+  const i2c_dma_prepared_t *prepared; // Encoded transaction or NULL
+  uint64_t submit_us;          // Time submitted, for statistics and trace
+  uint64_t start_us;           // Time started on the bus, ditto
+  uint32_t abort_source;       // IC_TX_ABRT_SOURCE if aborted, for trace
+  void *waiter;                // Waiting task, see i2c_dma_os.h
+  uint32_t submit_tick;        // Tick count when submitted
+  uint32_t deadline_ticks;     // Ticks it may wait for the bus, 0 if no limit
+  size_t resume_piece;         // Piece to resume at after a safe point or 0
+  uint8_t prio;                // Priority in the queue
+  uint8_t bypassed;            // Times overtaken in the queue
+  volatile int rc;             // Result, valid once done is true
+  volatile bool done;          // Set to true when the transaction is complete
+};
+
+// Starts a transaction that writes a block of bytes and/or reads a block of
+// bytes and returns without waiting for it to complete. The transaction is
+// the same as for i2c_dma_write_read, or for i2c_dma_write_readv if
+// xfer->wiov isn't NULL, in which case xfer->wbuf and xfer->wbuf_len are
+// ignored. If xfer->msgs isn't NULL, the transaction is the same as for
+// i2c_dma_transfer and xfer->addr, xfer->wbuf, xfer->wiov and xfer->rbuf and
+// their lengths are ignored. Likewise, if xfer->writes isn't NULL, the
+// transaction is the same as for i2c_dma_write_batch.
+//
+// Only one transaction at a time can be on an I2C bus. If the bus is busy,
+// xfer is queued. Queued transactions are started directly from the I2C
+// interrupt handler when the transaction before them completes, so there's
+// next to no idle time on the bus between them. i2c_dma_submit doesn't
+// block, except when it reinitializes the I2C peripheral after a timeout.
+//
+// Queued transactions are started highest priority first and, with the same
+// priority, in the order they were submitted. The priority is
+// xfer->priority, 1 to 255, or if that's I2C_DMA_PRIORITY_TASK, the
+// FreeRTOS priority of the submitting task, 0 without an RTOS. The
+// transactions of the i2c_dma_* functions that wait for completion always
+// have the priority of the calling task. So that low priority transactions
+// aren't starved, a queued transaction can only be overtaken by 4 others,
+// see I2C_DMA_MAX_BYPASS in i2c_dma.c. A transaction on the bus isn't
+// interrupted, except at I2C_DMA_M_STOP safe points, see i2c_dma_transfer.
+//
+// xfer->deadline_ms limits the time xfer waits for the bus. If it isn't
+// started in time, it completes with xfer->rc set to PICO_ERROR_TIMEOUT
+// without using the bus. If it's I2C_DMA_TIMEOUT_DEFAULT, the timeout set
+// with i2c_dma_set_mutex_timeout applies.
+//
+// Completion can be detected in any combination of the following ways:
+//   - xfer->callback is called, usually from the I2C interrupt handler, see
+//     i2c_dma_callback_t
+//   - i2c_dma_done returns true
+//   - i2c_dma_wait returns
+// To be woken by a task notification, set xfer->callback to
+// i2c_dma_notify_task and xfer->callback_arg to the handle of the task to
+// notify.
+//
+// A transaction that never completes, for example because SDA is stuck low,
+// is detected by i2c_dma_wait. It then completes with xfer->rc set to
+// PICO_ERROR_TIMEOUT and the I2C peripheral is reinitialized before the
+// next queued transaction is started.
+//
+// Returns
+//   PICO_OK
+//     Transaction started or queued, the result will be in xfer->rc
+//   PICO_ERROR_INVALID_ARG
+//     Invalid argument passed to function
+//     xfer is still in progress
+//   PICO_ERROR_GENERIC
+//     Error attemptimg to claim a DMA channel, xfer is complete with
+//     xfer->rc set to PICO_ERROR_GENERIC and its callback has been called
+int i2c_dma_submit(
+  i2c_dma_t *i2c_dma,  // i2c_dma_t pointer for I2C0 or I2C1
+  i2c_dma_xfer_t *xfer // Transaction to start
+);
+
+// Returns true if a transaction started with i2c_dma_submit is complete.
+// Doesn't block.
+static inline bool i2c_dma_done(
+  const i2c_dma_xfer_t *xfer // Transaction started with i2c_dma_submit
+) {
+  return xfer->done;
+}
+
+// Waits for a transaction started with i2c_dma_submit to complete and
+// returns its result. Returns immediately if the transaction is already
+// complete.
+//
+// Returns
+//   PICO_OK
+//     Transaction completed successfully
+//   PICO_ERROR_INVALID_ARG
+//     Invalid argument passed to function
+//     xfer was never submitted
+//   PICO_ERROR_TIMEOUT
+//     Timeout waiting for the bus
+//     Timeout waiting for I2C transaction to complete
+//   PICO_ERROR_IO
+//     I2C transaction aborted by I2C peripheral
+//     No stop condition for transaction detected by I2C peripheral
+int i2c_dma_wait(
+  i2c_dma_xfer_t *xfer // Transaction started with i2c_dma_submit
+);
+
+// An i2c_dma_callback_t that notifies the task whose TaskHandle_t is passed
+// as arg with vTaskNotifyGiveFromISR, or with xTaskNotifyGive if it's called
+// from a task. The task can wait for the notification with ulTaskNotifyTake.
+// If I2C_DMA_BARE_METAL is defined, arg is ignored and an event is sent to
+// wake cores waiting with __wfe.
+void i2c_dma_notify_task(i2c_dma_xfer_t *xfer, void *task, bool from_isr);
+
+// An i2c_dma_periodic_t executes a prepared transaction that reads from a
+// device at a fixed period, for example reading the temperature register of
+// a sensor every 10ms. A hardware alarm of the Pico SDK's default alarm pool
+// submits the transaction from its interrupt handler and the I2C interrupt
+// handler publishes the data read as a sample with a sequence number, so no
+// task runs to poll the device. Consumers call i2c_dma_periodic_read to get
+// the latest sample whenever they need it.
+//
+// It's allocated by the caller and the caller sets the fields in the first
+// group below. The fields in the second group are maintained by the
+// i2c_dma_periodic_* functions. From the call to i2c_dma_periodic_start until
+// i2c_dma_periodic_stop returns, the i2c_dma_periodic_t, the prepared
+// transaction and buf must remain valid and must not be modified.
+typedef struct i2c_dma_periodic_s i2c_dma_periodic_t;
+
+// Function called each time a periodic job has published a sample. It's
+// called in the same contexts and with the same restrictions as an
+// i2c_dma_callback_t, from_isr tells which. The sample can be fetched with
+// i2c_dma_periodic_read.
+typedef void (*i2c_dma_periodic_callback_t)(
+  i2c_dma_periodic_t *job, void *arg, bool from_isr
+);
+
+struct i2c_dma_periodic_s {
+  const i2c_dma_prepared_t *prepared;   // Transaction to execute, must read
+  uint8_t *buf;                         // Room for two samples of rbuf_len
+  uint32_t period_us;                   // Time from one start to the next
+  uint8_t priority;                     // Priority or I2C_DMA_PRIORITY_TASK
+  i2c_dma_periodic_callback_t callback; // Called for each sample or NULL
+  void *callback_arg;                   // Second argument passed to callback
+
+  i2c_dma_xfer_t xfer;                  // The transaction
+  repeating_timer_t timer;              // Alarm starting the transactions
+  volatile uint32_t seq;                // Number of samples published
+  volatile uint32_t errors;             // Transactions that failed
+  volatile uint32_t overruns;           // Periods skipped, still in progress
+  volatile int last_rc;                 // Result of the last failure
+  volatile bool busy;                   // The transaction is in progress
+  volatile bool running;                // Between start and stop
+};
+
+// Starts executing job->prepared every job->period_us microseconds. The
+// first transaction is started one period after i2c_dma_periodic_start is
+// called. Samples are read alternately into the two halves of job->buf, so
+// the latest sample is never overwritten while it's being fetched by
+// i2c_dma_periodic_read. The sequence number and the counters in job start
+// from 0.
+//
+// The transactions are queued like those of i2c_dma_submit. Their priority
+// is job->priority, or if that's I2C_DMA_PRIORITY_TASK, the priority of the
+// task calling i2c_dma_periodic_start. A transaction that can't get the bus
+// within one period, or at least 1ms, completes with PICO_ERROR_TIMEOUT and
+// is counted in job->errors. If a transaction is still in progress when the
+// next one is due, that period is skipped and counted in job->overruns.
+//
+// A transaction that never completes is timed out by the alarm handler. As
+// with i2c_dma_submit, the I2C peripheral is then reinitialized by the next
+// call to an i2c_dma_* function from a task, i2c_dma_periodic_read included.
+//
+// Returns
+//   PICO_OK
+//     Function completed successfully
+//   PICO_ERROR_INVALID_ARG
+//     Invalid argument passed to function
+//     job is already running or still busy, see i2c_dma_periodic_stop
+//   PICO_ERROR_GENERIC
+//     No alarm available in the default alarm pool
+int i2c_dma_periodic_start(
+  i2c_dma_periodic_t *job // Periodic job to start
+);
+
+// Stops a periodic job and waits for its transaction to complete if one is
+// in progress. The last sample can still be fetched with
+// i2c_dma_periodic_read and the job can be started again. If the completion
+// callback of the transaction doesn't run within 1s of it completing, for
+// example because it runs in a task that the caller starves,
+// PICO_ERROR_TIMEOUT is returned. The job is stopped but still busy, and
+// i2c_dma_periodic_stop can be called again to wait for it.
+//
+// Returns
+//   PICO_OK
+//     Function completed successfully
+//   PICO_ERROR_INVALID_ARG
+//     Invalid argument passed to function
+//     job isn't running and isn't busy
+//   PICO_ERROR_TIMEOUT
+//     Timeout waiting for the completion callback of the transaction
+int i2c_dma_periodic_stop(
+  i2c_dma_periodic_t *job // Periodic job to stop
+);
+
+// Copies the latest sample of a periodic job to sample, which must have room
+// for job->prepared->rbuf_len bytes, and returns its sequence number. The
+// sequence number is 1 for the first sample and increases by one for each
+// sample, so comparing it with the one returned by the previous call tells
+// whether a sample is new and how many were missed. Returns 0 and leaves
+// sample unmodified if there's no sample yet. sample may be NULL to only get
+// the sequence number. Doesn't block, except when it reinitializes the I2C
+// peripheral after a timeout.
+uint32_t i2c_dma_periodic_read(
+  i2c_dma_periodic_t *job, // Periodic job to read from
+  uint8_t *sample          // Copy of the latest sample or NULL
+);
+
 // Writes a block of bytes.
 //
 // I2C Transaction:
@@ -97,13 +806,12 @@ int i2c_dma_write_read(
 //   PICO_ERROR_INVALID_ARG
 //     Invalid argument passed to function
 //   PICO_ERROR_TIMEOUT
-//     Timeout waiting to take a mutex
+//     Timeout waiting for the bus
 //     Timeout waiting for I2C transaction to complete
 //   PICO_ERROR_IO
 //     I2C transaction aborted by I2C peripheral
 //     No stop condition for transaction detected by I2C peripheral
 //   PICO_ERROR_GENERIC
-//     Error attempting to give a mutex
 //     Error attemptimg to claim a DMA channel
 static inline int i2c_dma_write(
   i2c_dma_t *i2c_dma,  // i2c_dma_t pointer for I2C0 or I2C1
@@ -114,6 +822,33 @@ static inline int i2c_dma_write(
   return i2c_dma_write_read(i2c_dma, addr, wbuf, wbuf_len, NULL, 0);
 }
 
+// Writes a block of bytes made up of the wiovcnt segments in wiov.
+//
+// I2C Transaction, where wbuf is wiov[0], wiov[1], ... wiov[wiovcnt-1]:
+// S addr Wr [A] wbuf(0) [A] wbuf(1) [A] ... [A] wbuf(wbuf_len-1) [A] P
+//
+// Returns
+//   PICO_OK
+//     Function completed successfully
+//   PICO_ERROR_INVALID_ARG
+//     Invalid argument passed to function
+//   PICO_ERROR_TIMEOUT
+//     Timeout waiting for the bus
+//     Timeout waiting for I2C transaction to complete
+//   PICO_ERROR_IO
+//     I2C transaction aborted by I2C peripheral
+//     No stop condition for transaction detected by I2C peripheral
+//   PICO_ERROR_GENERIC
+//     Error attemptimg to claim a DMA channel
+static inline int i2c_dma_writev(
+  i2c_dma_t *i2c_dma,          // i2c_dma_t pointer for I2C0 or I2C1
+  uint8_t addr,                // 7 bit I2C address
+  const i2c_dma_iovec_t *wiov, // Segments of bytes to write
+  size_t wiovcnt               // Number of segments in wiov
+) {
+  return i2c_dma_write_readv(i2c_dma, addr, wiov, wiovcnt, NULL, 0);
+}
+
 // Reads a block of bytes.
 //
 // I2C Transaction:
@@ -125,13 +860,12 @@ static inline int i2c_dma_write(
 //   PICO_ERROR_INVALID_ARG
 //     Invalid argument passed to function
 //   PICO_ERROR_TIMEOUT
-//     Timeout waiting to take a mutex
+//     Timeout waiting for the bus
 //     Timeout waiting for I2C transaction to complete
 //   PICO_ERROR_IO
 //     I2C transaction aborted by I2C peripheral
 //     No stop condition for transaction detected by I2C peripheral
 //   PICO_ERROR_GENERIC
-//     Error attempting to give a mutex
 //     Error attemptimg to claim a DMA channel
 static inline int i2c_dma_read(
   i2c_dma_t *i2c_dma, // i2c_dma_t pointer for I2C0 or I2C1
@@ -153,13 +887,12 @@ static inline int i2c_dma_read(
 //   PICO_ERROR_INVALID_ARG
 //     Invalid argument passed to function
 //   PICO_ERROR_TIMEOUT
-//     Timeout waiting to take a mutex
+//     Timeout waiting for the bus
 //     Timeout waiting for I2C transaction to complete
 //   PICO_ERROR_IO
 //     I2C transaction aborted by I2C peripheral
 //     No stop condition for transaction detected by I2C peripheral
 //   PICO_ERROR_GENERIC
-//     Error attempting to give a mutex
 //     Error attemptimg to claim a DMA channel
 static inline int i2c_dma_write_byte(
   i2c_dma_t *i2c_dma, // i2c_dma_t pointer for I2C0 or I2C1
@@ -182,13 +915,12 @@ static inline int i2c_dma_write_byte(
 //   PICO_ERROR_INVALID_ARG
 //     Invalid argument passed to function
 //   PICO_ERROR_TIMEOUT
-//     Timeout waiting to take a mutex
+//     Timeout waiting for the bus
 //     Timeout waiting for I2C transaction to complete
 //   PICO_ERROR_IO
 //     I2C transaction aborted by I2C peripheral
 //     No stop condition for transaction detected by I2C peripheral
 //   PICO_ERROR_GENERIC
-//     Error attempting to give a mutex
 //     Error attemptimg to claim a DMA channel
 static inline int i2c_dma_read_byte(
   i2c_dma_t *i2c_dma, // i2c_dma_t pointer for I2C0 or I2C1
@@ -211,13 +943,12 @@ static inline int i2c_dma_read_byte(
 //   PICO_ERROR_INVALID_ARG
 //     Invalid argument passed to function
 //   PICO_ERROR_TIMEOUT
-//     Timeout waiting to take a mutex
+//     Timeout waiting for the bus
 //     Timeout waiting for I2C transaction to complete
 //   PICO_ERROR_IO
 //     I2C transaction aborted by I2C peripheral
 //     No stop condition for transaction detected by I2C peripheral
 //   PICO_ERROR_GENERIC
-//     Error attempting to give a mutex
 //     Error attemptimg to claim a DMA channel
 static inline int i2c_dma_write_word(
   i2c_dma_t *i2c_dma, // i2c_dma_t pointer for I2C0 or I2C1
@@ -241,13 +972,12 @@ static inline int i2c_dma_write_word(
 //   PICO_ERROR_INVALID_ARG
 //     Invalid argument passed to function
 //   PICO_ERROR_TIMEOUT
-//     Timeout waiting to take a mutex
+//     Timeout waiting for the bus
 //     Timeout waiting for I2C transaction to complete
 //   PICO_ERROR_IO
 //     I2C transaction aborted by I2C peripheral
 //     No stop condition for transaction detected by I2C peripheral
 //   PICO_ERROR_GENERIC
-//     Error attempting to give a mutex
 //     Error attemptimg to claim a DMA channel
 static inline int i2c_dma_read_word(
   i2c_dma_t *i2c_dma, // i2c_dma_t pointer for I2C0 or I2C1
@@ -270,13 +1000,12 @@ static inline int i2c_dma_read_word(
 //   PICO_ERROR_INVALID_ARG
 //     Invalid argument passed to function
 //   PICO_ERROR_TIMEOUT
-//     Timeout waiting to take a mutex
+//     Timeout waiting for the bus
 //     Timeout waiting for I2C transaction to complete
 //   PICO_ERROR_IO
 //     I2C transaction aborted by I2C peripheral
 //     No stop condition for transaction detected by I2C peripheral
 //   PICO_ERROR_GENERIC
-//     Error attempting to give a mutex
 //     Error attemptimg to claim a DMA channel
 static inline int i2c_dma_write_word_swapped(
   i2c_dma_t *i2c_dma, // i2c_dma_t pointer for I2C0 or I2C1
@@ -300,13 +1029,12 @@ static inline int i2c_dma_write_word_swapped(
 //   PICO_ERROR_INVALID_ARG
 //     Invalid argument passed to function
 //   PICO_ERROR_TIMEOUT
-//     Timeout waiting to take a mutex
+//     Timeout waiting for the bus
 //     Timeout waiting for I2C transaction to complete
 //   PICO_ERROR_IO
 //     I2C transaction aborted by I2C peripheral
 //     No stop condition for transaction detected by I2C peripheral
 //   PICO_ERROR_GENERIC
-//     Error attempting to give a mutex
 //     Error attemptimg to claim a DMA channel
 static inline int i2c_dma_read_word_swapped(
   i2c_dma_t *i2c_dma, // i2c_dma_t pointer for I2C0 or I2C1
@@ -319,6 +1047,204 @@ static inline int i2c_dma_read_word_swapped(
   return rc;
 }
 
+// An i2c_dma_regcache_t keeps copies of the values of registers on a device
+// so that reading a register whose value hasn't changed doesn't need a
+// transaction on the bus. It's useful for registers that never change, like
+// chip IDs and calibration data, and for configuration registers that only
+// change when they're written by the host. Registers are read and written as
+// with i2c_dma_write_read, a register byte followed by its value.
+//
+// The caller describes the registers to cache with an array of i2c_dma_reg_t
+// and passes it to i2c_dma_regcache_init. Registers not in the array aren't
+// cached. A register's value may be longer than a byte, for 16-bit registers
+// or blocks of registers read in one go, such as the calibration data of a
+// BME280. A cache can be shared by tasks.
+
+// Caching policies for i2c_dma_reg_t.policy.
+typedef enum {
+  I2C_DMA_REG_VOLATILE = 0, // Always read from the device
+  I2C_DMA_REG_CACHED,       // Read once, kept up to date by writes
+  I2C_DMA_REG_TTL,          // As I2C_DMA_REG_CACHED, read again after ttl_ms
+} i2c_dma_reg_policy_t;
+
+// A register in an i2c_dma_regcache_t. The caller sets the fields in the
+// first group below, the fields in the second group are maintained by the
+// i2c_dma_regcache_* functions. hits and misses can be used to tune the
+// policies.
+typedef struct {
+  uint8_t reg;                 // Number of the register
+  size_t len;                  // Length of the register's value in bytes
+  i2c_dma_reg_policy_t policy; // How the value is cached
+  uint32_t ttl_ms;             // Lifetime of the value for I2C_DMA_REG_TTL
+  uint8_t *value;              // Storage for len bytes, NULL if volatile
+
+  uint64_t update_us;          // Time value was last read or written
+  uint32_t hits;               // Reads answered from value
+  uint32_t misses;             // Reads that needed a transaction
+  bool valid;                  // value holds the value of the register
+} i2c_dma_reg_t;
+
+typedef struct {
+  i2c_dma_t *i2c_dma;          // i2c_dma_t the device is on
+  uint8_t addr;                // 7 bit I2C address of the device
+  i2c_dma_reg_t *regs;         // The cached registers
+  size_t nregs;                // Number of registers in regs
+  uint32_t hits;               // Reads answered from the cache
+  uint32_t misses;             // Reads of registers in regs that weren't
+  uint32_t uncached;           // Reads of registers not in regs
+  uint32_t seq;                // Incremented when writes start and end
+} i2c_dma_regcache_t;
+
+// Initializes a register cache for the device at addr with the nregs
+// registers in regs. Nothing is read from the device, values are cached the
+// first time they're read or written. regs must remain valid for as long as
+// cache is used.
+//
+// Returns
+//   PICO_OK
+//     Function completed successfully
+//   PICO_ERROR_INVALID_ARG
+//     Invalid argument passed to function
+//     A register is in regs more than once
+int i2c_dma_regcache_init(
+  i2c_dma_regcache_t *cache, // Register cache to initialize
+  i2c_dma_t *i2c_dma,        // i2c_dma_t pointer for I2C0 or I2C1
+  uint8_t addr,              // 7 bit I2C address
+  i2c_dma_reg_t *regs,       // Registers to cache
+  size_t nregs               // Number of registers in regs
+);
+
+// Reads len bytes from a register. If the register is cached, its value is
+// valid and, for I2C_DMA_REG_TTL, not older than ttl_ms, the bytes are copied
+// from the cache without a transaction. len may be less than the length of
+// the register's value, the first len bytes are copied. Otherwise the
+// register is read from the device and, if len is the length of the
+// register's value, the value is cached.
+//
+// I2C Transaction, if any:
+// S addr Wr [A] reg [A] Sr addr Rd [A] [rbuf(0)] A ... A [rbuf(len-1)] NA P
+//
+// Returns
+//   PICO_OK
+//     Function completed successfully
+//   PICO_ERROR_INVALID_ARG
+//     Invalid argument passed to function
+//   PICO_ERROR_TIMEOUT
+//     Timeout waiting for the bus
+//     Timeout waiting for I2C transaction to complete
+//   PICO_ERROR_IO
+//     I2C transaction aborted by I2C peripheral
+//     No stop condition for transaction detected by I2C peripheral
+//   PICO_ERROR_GENERIC
+//     Error attemptimg to claim a DMA channel
+int i2c_dma_regcache_read(
+  i2c_dma_regcache_t *cache, // Register cache of the device
+  uint8_t reg,               // Number of the register to read from
+  uint8_t *rbuf,             // Block for the data read
+  size_t len                 // Number of bytes to read
+);
+
+// Writes len bytes to a register. Writes always go to the device, which is
+// expected to increment its register pointer after each byte, so the bytes
+// after the first go to the registers that follow reg. The cached values of
+// registers in [reg, reg + len) are updated if the bytes written cover them
+// completely. Values only partly covered, and all those covered by a write
+// that fails, are invalidated as the device may have taken some of the
+// bytes.
+//
+// I2C Transaction:
+// S addr Wr [A] reg [A] wbuf(0) [A] ... [A] wbuf(len-1) [A] P
+//
+// Returns
+//   PICO_OK
+//     Function completed successfully
+//   PICO_ERROR_INVALID_ARG
+//     Invalid argument passed to function
+//   PICO_ERROR_TIMEOUT
+//     Timeout waiting for the bus
+//     Timeout waiting for I2C transaction to complete
+//   PICO_ERROR_IO
+//     I2C transaction aborted by I2C peripheral
+//     No stop condition for transaction detected by I2C peripheral
+//   PICO_ERROR_GENERIC
+//     Error attemptimg to claim a DMA channel
+int i2c_dma_regcache_write(
+  i2c_dma_regcache_t *cache, // Register cache of the device
+  uint8_t reg,               // Number of the register to write to
+  const uint8_t *wbuf,       // Block of bytes to write
+  size_t len                 // Number of bytes to write
+);
+
+// Invalidates all cached values, for example after resetting the device, so
+// they're read from the device again. Doesn't block.
+void i2c_dma_regcache_invalidate(
+  i2c_dma_regcache_t *cache // Register cache of the device
+);
+
+// i2c_dma_read_byte through a register cache. Returns the same as
+// i2c_dma_regcache_read.
+static inline int i2c_dma_regcache_read_byte(
+  i2c_dma_regcache_t *cache, // Register cache of the device
+  uint8_t reg,               // Number of the register to read from
+  uint8_t *byte              // Pointer to the byte for the data read
+) {
+  return i2c_dma_regcache_read(cache, reg, byte, 1);
+}
+
+// i2c_dma_write_byte through a register cache. Returns the same as
+// i2c_dma_regcache_write.
+static inline int i2c_dma_regcache_write_byte(
+  i2c_dma_regcache_t *cache, // Register cache of the device
+  uint8_t reg,               // Number of the register to write to
+  uint8_t byte               // Byte to write
+) {
+  return i2c_dma_regcache_write(cache, reg, &byte, 1);
+}
+
+// i2c_dma_read_word through a register cache. Returns the same as
+// i2c_dma_regcache_read.
+static inline int i2c_dma_regcache_read_word(
+  i2c_dma_regcache_t *cache, // Register cache of the device
+  uint8_t reg,               // Number of the register to read from
+  uint16_t *word             // Pointer to the 16-bit word for the data read
+) {
+  return i2c_dma_regcache_read(cache, reg, (uint8_t *) word, 2);
+}
+
+// i2c_dma_write_word through a register cache. Returns the same as
+// i2c_dma_regcache_write.
+static inline int i2c_dma_regcache_write_word(
+  i2c_dma_regcache_t *cache, // Register cache of the device
+  uint8_t reg,               // Number of the register to write to
+  uint16_t word              // 16-bit word to write
+) {
+  const uint8_t wbuf[2] = {word & 0xff, word >> 8};
+  return i2c_dma_regcache_write(cache, reg, wbuf, 2);
+}
+
+// i2c_dma_read_word_swapped through a register cache. Returns the same as
+// i2c_dma_regcache_read.
+static inline int i2c_dma_regcache_read_word_swapped(
+  i2c_dma_regcache_t *cache, // Register cache of the device
+  uint8_t reg,               // Number of the register to read from
+  uint16_t *word             // Pointer to the 16-bit word for the data read
+) {
+  int rc = i2c_dma_regcache_read(cache, reg, (uint8_t *) word, 2);
+  *word = *word << 8 | *word >> 8;
+  return rc;
+}
+
+// i2c_dma_write_word_swapped through a register cache. Returns the same as
+// i2c_dma_regcache_write.
+static inline int i2c_dma_regcache_write_word_swapped(
+  i2c_dma_regcache_t *cache, // Register cache of the device
+  uint8_t reg,               // Number of the register to write to
+  uint16_t word              // 16-bit word to write
+) {
+  const uint8_t wbuf[2] = {word >> 8, word & 0xff};
+  return i2c_dma_regcache_write(cache, reg, wbuf, 2);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,196 @@
+#!/usr/bin/env python3
+"""Decodes a trace dumped with i2c_dma_trace_dump.
+
+The dump can be the raw binary output of i2c_dma_trace_dump or the same
+bytes as hex text, for example when the firmware prints the dump to a serial
+console. Prints a timeline of the traced transactions followed by a report
+per bus.
+
+    i2c_dma_trace.py trace.bin
+    i2c_dma_trace.py --hex trace.txt
+    i2c_dma_trace.py --report-only trace.bin
+"""
+
+import argparse
+import struct
+import sys
+
+HEADER = struct.Struct('<4sHHII')
+ENTRY = struct.Struct('<IIIIIIBBbB4s')
+MAGIC = b'I2CT'
+VERSION = 1
+
+RESULTS = {
+    0: 'OK',
+    -1: 'TIMEOUT',
+    -2: 'GENERIC',
+    -5: 'INVALID_ARG',
+    -6: 'IO',
+}
+
+# Bits of the RP2040 IC_TX_ABRT_SOURCE register.
+ABORT_SOURCES = [
+    (0, 'ADDR_NOACK'),
+    (1, '10ADDR1_NOACK'),
+    (2, '10ADDR2_NOACK'),
+    (3, 'TXDATA_NOACK'),
+    (4, 'GCALL_NOACK'),
+    (5, 'GCALL_READ'),
+    (6, 'HS_ACKDET'),
+    (7, 'SBYTE_ACKDET'),
+    (8, 'HS_NORSTRT'),
+    (9, 'SBYTE_NORSTRT'),
+    (10, '10B_RD_NORSTRT'),
+    (11, 'MASTER_DIS'),
+    (12, 'ARB_LOST'),
+    (13, 'SLVFLUSH_TXFIFO'),
+    (14, 'SLV_ARBLOST'),
+    (15, 'SLVRD_INTX'),
+    (16, 'USER_ABRT'),
+]
+
+
+class Entry:
+    def __init__(self, fields):
+        (self.seq, self.start_us, self.stop_us, self.wlen, self.rlen,
+         self.abort_source, self.bus, self.addr, self.rc, nbytes,
+         data) = fields
+        self.data = data[:nbytes]
+        # Times are 32 bit and wrap after about 71 minutes.
+        self.duration_us = (self.stop_us - self.start_us) & 0xffffffff
+
+
+def decode_abort_source(abort_source):
+    names = [name for bit, name in ABORT_SOURCES if abort_source & (1 << bit)]
+    return '|'.join(names) if names else '0x%x' % abort_source
+
+
+def parse(dump):
+    if len(dump) < HEADER.size:
+        raise ValueError('dump too short for header')
+
+    magic, version, entry_size, count, dropped = HEADER.unpack_from(dump)
+    if magic != MAGIC:
+        raise ValueError('bad magic %r' % magic)
+    if version != VERSION:
+        raise ValueError('unsupported version %d' % version)
+    if entry_size < ENTRY.size:
+        raise ValueError('entry size %d too small' % entry_size)
+    if len(dump) < HEADER.size + count * entry_size:
+        raise ValueError('dump truncated, expected %d entries' % count)
+
+    entries = []
+    for i in range(count):
+        offset = HEADER.size + i * entry_size
+        entries.append(Entry(ENTRY.unpack_from(dump, offset)))
+
+    return entries, dropped
+
+
+def unwrap(entries):
+    """Returns the start times of entries in microseconds relative to the
+    first one, allowing for the 32 bit timer wrapping."""
+    times = []
+    base = 0
+    previous = None
+    for entry in entries:
+        if previous is not None and entry.start_us < previous:
+            base += 1 << 32
+        previous = entry.start_us
+        times.append(base + entry.start_us)
+    first = times[0] if times else 0
+    return [t - first for t in times]
+
+
+def print_timeline(entries, out):
+    out.write('%8s %12s %10s %3s %4s %7s %7s %-11s %s\n' % (
+        'seq', 'start_us', 'dur_us', 'bus', 'addr', 'wlen', 'rlen',
+        'result', 'bytes'))
+
+    for entry, start in zip(entries, unwrap(entries)):
+        result = RESULTS.get(entry.rc, str(entry.rc))
+        if entry.abort_source:
+            result += ' ' + decode_abort_source(entry.abort_source)
+        out.write('%8d %12d %10d %3d 0x%02x %7d %7d %-11s %s\n' % (
+            entry.seq, start, entry.duration_us, entry.bus, entry.addr,
+            entry.wlen, entry.rlen, result, entry.data.hex(' ')))
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return 0
+    index = min(len(sorted_values) - 1, int(len(sorted_values) * p / 100))
+    return sorted_values[index]
+
+
+def print_report(entries, dropped, out):
+    out.write('entries=%d dropped=%d\n' % (len(entries), dropped))
+
+    for bus in sorted(set(entry.bus for entry in entries)):
+        bus_entries = [entry for entry in entries if entry.bus == bus]
+        starts = unwrap(bus_entries)
+        span_us = starts[-1] + bus_entries[-1].duration_us
+        busy_us = sum(entry.duration_us for entry in bus_entries)
+        durations = sorted(entry.duration_us for entry in bus_entries)
+        ok = [entry for entry in bus_entries if entry.rc == 0]
+
+        results = {}
+        for entry in bus_entries:
+            result = RESULTS.get(entry.rc, str(entry.rc))
+            results[result] = results.get(result, 0) + 1
+
+        addrs = {}
+        for entry in bus_entries:
+            addrs[entry.addr] = addrs.get(entry.addr, 0) + 1
+
+        out.write('bus=%d transactions=%d span_us=%d busy_us=%d '
+                  'utilization=%.3f\n' % (
+                      bus, len(bus_entries), span_us, busy_us,
+                      busy_us / span_us if span_us else 0))
+        out.write('  results: %s\n' % ' '.join(
+            '%s=%d' % item for item in sorted(results.items())))
+        out.write('  addrs: %s\n' % ' '.join(
+            '0x%02x=%d' % item for item in sorted(addrs.items())))
+        out.write('  bytes_written=%d bytes_read=%d\n' % (
+            sum(entry.wlen for entry in ok), sum(entry.rlen for entry in ok)))
+        out.write('  dur_us: p50=%d p99=%d max=%d\n' % (
+            percentile(durations, 50), percentile(durations, 99),
+            durations[-1]))
+
+
+def read_dump(path, hex_text):
+    if path == '-':
+        data = sys.stdin.buffer.read()
+    else:
+        with open(path, 'rb') as f:
+            data = f.read()
+
+    if hex_text:
+        data = bytes.fromhex(data.decode('ascii'))
+
+    return data
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Decode a trace dumped with i2c_dma_trace_dump.')
+    parser.add_argument('dump', help='dump file, - for stdin')
+    parser.add_argument('--hex', action='store_true',
+                        help='the dump is hex text rather than binary')
+    parser.add_argument('--report-only', action='store_true',
+                        help="don't print the timeline")
+    args = parser.parse_args()
+
+    try:
+        entries, dropped = parse(read_dump(args.dump, args.hex))
+    except ValueError as e:
+        sys.exit('i2c_dma_trace.py: %s' % e)
+
+    if not args.report_only:
+        print_timeline(entries, sys.stdout)
+        sys.stdout.write('\n')
+    print_report(entries, dropped, sys.stdout)
+
+
+if __name__ == '__main__':
+    main()